@@ -4,6 +4,27 @@
  * This file includes two main algorithms:
  * 1. Process 100-byte frames by removing duplicates and sorting
  * 2. Quick search for byte value 62 in 500-byte frames
+ * plus variants specialized for the fixed production frame lengths and
+ * distinct/sort kernels for frames of 16-bit and 32-bit symbols, and
+ * compile-time generated searchers for fixed sets of marker bytes.
+ * autotune_kernels() picks the fastest variant of each kernel for the host.
+ * Frames of at most SMALL_FRAME_MAX bytes are sorted with a SIMD bitonic
+ * network instead of the 256-entry histogram, and sorted frames can be
+ * queried with lower/upper bound, equal range, count and rank.
+ * Frames too large to buffer can be processed and searched chunk by chunk
+ * with the distinct_stream and search_stream kernels, and buffers of many
+ * megabytes can be split across a par_pool_t thread pool. frame_pipeline_run
+ * runs a configured chain of per-frame operators in one pass. crc32c and
+ * crc32c_copy check frame integrity, the latter while copying the frame.
+ * frame_gen_t produces reproducible synthetic frames from a seed, and
+ * format_hex_line/format_decimal render frames as text without printf.
+ * line_splitter_t cuts a text stream into lines and parse_u64 reads the
+ * numbers in them. frame_buf_t shares a received frame between consumers
+ * by reference, and perf_counter_* count hardware events for benchmarks.
+ * co_sched_t runs connection handlers as coroutines over epoll.
+ *
+ * Built on its own it runs the tests in main(); define ALGO_NO_MAIN to
+ * link the kernels into another program.
  */
 
 #include <stdio.h>
@@ -12,18 +33,29 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/perf_event.h>
+#endif
 
-/* Constants */
-#define FRAME_LEN_100 100
-#define FRAME_LEN_500 500
-#define SEARCH_BYTE 62
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-/* Function prototypes */
-int process_byte_frame(uint8_t *data, int data_len, uint8_t *result, int *result_len);
-int binary_search_for_byte(uint8_t *data, int data_len, uint8_t target);
-int linear_search_for_byte(uint8_t *data, int data_len, uint8_t target);
-void print_data(uint8_t *data, int data_len);
-int generate_test_data(uint8_t *buffer, int size);
+#include "algo.h"
+#include "frame.h"
 
 
 
@@ -75,44 +107,2994 @@ int binary_search_for_byte(uint8_t *data, int data_len, uint8_t target){
         return -1;
     }
 
-    int left = 0;   // left index
-    int right = data_len - 1; // right index
+    // the first occurrence is where target would be inserted
+    int pos = sorted_lower_bound(data, data_len, target);
+    if(pos < data_len && data[pos] == target){
+        return pos;
+    }
+    return -1;
+}
+
+/**
+ * sorted_lower_bound:
+ * index of the first byte >= target in sorted data (data_len if none)
+ * branchless: the window [base, base + len) always holds the answer and
+ * halves every step through a conditional move instead of a branch
+ */
+int sorted_lower_bound(const uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return 0;
+    }
+    const uint8_t *base = data;
+    int len = data_len;
+    while(len > 1){
+        int half = len / 2;
+        base = base[half - 1] < target ? base + half : base;
+        len -= half;
+    }
+    return (int)(base - data) + (*base < target);
+}
+
+/**
+ * sorted_upper_bound:
+ * index of the first byte > target in sorted data (data_len if none)
+ */
+int sorted_upper_bound(const uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return 0;
+    }
+    const uint8_t *base = data;
+    int len = data_len;
+    while(len > 1){
+        int half = len / 2;
+        base = base[half - 1] <= target ? base + half : base;
+        len -= half;
+    }
+    return (int)(base - data) + (*base <= target);
+}
+
+/**
+ * sorted_equal_range:
+ * [*first, *last) is the run of target bytes in sorted data
+ * (empty, with *first == *last at the insertion point, if target is absent)
+ */
+void sorted_equal_range(const uint8_t *data, int data_len, uint8_t target, int *first, int *last){
+    *first = sorted_lower_bound(data, data_len, target);
+    *last = sorted_upper_bound(data, data_len, target);
+}
+
+/**
+ * sorted_count:
+ * number of occurrences of target in sorted data
+ */
+int sorted_count(const uint8_t *data, int data_len, uint8_t target){
+    return sorted_upper_bound(data, data_len, target) - sorted_lower_bound(data, data_len, target);
+}
+
+/**
+ * sorted_rank:
+ * number of bytes strictly below target, the same as its lower bound
+ * in sorted data; counted 16 bytes at a time, so unlike the bounds it
+ * also works on unsorted frames
+ */
+int sorted_rank(const uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return 0;
+    }
+    int rank = 0;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i t = _mm_set1_epi8((char)target);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 16 <= data_len; i += 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(data + i));
+        // t - x saturates to 0 exactly when x >= t
+        __m128i ge = _mm_cmpeq_epi8(_mm_subs_epu8(t, chunk), zero);
+        rank += 16 - __builtin_popcount(_mm_movemask_epi8(ge));
+    }
+#endif
+    for(; i < data_len; i++){
+        rank += data[i] < target;
+    }
+    return rank;
+}
+
+/**
+ * sorted_index_build:
+ * prefix-count table for a frame queried many times: below[v] is the
+ * number of bytes < v, built with one histogram pass over the data (which
+ * need not be sorted), after which lower/upper bound, count and rank are
+ * single table loads
+ */
+void sorted_index_build(const uint8_t *data, int data_len, sorted_index_t *index){
+    uint32_t count[256] = {0};
+    for(int i = 0; i < data_len; i++){
+        count[data[i]]++;
+    }
+    index->below[0] = 0;
+    for(int v = 0; v < 256; v++){
+        index->below[v + 1] = index->below[v] + count[v];
+    }
+}
+
+/**
+ * linear_search_for_byte:
+ * search for target byte in input data array (length = data_len)
+ * return the index of the first occurrence of target byte
+ * return -1 if target byte is not found
+ */
+int linear_search_for_byte(uint8_t *data, int data_len, uint8_t target){
+    // check input parameters
+    if(data == NULL || data_len <= 0){
+        return -1;
+    }
+
+    // simple linear search
+    for(int i = 0; i < data_len; i++){
+        if(data[i] == target){   // target found
+            return i;           // return the index of the target byte found
+        }
+    }
+    return -1;                  // target not found
+}
+
+/**
+ * Fixed-length kernel bodies. They are always inlined into wrappers that
+ * pass a constant frame length, so the compiler sees the exact number of
+ * 16-byte blocks and the tail size: the block loops get unrolled and the
+ * tail handling below folds down to a single masked block (or vanishes
+ * when the length is a multiple of 16).
+ */
+static inline __attribute__((always_inline))
+int process_byte_frame_fixed(const uint8_t *data, const int len, uint8_t *result, int *result_len){
+    // presence flags instead of counters, collected 16 values at a time
+    uint8_t seen[256] __attribute__((aligned(16))) = {0};
+    for(int i = 0; i < len; i++){
+        seen[data[i]] = 1;
+    }
+    int n = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(int b = 0; b < 256; b += 16){
+        __m128i flags = _mm_load_si128((const __m128i *)&seen[b]);
+        unsigned mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(flags, zero)) & 0xFFFF;
+        while(mask){
+            result[n++] = (uint8_t)(b + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#else
+    for(int b = 0; b < 256; b++){
+        if(seen[b]){
+            result[n++] = (uint8_t)b;
+        }
+    }
+#endif
+    *result_len = n;
+    return 0;
+}
+
+static inline __attribute__((always_inline))
+int linear_search_for_byte_fixed(const uint8_t *data, const int len, uint8_t target){
+#ifdef __SSE2__
+    const __m128i needle = _mm_set1_epi8((char)target);
+    int i = 0;
+    for(; i + 16 <= len; i += 16){
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if(len % 16 != 0 && len >= 16){
+        // tail: reload the last 16 bytes and shift out the lanes already checked
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + len - 16));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)) >> (16 - len % 16);
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+        return -1;
+    }
+    for(; i < len; i++){
+        if(data[i] == target){
+            return i;
+        }
+    }
+    return -1;
+#else
+    for(int i = 0; i < len; i++){
+        if(data[i] == target){
+            return i;
+        }
+    }
+    return -1;
+#endif
+}
+
+/**
+ * Instantiate the specialized kernels for one frame length:
+ * process_byte_frame_<LEN> and linear_search_for_byte_<LEN>
+ */
+#define DEFINE_FIXED_FRAME_KERNELS(LEN) \
+    int process_byte_frame_##LEN(uint8_t *data, uint8_t *result, int *result_len){ \
+        if(data == NULL || result == NULL || result_len == NULL){ \
+            return -1; \
+        } \
+        return process_byte_frame_fixed(data, LEN, result, result_len); \
+    } \
+    int linear_search_for_byte_##LEN(uint8_t *data, uint8_t target){ \
+        if(data == NULL){ \
+            return -1; \
+        } \
+        return linear_search_for_byte_fixed(data, LEN, target); \
+    }
+
+DEFINE_FIXED_FRAME_KERNELS(100)  // FRAME_LEN_100
+DEFINE_FIXED_FRAME_KERNELS(500)  // FRAME_LEN_500
+
+#if defined(__x86_64__) || defined(__i386__)
+// bitonic network tables for compare distance j = 1 << index within a register:
+// the lane each lane is compared with, and the lanes that are the lower of their pair
+static const uint8_t bitonic_partner[4][16] __attribute__((aligned(16))) = {
+    {0x01, 0x00, 0x03, 0x02, 0x05, 0x04, 0x07, 0x06, 0x09, 0x08, 0x0B, 0x0A, 0x0D, 0x0C, 0x0F, 0x0E},
+    {0x02, 0x03, 0x00, 0x01, 0x06, 0x07, 0x04, 0x05, 0x0A, 0x0B, 0x08, 0x09, 0x0E, 0x0F, 0x0C, 0x0D},
+    {0x04, 0x05, 0x06, 0x07, 0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x0E, 0x0F, 0x08, 0x09, 0x0A, 0x0B},
+    {0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07},
+};
+static const uint8_t bitonic_lower[4][16] __attribute__((aligned(16))) = {
+    {0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00},
+    {0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00},
+    {0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00},
+    {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+};
+
+/**
+ * Bitonic sort of nregs * 16 bytes held in registers (nregs = 1, 2 or 4).
+ * Lane i is compared with lane i ^ j; it keeps the minimum when it is the
+ * lower lane of the pair in an ascending block (i & k == 0) or the upper
+ * lane in a descending one. Distances of 16 and more pair whole registers,
+ * shorter ones pair lanes of one register through pshufb.
+ */
+static inline __attribute__((always_inline, target("ssse3")))
+void bitonic_sort_regs(__m128i *v, const int nregs){
+    const __m128i ones = _mm_set1_epi8(-1);
+    for(int k = 2; k <= nregs * 16; k <<= 1){
+        for(int j = k >> 1; j > 0; j >>= 1){
+            if(j >= 16){
+                int q = j >> 4;
+                for(int r = 0; r < nregs; r++){
+                    if(r & q){
+                        continue;
+                    }
+                    __m128i lo = _mm_min_epu8(v[r], v[r | q]);
+                    __m128i hi = _mm_max_epu8(v[r], v[r | q]);
+                    int ascending = ((r * 16) & k) == 0;
+                    v[r] = ascending ? lo : hi;
+                    v[r | q] = ascending ? hi : lo;
+                }
+                continue;
+            }
+            int jb = __builtin_ctz(j);
+            const __m128i partner_idx = _mm_load_si128((const __m128i *)bitonic_partner[jb]);
+            const __m128i lower = _mm_load_si128((const __m128i *)bitonic_lower[jb]);
+            // within a register block (k < 16) the direction varies per lane
+            const __m128i in_block = k < 16 ? _mm_xor_si128(_mm_xor_si128(lower,
+                                     _mm_load_si128((const __m128i *)bitonic_lower[__builtin_ctz(k) & 3])), ones) : lower;
+            for(int r = 0; r < nregs; r++){
+                __m128i partner = _mm_shuffle_epi8(v[r], partner_idx);
+                __m128i mn = _mm_min_epu8(v[r], partner);
+                __m128i mx = _mm_max_epu8(v[r], partner);
+                __m128i take_min = k < 16 ? in_block :
+                                   (((r * 16) & k) == 0 ? lower : _mm_xor_si128(lower, ones));
+                v[r] = _mm_or_si128(_mm_and_si128(take_min, mn), _mm_andnot_si128(take_min, mx));
+            }
+        }
+    }
+}
+
+/**
+ * Sort up to nregs * 16 bytes padded with 0xFF (the padding sorts to the
+ * end), then keep the first of each run of equal values among the first
+ * data_len lanes: a lane is kept when it differs from the lane before it.
+ */
+static inline __attribute__((always_inline, target("ssse3")))
+int sort_unique_small(const uint8_t *data, int data_len, uint8_t *result, const int nregs){
+    uint8_t lanes[64] __attribute__((aligned(16)));
+    memset(lanes, 0xFF, sizeof(lanes));
+    memcpy(lanes, data, data_len);
+    __m128i v[4];
+    for(int r = 0; r < nregs; r++){
+        v[r] = _mm_load_si128((const __m128i *)(lanes + r * 16));
+    }
+    bitonic_sort_regs(v, nregs);
+
+    int n = 0;
+    for(int r = 0; r < nregs && r * 16 < data_len; r++){
+        __m128i prev = r == 0 ? _mm_slli_si128(v[0], 1) : _mm_alignr_epi8(v[r], v[r - 1], 15);
+        unsigned keep = ~_mm_movemask_epi8(_mm_cmpeq_epi8(v[r], prev)) & 0xFFFF;
+        if(r == 0){
+            keep |= 1;
+        }
+        int valid = data_len - r * 16;
+        if(valid < 16){
+            keep &= (1u << valid) - 1;
+        }
+        _mm_store_si128((__m128i *)(lanes + r * 16), v[r]);
+        // compress: copy the kept lanes to the output
+        while(keep){
+            result[n++] = lanes[r * 16 + __builtin_ctz(keep)];
+            keep &= keep - 1;
+        }
+    }
+    return n;
+}
+
+__attribute__((target("ssse3")))
+static int process_byte_frame_small_ssse3(const uint8_t *data, int data_len, uint8_t *result){
+    if(data_len <= 16) return sort_unique_small(data, data_len, result, 1);
+    if(data_len <= 32) return sort_unique_small(data, data_len, result, 2);
+    return sort_unique_small(data, data_len, result, 4);
+}
+#endif
+
+/**
+ * process_byte_frame_small:
+ * same contract as process_byte_frame, for frames of at most SMALL_FRAME_MAX
+ * bytes: the frame is sorted in SSE registers with a bitonic network and
+ * duplicates are dropped by comparing each lane with its neighbour, so the
+ * cost follows the frame length instead of the 256 histogram buckets.
+ * Longer frames (or CPUs without SSSE3) use process_byte_frame.
+ */
+int process_byte_frame_small(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+#if defined(__x86_64__) || defined(__i386__)
+    if(data != NULL && result != NULL && result_len != NULL && data_len >= 0 &&
+       data_len <= SMALL_FRAME_MAX && __builtin_cpu_supports("ssse3")){
+        *result_len = process_byte_frame_small_ssse3(data, data_len, result);
+        return 0;
+    }
+#endif
+    return process_byte_frame(data, data_len, result, result_len);
+}
+
+/**
+ * process_byte_frame_dispatch:
+ * same contract as process_byte_frame, using the kernel specialized
+ * for data_len when it is one of the known frame lengths, and the
+ * sorting network for small frames
+ */
+int process_byte_frame_dispatch(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+    if(data_len <= SMALL_FRAME_MAX){
+        return process_byte_frame_small(data, data_len, result, result_len);
+    }
+    switch(data_len){
+    case FRAME_LEN_100:
+        return process_byte_frame_100(data, result, result_len);
+    case FRAME_LEN_500:
+        return process_byte_frame_500(data, result, result_len);
+    default:
+        return process_byte_frame(data, data_len, result, result_len);
+    }
+}
+
+/**
+ * linear_search_for_byte_dispatch:
+ * same contract as linear_search_for_byte, using the kernel specialized
+ * for data_len when it is one of the known frame lengths
+ */
+int linear_search_for_byte_dispatch(uint8_t *data, int data_len, uint8_t target){
+    switch(data_len){
+    case FRAME_LEN_100:
+        return linear_search_for_byte_100(data, target);
+    case FRAME_LEN_500:
+        return linear_search_for_byte_500(data, target);
+    default:
+        return linear_search_for_byte(data, data_len, target);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define X86_KERNELS 1
+#endif
+
+/**
+ * Generic-length SIMD variants of process_byte_frame and
+ * linear_search_for_byte. They share the kernels' contract and differ
+ * only in vector width, so the autotuner can pick per host.
+ */
+int process_byte_frame_sse2(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+    if(data == NULL || result == NULL || result_len == NULL){
+        return -1;
+    }
+    return process_byte_frame_fixed(data, data_len, result, result_len);
+}
+
+int linear_search_for_byte_sse2(uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return -1;
+    }
+    return linear_search_for_byte_fixed(data, data_len, target);
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+int process_byte_frame_avx2(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+    if(data == NULL || result == NULL || result_len == NULL){
+        return -1;
+    }
+    uint8_t seen[256] __attribute__((aligned(32))) = {0};
+    for(int i = 0; i < data_len; i++){
+        seen[data[i]] = 1;
+    }
+    int n = 0;
+    const __m256i zero = _mm256_setzero_si256();
+    for(int b = 0; b < 256; b += 32){
+        __m256i flags = _mm256_load_si256((const __m256i *)&seen[b]);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(flags, zero));
+        while(mask){
+            result[n++] = (uint8_t)(b + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+    *result_len = n;
+    return 0;
+}
+
+__attribute__((target("avx2")))
+int linear_search_for_byte_avx2(uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return -1;
+    }
+    if(data_len < 32){
+        return linear_search_for_byte_sse2(data, data_len, target);
+    }
+    const __m256i needle = _mm256_set1_epi8((char)target);
+    int i = 0;
+    for(; i + 32 <= data_len; i += 32){
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if(i < data_len){
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + data_len - 32));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)) >> (32 - (data_len - i));
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int process_byte_frame_avx512(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+    if(data == NULL || result == NULL || result_len == NULL){
+        return -1;
+    }
+    uint8_t seen[256] __attribute__((aligned(64))) = {0};
+    for(int i = 0; i < data_len; i++){
+        seen[data[i]] = 1;
+    }
+    int n = 0;
+    for(int b = 0; b < 256; b += 64){
+        __m512i flags = _mm512_load_si512((const void *)&seen[b]);
+        uint64_t mask = _mm512_test_epi8_mask(flags, flags);
+        while(mask){
+            result[n++] = (uint8_t)(b + __builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+    *result_len = n;
+    return 0;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+int linear_search_for_byte_avx512(uint8_t *data, int data_len, uint8_t target){
+    if(data == NULL || data_len <= 0){
+        return -1;
+    }
+    const __m512i needle = _mm512_set1_epi8((char)target);
+    for(int i = 0; i < data_len; i += 64){
+        // masked load: the tail never reads past the end of the frame
+        int left = data_len - i;
+        __mmask64 valid = left >= 64 ? ~0ull : (1ull << left) - 1;
+        __m512i block = _mm512_maskz_loadu_epi8(valid, data + i);
+        uint64_t mask = _mm512_mask_cmpeq_epi8_mask(valid, block, needle);
+        if(mask){
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return -1;
+}
+#endif // X86_KERNELS
+
+// a kernel implementation the autotuner can choose
+typedef struct{
+    const char *name;
+    const char *cpu_feature;    // required CPU feature, NULL if none
+    int (*process)(uint8_t *data, int data_len, uint8_t *result, int *result_len);
+    int (*search)(uint8_t *data, int data_len, uint8_t target);
+} kernel_variant_t;
+
+static const kernel_variant_t kernel_variants[] = {
+    { "scalar", NULL, process_byte_frame, linear_search_for_byte },
+    { "sse2", NULL, process_byte_frame_sse2, linear_search_for_byte_sse2 },
+#ifdef X86_KERNELS
+    { "avx2", "avx2", process_byte_frame_avx2, linear_search_for_byte_avx2 },
+    { "avx512", "avx512bw", process_byte_frame_avx512, linear_search_for_byte_avx512 },
+#endif
+    { "specialized", NULL, process_byte_frame_dispatch, linear_search_for_byte_dispatch },
+};
+#define NUM_KERNEL_VARIANTS ((int)(sizeof(kernel_variants) / sizeof(kernel_variants[0])))
+
+// current selection, generic kernels until autotune_kernels() runs
+static int tuned_process = 0;
+static int tuned_search = 0;
+static long tuned_process_ns[NUM_KERNEL_VARIANTS];
+static long tuned_search_ns[NUM_KERNEL_VARIANTS];
+static int tuned_from_cache = 0;
+
+int process_byte_frame_tuned(uint8_t *data, int data_len, uint8_t *result, int *result_len){
+    return kernel_variants[tuned_process].process(data, data_len, result, result_len);
+}
+
+int linear_search_for_byte_tuned(uint8_t *data, int data_len, uint8_t target){
+    return kernel_variants[tuned_search].search(data, data_len, target);
+}
+
+static int kernel_variant_supported(int v){
+#ifdef X86_KERNELS
+    if(kernel_variants[v].cpu_feature != NULL){
+        __builtin_cpu_init();
+        if(strcmp(kernel_variants[v].cpu_feature, "avx2") == 0) return __builtin_cpu_supports("avx2");
+        if(strcmp(kernel_variants[v].cpu_feature, "avx512bw") == 0) return __builtin_cpu_supports("avx512bw");
+        return 0;
+    }
+#endif
+    return kernel_variants[v].cpu_feature == NULL;
+}
+
+static int kernel_variant_index(const char *name){
+    for(int v = 0; v < NUM_KERNEL_VARIANTS; v++){
+        if(strcmp(kernel_variants[v].name, name) == 0){
+            return kernel_variant_supported(v) ? v : -1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Read the CPU model name, the key for cached autotuning decisions
+ */
+static void cpu_model_name(char *buf, size_t len){
+    snprintf(buf, len, "unknown");
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if(fp == NULL){
+        return;
+    }
+    char line[512];
+    while(fgets(line, sizeof(line), fp) != NULL){
+        char *colon = strchr(line, ':');
+        if(strncmp(line, "model name", 10) == 0 && colon != NULL){
+            colon += 1 + strspn(colon + 1, " \t");
+            colon[strcspn(colon, "\n")] = '\0';
+            snprintf(buf, len, "%s", colon);
+            break;
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * autotune_cache_store:
+ * rewrite the cache file with this model's decision replacing any older
+ * line for it; other models' lines are kept. Written to a temporary file
+ * and renamed over the cache, so readers never see a partial file.
+ */
+static void autotune_cache_store(const char *cache_path, const char *model){
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+    FILE *out = fopen(tmp, "w");
+    if(out == NULL){
+        return;
+    }
+    FILE *in = fopen(cache_path, "r");
+    char line[512];
+    size_t model_len = strlen(model);
+    while(in != NULL && fgets(line, sizeof(line), in) != NULL){
+        if(strncmp(line, model, model_len) != 0 || line[model_len] != '\t'){
+            fputs(line, out);
+        }
+    }
+    if(in != NULL){
+        fclose(in);
+    }
+    fprintf(out, "%s\t%s\t%s\n", model, kernel_variants[tuned_process].name,
+            kernel_variants[tuned_search].name);
+    if(fclose(out) != 0 || rename(tmp, cache_path) != 0){
+        unlink(tmp);
+    }
+}
+
+/**
+ * autotune_kernels:
+ * pick the fastest process_byte_frame and linear_search_for_byte variant
+ * for this host; the choice is then used by the *_tuned entry points.
+ * Variants are timed on a mix of random frames: FRAME_LEN_100, FRAME_LEN_500
+ * and the odd lengths of recv chunks up to a full 1023-byte server buffer
+ * (best of several rounds, to filter out noise). With a cache file, a
+ * decision cached for this CPU model is reused instead of benchmarking,
+ * and a fresh decision replaces the model's line "model<TAB>process<TAB>search"
+ * (the file is rewritten, so it keeps one line per CPU model).
+ * return 0 if the kernels were benchmarked, 1 if taken from the cache
+ */
+int autotune_kernels(const char *cache_path){
+    char model[256];
+    cpu_model_name(model, sizeof(model));
+
+    if(cache_path != NULL){
+        FILE *fp = fopen(cache_path, "r");
+        char line[512];
+        while(fp != NULL && fgets(line, sizeof(line), fp) != NULL){
+            line[strcspn(line, "\n")] = '\0';
+            char *p = strchr(line, '\t'), *q = p ? strchr(p + 1, '\t') : NULL;
+            if(q == NULL){
+                continue;
+            }
+            *p++ = '\0';
+            *q++ = '\0';
+            int process = kernel_variant_index(p), search = kernel_variant_index(q);
+            if(strcmp(line, model) == 0 && process >= 0 && search >= 0){
+                tuned_process = process;
+                tuned_search = search;
+                tuned_from_cache = 1;
+            }
+        }
+        if(fp != NULL){
+            fclose(fp);
+        }
+        if(tuned_from_cache){
+            return 1;
+        }
+    }
+
+    enum { TUNE_FRAMES = 64, TUNE_ROUNDS = 5, TUNE_MAX_LEN = 1023 };
+    // framed lengths and arbitrary recv chunk lengths, up to the server's
+    // BUFFER_SIZE - 1
+    static const int tune_lens[] = { FRAME_LEN_100, FRAME_LEN_500, TUNE_MAX_LEN, 1, 37, 255, 731, 1000 };
+    uint8_t *frames = malloc(TUNE_FRAMES * TUNE_MAX_LEN);
+    if(frames == NULL){
+        return 0;
+    }
+    int lens[TUNE_FRAMES];
+    for(int f = 0; f < TUNE_FRAMES; f++){
+        uint8_t *frame = frames + f * TUNE_MAX_LEN;
+        int len = lens[f] = tune_lens[f % (int)(sizeof(tune_lens) / sizeof(tune_lens[0]))];
+        generate_test_data(frame, len);
+        for(int i = 0; i < len; i++){
+            if(frame[i] == SEARCH_BYTE) frame[i]++;
+        }
+        frame[rand() % len] = SEARCH_BYTE;
+    }
+    uint8_t result[256];
+    int result_len;
+    volatile int sink = 0;
+    struct timespec start, end;
+    for(int v = 0; v < NUM_KERNEL_VARIANTS; v++){
+        tuned_process_ns[v] = tuned_search_ns[v] = -1;
+        if(!kernel_variant_supported(v)){
+            continue;
+        }
+        for(int round = 0; round < TUNE_ROUNDS; round++){
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(int f = 0; f < TUNE_FRAMES; f++){
+                kernel_variants[v].process(frames + f * TUNE_MAX_LEN, lens[f], result, &result_len);
+                sink += result_len;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+            if(tuned_process_ns[v] < 0 || ns < tuned_process_ns[v]) tuned_process_ns[v] = ns;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(int f = 0; f < TUNE_FRAMES; f++){
+                sink += kernel_variants[v].search(frames + f * TUNE_MAX_LEN, lens[f], SEARCH_BYTE);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+            if(tuned_search_ns[v] < 0 || ns < tuned_search_ns[v]) tuned_search_ns[v] = ns;
+        }
+        if(tuned_process_ns[v] < tuned_process_ns[tuned_process]) tuned_process = v;
+        if(tuned_search_ns[v] < tuned_search_ns[tuned_search]) tuned_search = v;
+    }
+    free(frames);
+    tuned_from_cache = 0;
+
+    if(cache_path != NULL){
+        autotune_cache_store(cache_path, model);
+    }
+    return 0;
+}
+
+/**
+ * autotune_report:
+ * format the autotuning decisions as key=value metrics, e.g.
+ * "kernel_process=avx2 kernel_search=avx512 source=benchmark process_ns.scalar=1234 ..."
+ * (per-variant timings are only present after a benchmark)
+ */
+void autotune_report(char *buf, size_t len){
+    int n = snprintf(buf, len, "kernel_process=%s kernel_search=%s source=%s",
+                     kernel_variants[tuned_process].name, kernel_variants[tuned_search].name,
+                     tuned_from_cache ? "cache" : "benchmark");
+    for(int v = 0; v < NUM_KERNEL_VARIANTS && !tuned_from_cache && n > 0 && (size_t)n < len; v++){
+        if(tuned_process_ns[v] >= 0){
+            n += snprintf(buf + n, len - n, " process_ns.%s=%ld search_ns.%s=%ld",
+                          kernel_variants[v].name, tuned_process_ns[v],
+                          kernel_variants[v].name, tuned_search_ns[v]);
+        }
+    }
+}
+
+/**
+ * process_u16_frame:
+ * distinct + sort for frames of 16-bit symbols (length = data_len)
+ * mark each symbol in an 8 KB presence bitmap, then walk the set bits in
+ * ascending order. A 1024-bit summary of non-empty bitmap words lets
+ * small frames skip the empty parts of the bitmap.
+ * result must hold min(data_len, 65536) symbols
+ * return 0 if success, otherwise any non-zero value
+ */
+int process_u16_frame(const uint16_t *data, int data_len, uint16_t *result, int *result_len){
+    if(data == NULL || result == NULL || result_len == NULL || data_len < 0){
+        return -1;
+    }
+    uint64_t present[65536 / 64] = {0};
+    uint64_t summary[65536 / 64 / 64] = {0};
+    for(int i = 0; i < data_len; i++){
+        uint16_t v = data[i];
+        present[v >> 6] |= 1ull << (v & 63);
+        summary[v >> 12] |= 1ull << ((v >> 6) & 63);
+    }
+    int n = 0;
+    for(int s = 0; s < 16; s++){
+        uint64_t words = summary[s];
+        while(words){
+            int w = s * 64 + __builtin_ctzll(words);
+            uint64_t bits = present[w];
+            while(bits){
+                result[n++] = (uint16_t)(w * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+            words &= words - 1;
+        }
+    }
+    *result_len = n;
+    return 0;
+}
+
+/**
+ * process_u32_frame:
+ * distinct + sort for frames of 32-bit symbols (length = data_len)
+ * LSD radix sort with 8-bit digits (passes where every symbol shares the
+ * digit are skipped), then drop adjacent duplicates. Tiny frames use an
+ * insertion sort instead.
+ * result and scratch must each hold data_len symbols
+ * return 0 if success, otherwise any non-zero value
+ */
+int process_u32_frame(const uint32_t *data, int data_len, uint32_t *result, int *result_len, uint32_t *scratch){
+    if(data == NULL || result == NULL || result_len == NULL || scratch == NULL || data_len < 0){
+        return -1;
+    }
+    const uint32_t *src = data;
+    uint32_t *dst = result, *other = scratch;
+    if(data_len <= 32){
+        for(int i = 0; i < data_len; i++){
+            uint32_t v = data[i];
+            int j = i;
+            while(j > 0 && result[j - 1] > v){
+                result[j] = result[j - 1];
+                j--;
+            }
+            result[j] = v;
+        }
+    }else{
+        // one histogram pass for all four digits
+        uint32_t counts[4][256] = {{0}};
+        for(int i = 0; i < data_len; i++){
+            uint32_t v = data[i];
+            counts[0][v & 0xFF]++;
+            counts[1][(v >> 8) & 0xFF]++;
+            counts[2][(v >> 16) & 0xFF]++;
+            counts[3][v >> 24]++;
+        }
+        for(int d = 0; d < 4; d++){
+            uint32_t *count = counts[d];
+            int shift = d * 8;
+            if(count[(src[0] >> shift) & 0xFF] == (uint32_t)data_len){
+                continue;   // every symbol has the same digit here
+            }
+            uint32_t offset = 0;
+            for(int b = 0; b < 256; b++){
+                uint32_t c = count[b];
+                count[b] = offset;
+                offset += c;
+            }
+            for(int i = 0; i < data_len; i++){
+                uint32_t v = src[i];
+                dst[count[(v >> shift) & 0xFF]++] = v;
+            }
+            src = dst;
+            dst = (dst == result) ? other : result;
+        }
+        if(src != result){
+            memcpy(result, src, data_len * sizeof(uint32_t));
+        }
+    }
+    // drop adjacent duplicates
+    int n = 0;
+    for(int i = 0; i < data_len; i++){
+        if(n == 0 || result[i] != result[n - 1]){
+            result[n++] = result[i];
+        }
+    }
+    *result_len = n;
+    return 0;
+}
+
+/**
+ * find_frame_markers:
+ * search for any of the frame marker bytes (SEARCH_BYTE, '\n', 0x00, 0xFF)
+ * return the index of the first marker, -1 if there is none
+ */
+DEFINE_BYTE_SEARCHER(find_frame_markers, SEARCH_BYTE, '\n', 0x00, 0xFF)
+
+/**
+ * distinct_stream_init:
+ * start a frame that is processed chunk by chunk as it arrives
+ */
+void distinct_stream_init(distinct_stream_t *st){
+    memset(st->seen, 0, sizeof(st->seen));
+    st->distinct = 0;
+    st->bytes = 0;
+}
+
+/**
+ * distinct_stream_update:
+ * fold the next chunk of the frame (any length) into the presence set.
+ * A presence flag rather than a counter, so multi-megabyte frames cannot
+ * wrap it; once all 256 values were seen the rest of the frame is skipped.
+ */
+void distinct_stream_update(distinct_stream_t *st, const uint8_t *data, int data_len){
+    st->bytes += data_len;
+    if(st->distinct == 256){
+        return;
+    }
+    // check for saturation once per block rather than per byte
+    for(int i = 0; i < data_len; i += 4096){
+        int end = data_len - i < 4096 ? data_len : i + 4096;
+        for(int j = i; j < end; j++){
+            st->seen[data[j]] = 1;
+        }
+        int distinct = 0;
+        for(int v = 0; v < 256; v++){
+            distinct += st->seen[v];
+        }
+        st->distinct = distinct;
+        if(distinct == 256){
+            return;
+        }
+    }
+}
+
+/**
+ * distinct_stream_final:
+ * the frame ended: write its distinct bytes in ascending order, the same
+ * result process_byte_frame gives for the whole frame at once
+ * return 0 if success, otherwise any non-zero value
+ */
+int distinct_stream_final(const distinct_stream_t *st, uint8_t *result, int *result_len){
+    if(result == NULL || result_len == NULL){
+        return -1;
+    }
+    *result_len = 0;
+    for(int v = 0; v < 256; v++){
+        if(st->seen[v]){
+            result[(*result_len)++] = (uint8_t)v;
+        }
+    }
+    return 0;
+}
+
+/**
+ * search_stream_init:
+ * start looking for pattern (1 to SEARCH_STREAM_MAX_PATTERN bytes, kept
+ * by reference) in a frame that arrives in chunks
+ * return 0 if success, -1 if the pattern length is out of range
+ */
+int search_stream_init(search_stream_t *st, const uint8_t *pattern, int pattern_len){
+    if(pattern == NULL || pattern_len < 1 || pattern_len > SEARCH_STREAM_MAX_PATTERN){
+        return -1;
+    }
+    st->pattern = pattern;
+    st->pattern_len = pattern_len;
+    st->carry_len = 0;
+    st->offset = 0;
+    st->found = -1;
+    return 0;
+}
+
+// first match of pattern starting in data[0, starts), or -1; the match may
+// run past starts but not past data_len
+static int search_window(const search_stream_t *st, const uint8_t *data, int data_len, int starts){
+    const uint8_t *p = data;
+    int plen = st->pattern_len;
+    if(starts > data_len - plen + 1){
+        starts = data_len - plen + 1;
+    }
+    while(starts > 0 && (p = memchr(p, st->pattern[0], data + starts - p)) != NULL){
+        if(memcmp(p + 1, st->pattern + 1, plen - 1) == 0){
+            return (int)(p - data);
+        }
+        p++;
+    }
+    return -1;
+}
+
+/**
+ * search_stream_update:
+ * scan the next chunk of the frame. Matches that straddle chunk boundaries
+ * are found through the last pattern_len - 1 bytes carried over from the
+ * previous chunks.
+ * return the frame offset of the first match once it has been seen
+ * (also on every later call), -1 while there is none yet
+ */
+int64_t search_stream_update(search_stream_t *st, const uint8_t *data, int data_len){
+    if(st->found >= 0 || data_len <= 0){
+        return st->found;
+    }
+    int plen = st->pattern_len;
+    int pos;
+    // matches starting in the carried-over tail
+    if(st->carry_len > 0){
+        uint8_t window[2 * SEARCH_STREAM_MAX_PATTERN];
+        int take = data_len < plen - 1 ? data_len : plen - 1;
+        memcpy(window, st->carry, st->carry_len);
+        memcpy(window + st->carry_len, data, take);
+        pos = search_window(st, window, st->carry_len + take, st->carry_len);
+        if(pos >= 0){
+            st->found = st->offset - st->carry_len + pos;
+            return st->found;
+        }
+    }
+    pos = search_window(st, data, data_len, data_len);
+    if(pos >= 0){
+        st->found = st->offset + pos;
+        return st->found;
+    }
+    // keep the last plen - 1 bytes seen for the next chunk
+    int keep = plen - 1;
+    if(data_len >= keep){
+        memcpy(st->carry, data + data_len - keep, keep);
+        st->carry_len = keep;
+    }else{
+        int old = st->carry_len + data_len > keep ? keep - data_len : st->carry_len;
+        memmove(st->carry, st->carry + st->carry_len - old, old);
+        memcpy(st->carry + old, data, data_len);
+        st->carry_len = old + data_len;
+    }
+    st->offset += data_len;
+    return -1;
+}
+
+/*
+ * Thread pool for multi-megabyte buffers. A job splits the buffer into
+ * PAR_CHUNK_LEN chunks that the workers (and the calling thread) claim
+ * in ascending order from a shared counter; each chunk's result is
+ * merged into the job result with atomics.
+ */
+#define PAR_CHUNK_LEN (256 * 1024)
+#define PAR_SERIAL_LEN (1 << 30)    // piece handed to an int-length serial kernel
+
+struct par_pool{
+    pthread_t *threads;
+    int num_threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start;       // a new job was posted
+    pthread_cond_t done;        // the last worker left the job
+    uint64_t generation;        // bumped for every job
+    int active;                 // workers still inside the current job
+    int stop;
+    // current job
+    void (*task)(struct par_pool *pool, size_t chunk);
+    const uint8_t *data;
+    size_t data_len;
+    size_t num_chunks;
+    size_t next_chunk;          // next chunk to claim
+    uint8_t target;
+    uint64_t present[4];        // distinct: OR of the chunk presence sets
+    uint64_t *counts;           // histogram: sum of the chunk histograms
+    int64_t found;              // search: lowest match index, INT64_MAX if none
+};
+
+static void par_pool_work(par_pool_t *pool){
+    size_t c;
+    while((c = __atomic_fetch_add(&pool->next_chunk, 1, __ATOMIC_RELAXED)) < pool->num_chunks){
+        pool->task(pool, c);
+    }
+}
+
+static void *par_pool_thread(void *arg){
+    par_pool_t *pool = arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while(1){
+        while(pool->generation == seen && !pool->stop){
+            pthread_cond_wait(&pool->start, &pool->mutex);
+        }
+        if(pool->stop){
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+        par_pool_work(pool);
+        pthread_mutex_lock(&pool->mutex);
+        if(--pool->active == 0){
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/**
+ * par_pool_create:
+ * start a pool of threads helping the caller with parallel kernels
+ * (threads <= 0: one per online CPU besides the caller's). With fewer
+ * than 2 CPUs online that is no threads, and the parallel kernels then
+ * run the serial ones on the caller instead of splitting the buffer.
+ * return the pool, or NULL on failure
+ */
+par_pool_t *par_pool_create(int threads){
+    if(threads <= 0){
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+        if(threads < 0) threads = 0;
+    }
+    par_pool_t *pool = calloc(1, sizeof(par_pool_t));
+    if(pool == NULL){
+        return NULL;
+    }
+    pool->threads = calloc(threads > 0 ? threads : 1, sizeof(pthread_t));
+    if(pool->threads == NULL){
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for(int i = 0; i < threads; i++){
+        if(pthread_create(&pool->threads[i], NULL, par_pool_thread, pool) != 0){
+            break;
+        }
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+/**
+ * par_pool_destroy:
+ * stop and join the pool's threads
+ */
+void par_pool_destroy(par_pool_t *pool){
+    if(pool == NULL){
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for(int i = 0; i < pool->num_threads; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->threads);
+    free(pool);
+}
+
+// run task over every chunk of data, the caller working alongside the pool
+static void par_pool_run(par_pool_t *pool, void (*task)(par_pool_t *, size_t),
+                         const uint8_t *data, size_t data_len){
+    pool->task = task;
+    pool->data = data;
+    pool->data_len = data_len;
+    pool->num_chunks = (data_len + PAR_CHUNK_LEN - 1) / PAR_CHUNK_LEN;
+    pool->next_chunk = 0;
+    if(pool->num_threads == 0){
+        par_pool_work(pool);
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->active = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    par_pool_work(pool);
+    pthread_mutex_lock(&pool->mutex);
+    while(pool->active > 0){
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void par_chunk_bounds(const par_pool_t *pool, size_t chunk, const uint8_t **data, size_t *len){
+    size_t off = chunk * PAR_CHUNK_LEN;
+    *data = pool->data + off;
+    *len = pool->data_len - off < PAR_CHUNK_LEN ? pool->data_len - off : PAR_CHUNK_LEN;
+}
+
+static void par_distinct_task(par_pool_t *pool, size_t chunk){
+    const uint8_t *data;
+    size_t len;
+    uint8_t seen[256] = {0};
+    uint64_t present[4] = {0};
+    par_chunk_bounds(pool, chunk, &data, &len);
+    for(size_t i = 0; i < len; i++){
+        seen[data[i]] = 1;
+    }
+    for(int v = 0; v < 256; v++){
+        present[v >> 6] |= (uint64_t)seen[v] << (v & 63);
+    }
+    for(int w = 0; w < 4; w++){
+        if(present[w] & ~__atomic_load_n(&pool->present[w], __ATOMIC_RELAXED)){
+            __atomic_fetch_or(&pool->present[w], present[w], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void par_histogram_task(par_pool_t *pool, size_t chunk){
+    const uint8_t *data;
+    size_t len;
+    uint32_t count[256] = {0};
+    par_chunk_bounds(pool, chunk, &data, &len);
+    for(size_t i = 0; i < len; i++){
+        count[data[i]]++;
+    }
+    for(int v = 0; v < 256; v++){
+        if(count[v]){
+            __atomic_fetch_add(&pool->counts[v], count[v], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void par_search_task(par_pool_t *pool, size_t chunk){
+    const uint8_t *data;
+    size_t len;
+    int64_t off = (int64_t)chunk * PAR_CHUNK_LEN;
+    // chunks are claimed in order, so once a match is known every chunk
+    // after it can be skipped
+    if(off >= __atomic_load_n(&pool->found, __ATOMIC_RELAXED)){
+        return;
+    }
+    par_chunk_bounds(pool, chunk, &data, &len);
+    int pos = linear_search_for_byte_tuned((uint8_t *)data, (int)len, pool->target);
+    if(pos < 0){
+        return;
+    }
+    int64_t idx = off + pos;
+    int64_t best = __atomic_load_n(&pool->found, __ATOMIC_RELAXED);
+    while(idx < best && !__atomic_compare_exchange_n(&pool->found, &best, idx, 1,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+}
+
+/**
+ * process_byte_frame_parallel:
+ * same result as process_byte_frame for a buffer of any size: each chunk
+ * builds a 256-bit presence set and the sets are ORed together
+ * return 0 if success, otherwise any non-zero value
+ */
+int process_byte_frame_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len,
+                                uint8_t *result, int *result_len){
+    if(pool == NULL || data == NULL || result == NULL || result_len == NULL){
+        return -1;
+    }
+    if(pool->num_threads == 0){
+        // no helpers: the streaming kernel beats per-chunk presence sets
+        distinct_stream_t ds;
+        distinct_stream_init(&ds);
+        for(size_t off = 0; off < data_len; off += PAR_SERIAL_LEN){
+            size_t len = data_len - off < PAR_SERIAL_LEN ? data_len - off : PAR_SERIAL_LEN;
+            distinct_stream_update(&ds, data + off, (int)len);
+        }
+        return distinct_stream_final(&ds, result, result_len);
+    }
+    memset(pool->present, 0, sizeof(pool->present));
+    par_pool_run(pool, par_distinct_task, data, data_len);
+    *result_len = 0;
+    for(int v = 0; v < 256; v++){
+        if(pool->present[v >> 6] >> (v & 63) & 1){
+            result[(*result_len)++] = (uint8_t)v;
+        }
+    }
+    return 0;
+}
+
+/**
+ * byte_histogram_parallel:
+ * count the occurrences of every byte value (counts[256]), summing the
+ * per-chunk histograms
+ * return 0 if success, otherwise any non-zero value
+ */
+int byte_histogram_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len, uint64_t *counts){
+    if(pool == NULL || data == NULL || counts == NULL){
+        return -1;
+    }
+    memset(counts, 0, 256 * sizeof(uint64_t));
+    pool->counts = counts;
+    par_pool_run(pool, par_histogram_task, data, data_len);
+    return 0;
+}
+
+/**
+ * linear_search_for_byte_parallel:
+ * index of the first occurrence of target in a buffer of any size, -1 if
+ * absent. Each chunk is searched with the tuned kernel and the lowest
+ * match wins; chunks past an already found match are not searched.
+ */
+int64_t linear_search_for_byte_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len, uint8_t target){
+    if(pool == NULL || data == NULL){
+        return -1;
+    }
+    if(pool->num_threads == 0){
+        for(size_t off = 0; off < data_len; off += PAR_SERIAL_LEN){
+            size_t len = data_len - off < PAR_SERIAL_LEN ? data_len - off : PAR_SERIAL_LEN;
+            int pos = linear_search_for_byte_tuned((uint8_t *)data + off, (int)len, target);
+            if(pos >= 0){
+                return (int64_t)off + pos;
+            }
+        }
+        return -1;
+    }
+    pool->target = target;
+    pool->found = INT64_MAX;
+    par_pool_run(pool, par_search_task, data, data_len);
+    return pool->found == INT64_MAX ? -1 : pool->found;
+}
+
+/*
+ * Fused frame pipeline: every operator of the chain works on the same
+ * 16-byte vector as it is loaded, and distinct is read off the histogram.
+ * frame_pipeline_core is instantiated once per operator combination so
+ * the operators that are off compile away.
+ */
+static const char *const frame_op_names[] = { "validate", "histogram", "distinct", "markers", "stats" };
+#define NUM_FRAME_OPS (int)(sizeof(frame_op_names) / sizeof(frame_op_names[0]))
+
+static inline __attribute__((always_inline))
+void frame_pipeline_core(const unsigned ops, const frame_pipeline_t *p, const uint8_t *data,
+                         int data_len, frame_pipeline_result_t *out){
+    const int need_hist = ops & (FRAME_OP_HISTOGRAM | FRAME_OP_DISTINCT);
+    const int need_range = ops & (FRAME_OP_VALIDATE | FRAME_OP_STATS);
+    uint32_t *hist = out->histogram;
+    int first_invalid = -1, first_marker = -1, marker_count = 0;
+    uint64_t sum = 0;
+    uint8_t lo = 0xFF, hi = 0;
+    int i = 0;
+    if(need_hist){
+        memset(hist, 0, sizeof(out->histogram));
+    }
+#ifdef __SSE2__
+    const __m128i valid_lo = _mm_set1_epi8((char)p->min_valid);
+    const __m128i valid_hi = _mm_set1_epi8((char)p->max_valid);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vmin = _mm_set1_epi8(-1), vmax = zero, vsum = zero;
+    __m128i marker[FRAME_PIPELINE_MAX_MARKERS];
+    for(int m = 0; m < FRAME_PIPELINE_MAX_MARKERS; m++){
+        marker[m] = _mm_set1_epi8((char)p->markers[m < p->num_markers ? m : 0]);
+    }
+    for(; i + 16 <= data_len; i += 16){
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        if(ops & FRAME_OP_VALIDATE){
+            // in range when max(v, lo) == v and min(v, hi) == v
+            __m128i ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, valid_lo), v),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, valid_hi), v));
+            unsigned bad = ~_mm_movemask_epi8(ok) & 0xFFFF;
+            if(bad && first_invalid < 0){
+                first_invalid = i + __builtin_ctz(bad);
+            }
+        }
+        if(ops & FRAME_OP_MARKERS){
+            __m128i eq = _mm_cmpeq_epi8(v, marker[0]);
+            for(int m = 1; m < p->num_markers; m++){
+                eq = _mm_or_si128(eq, _mm_cmpeq_epi8(v, marker[m]));
+            }
+            unsigned hits = _mm_movemask_epi8(eq);
+            if(hits){
+                if(first_marker < 0){
+                    first_marker = i + __builtin_ctz(hits);
+                }
+                marker_count += __builtin_popcount(hits);
+            }
+        }
+        if(need_range){
+            vmin = _mm_min_epu8(vmin, v);
+            vmax = _mm_max_epu8(vmax, v);
+        }
+        if(ops & FRAME_OP_STATS){
+            vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+        }
+        if(need_hist){
+            // the vector is already loaded: count its lanes from the register
+            uint8_t lanes[16] __attribute__((aligned(16)));
+            _mm_store_si128((__m128i *)lanes, v);
+            for(int l = 0; l < 16; l++){
+                hist[lanes[l]]++;
+            }
+        }
+    }
+    if(need_range && i > 0){
+        uint8_t lanes[16] __attribute__((aligned(16)));
+        _mm_store_si128((__m128i *)lanes, vmin);
+        for(int l = 0; l < 16; l++) lo = lanes[l] < lo ? lanes[l] : lo;
+        _mm_store_si128((__m128i *)lanes, vmax);
+        for(int l = 0; l < 16; l++) hi = lanes[l] > hi ? lanes[l] : hi;
+    }
+    if(ops & FRAME_OP_STATS){
+        uint64_t halves[2] __attribute__((aligned(16)));
+        _mm_store_si128((__m128i *)halves, vsum);
+        sum = halves[0] + halves[1];
+    }
+#endif
+    for(; i < data_len; i++){
+        uint8_t b = data[i];
+        if((ops & FRAME_OP_VALIDATE) && first_invalid < 0 && (b < p->min_valid || b > p->max_valid)){
+            first_invalid = i;
+        }
+        if(ops & FRAME_OP_MARKERS){
+            for(int m = 0; m < p->num_markers; m++){
+                if(b == p->markers[m]){
+                    if(first_marker < 0) first_marker = i;
+                    marker_count++;
+                    break;
+                }
+            }
+        }
+        if(need_range){
+            lo = b < lo ? b : lo;
+            hi = b > hi ? b : hi;
+        }
+        if(ops & FRAME_OP_STATS){
+            sum += b;
+        }
+        if(need_hist){
+            hist[b]++;
+        }
+    }
+
+    if(ops & FRAME_OP_VALIDATE){
+        out->valid = first_invalid < 0 && data_len >= p->min_len && data_len <= p->max_len;
+        out->first_invalid = first_invalid;
+    }
+    if(ops & FRAME_OP_DISTINCT){
+        out->distinct_len = 0;
+        for(int v = 0; v < 256; v++){
+            if(hist[v]){
+                out->distinct[out->distinct_len++] = (uint8_t)v;
+            }
+        }
+    }
+    if(ops & FRAME_OP_MARKERS){
+        out->first_marker = first_marker;
+        out->marker_count = marker_count;
+    }
+    if(ops & FRAME_OP_STATS){
+        out->sum = sum;
+        out->min = data_len > 0 ? lo : 0;
+        out->max = data_len > 0 ? hi : 0;
+    }
+}
+
+#define DEFINE_FRAME_PIPELINE(ops) \
+    static void frame_pipeline_##ops(const frame_pipeline_t *p, const uint8_t *data, int data_len, \
+                                     frame_pipeline_result_t *out){ \
+        frame_pipeline_core(ops, p, data, data_len, out); \
+    }
+DEFINE_FRAME_PIPELINE(0)  DEFINE_FRAME_PIPELINE(1)  DEFINE_FRAME_PIPELINE(2)  DEFINE_FRAME_PIPELINE(3)
+DEFINE_FRAME_PIPELINE(4)  DEFINE_FRAME_PIPELINE(5)  DEFINE_FRAME_PIPELINE(6)  DEFINE_FRAME_PIPELINE(7)
+DEFINE_FRAME_PIPELINE(8)  DEFINE_FRAME_PIPELINE(9)  DEFINE_FRAME_PIPELINE(10) DEFINE_FRAME_PIPELINE(11)
+DEFINE_FRAME_PIPELINE(12) DEFINE_FRAME_PIPELINE(13) DEFINE_FRAME_PIPELINE(14) DEFINE_FRAME_PIPELINE(15)
+DEFINE_FRAME_PIPELINE(16) DEFINE_FRAME_PIPELINE(17) DEFINE_FRAME_PIPELINE(18) DEFINE_FRAME_PIPELINE(19)
+DEFINE_FRAME_PIPELINE(20) DEFINE_FRAME_PIPELINE(21) DEFINE_FRAME_PIPELINE(22) DEFINE_FRAME_PIPELINE(23)
+DEFINE_FRAME_PIPELINE(24) DEFINE_FRAME_PIPELINE(25) DEFINE_FRAME_PIPELINE(26) DEFINE_FRAME_PIPELINE(27)
+DEFINE_FRAME_PIPELINE(28) DEFINE_FRAME_PIPELINE(29) DEFINE_FRAME_PIPELINE(30) DEFINE_FRAME_PIPELINE(31)
+
+typedef void (*frame_pipeline_fn)(const frame_pipeline_t *, const uint8_t *, int, frame_pipeline_result_t *);
+static const frame_pipeline_fn frame_pipelines[FRAME_OP_ALL + 1] = {
+    frame_pipeline_0,  frame_pipeline_1,  frame_pipeline_2,  frame_pipeline_3,
+    frame_pipeline_4,  frame_pipeline_5,  frame_pipeline_6,  frame_pipeline_7,
+    frame_pipeline_8,  frame_pipeline_9,  frame_pipeline_10, frame_pipeline_11,
+    frame_pipeline_12, frame_pipeline_13, frame_pipeline_14, frame_pipeline_15,
+    frame_pipeline_16, frame_pipeline_17, frame_pipeline_18, frame_pipeline_19,
+    frame_pipeline_20, frame_pipeline_21, frame_pipeline_22, frame_pipeline_23,
+    frame_pipeline_24, frame_pipeline_25, frame_pipeline_26, frame_pipeline_27,
+    frame_pipeline_28, frame_pipeline_29, frame_pipeline_30, frame_pipeline_31,
+};
+
+/**
+ * frame_pipeline_init:
+ * declare an operator chain from a spec like "validate,histogram,distinct,
+ * markers,stats" (any subset, in any order). Validation defaults to
+ * accepting every byte and length, markers to SEARCH_BYTE; adjust the
+ * fields afterwards for the frame type.
+ * return 0 if success, -1 on an unknown operator
+ */
+int frame_pipeline_init(frame_pipeline_t *p, const char *spec){
+    memset(p, 0, sizeof(*p));
+    p->min_valid = 0;
+    p->max_valid = 0xFF;
+    p->max_len = INT32_MAX;
+    p->markers[0] = SEARCH_BYTE;
+    p->num_markers = 1;
+    while(spec && *spec){
+        size_t n = strcspn(spec, ",");
+        int op = 0;
+        while(op < NUM_FRAME_OPS && (strlen(frame_op_names[op]) != n || strncmp(spec, frame_op_names[op], n) != 0)){
+            op++;
+        }
+        if(op == NUM_FRAME_OPS){
+            return -1;
+        }
+        p->ops |= 1u << op;
+        spec += n + (spec[n] == ',');
+    }
+    return 0;
+}
+
+/**
+ * frame_pipeline_run:
+ * run the pipeline's operators over the frame in a single pass. Only the
+ * result fields of the configured operators are written.
+ * return 0 if success, otherwise any non-zero value
+ */
+int frame_pipeline_run(const frame_pipeline_t *p, const uint8_t *data, int data_len,
+                       frame_pipeline_result_t *out){
+    if(p == NULL || out == NULL || (data == NULL && data_len > 0) || data_len < 0 ||
+       p->num_markers < 1 || p->num_markers > FRAME_PIPELINE_MAX_MARKERS){
+        return -1;
+    }
+    frame_pipelines[p->ops & FRAME_OP_ALL](p, data, data_len, out);
+    return 0;
+}
+
+/*
+ * CRC32C (Castagnoli, reflected polynomial 0x82F63B78). With SSE4.2 the
+ * crc32 instruction does 8 bytes per step; its 3-cycle latency is hidden
+ * by running three independent streams over consecutive CRC_BLOCK byte
+ * blocks and folding them together, which takes crc32c_shift: the CRC
+ * register after CRC_BLOCK more zero bytes, as four table lookups.
+ */
+#define CRC32C_POLY 0x82F63B78u
+#define CRC_BLOCK 256
+
+static uint32_t crc32c_table[256];          // one byte at a time
+static uint32_t crc32c_zeros[4][256];       // CRC_BLOCK zero bytes
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_byte_sw(uint32_t crc, uint8_t b){
+    return crc32c_table[(crc ^ b) & 0xFF] ^ (crc >> 8);
+}
+
+static void crc32c_init_tables(void){
+    for(uint32_t n = 0; n < 256; n++){
+        uint32_t crc = n;
+        for(int k = 0; k < 8; k++){
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc32c_table[n] = crc;
+    }
+    // the register is linear in its value, so feeding zeros to each byte
+    // lane separately and xoring the results gives the whole shift
+    for(int lane = 0; lane < 4; lane++){
+        for(uint32_t n = 0; n < 256; n++){
+            uint32_t crc = n << (8 * lane);
+            for(int i = 0; i < CRC_BLOCK; i++){
+                crc = crc32c_byte_sw(crc, 0);
+            }
+            crc32c_zeros[lane][n] = crc;
+        }
+    }
+}
+
+static inline uint32_t crc32c_shift(uint32_t crc){
+    return crc32c_zeros[0][crc & 0xFF] ^ crc32c_zeros[1][(crc >> 8) & 0xFF] ^
+           crc32c_zeros[2][(crc >> 16) & 0xFF] ^ crc32c_zeros[3][crc >> 24];
+}
+
+#if defined(__x86_64__)
+/**
+ * CRC of src into the running register crc, also copying src to dst
+ * when dst is not NULL (the bytes are loaded once for both)
+ */
+static inline __attribute__((always_inline, target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t len){
+    uint64_t c0 = crc;
+    while(len >= 3 * CRC_BLOCK){
+        uint64_t c1 = 0, c2 = 0;
+        for(size_t i = 0; i < CRC_BLOCK; i += 16){
+            // 16-byte loads serve the copy; the crc32 input comes from the register
+            __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(src + CRC_BLOCK + i));
+            __m128i c = _mm_loadu_si128((const __m128i *)(src + 2 * CRC_BLOCK + i));
+            if(dst){
+                _mm_storeu_si128((__m128i *)(dst + i), a);
+                _mm_storeu_si128((__m128i *)(dst + CRC_BLOCK + i), b);
+                _mm_storeu_si128((__m128i *)(dst + 2 * CRC_BLOCK + i), c);
+            }
+            c0 = _mm_crc32_u64(c0, (uint64_t)_mm_cvtsi128_si64(a));
+            c1 = _mm_crc32_u64(c1, (uint64_t)_mm_cvtsi128_si64(b));
+            c2 = _mm_crc32_u64(c2, (uint64_t)_mm_cvtsi128_si64(c));
+            c0 = _mm_crc32_u64(c0, (uint64_t)_mm_extract_epi64(a, 1));
+            c1 = _mm_crc32_u64(c1, (uint64_t)_mm_extract_epi64(b, 1));
+            c2 = _mm_crc32_u64(c2, (uint64_t)_mm_extract_epi64(c, 1));
+        }
+        c0 = crc32c_shift((uint32_t)c0) ^ c1;
+        c0 = crc32c_shift((uint32_t)c0) ^ c2;
+        src += 3 * CRC_BLOCK;
+        dst = dst ? dst + 3 * CRC_BLOCK : NULL;
+        len -= 3 * CRC_BLOCK;
+    }
+    for(; len >= 8; len -= 8, src += 8){
+        uint64_t a;
+        memcpy(&a, src, 8);
+        c0 = _mm_crc32_u64(c0, a);
+        if(dst){
+            memcpy(dst, &a, 8);
+            dst += 8;
+        }
+    }
+    uint32_t c = (uint32_t)c0;
+    for(; len > 0; len--){
+        c = _mm_crc32_u8(c, *src);
+        if(dst) *dst++ = *src;
+        src++;
+    }
+    return c;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t len){
+    return crc32c_hw(crc, dst, src, len);
+}
+#endif
+
+static uint32_t crc32c_update(uint32_t crc, uint8_t *dst, const uint8_t *src, size_t len){
+    pthread_once(&crc32c_once, crc32c_init_tables);
+    crc = ~crc;
+#if defined(__x86_64__)
+    if(__builtin_cpu_supports("sse4.2")){
+        return ~crc32c_sse42(crc, dst, src, len);
+    }
+#endif
+    if(dst){
+        memcpy(dst, src, len);
+    }
+    for(size_t i = 0; i < len; i++){
+        crc = crc32c_byte_sw(crc, src[i]);
+    }
+    return ~crc;
+}
+
+/**
+ * crc32c:
+ * CRC32C of data, continuing from crc (0 to start), so a frame can be
+ * checked chunk by chunk: crc32c(crc32c(0, a, n), b, m) is the CRC of a
+ * followed by b
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len){
+    return crc32c_update(crc, NULL, data, len);
+}
+
+/**
+ * crc32c_copy:
+ * copy len bytes from src to dst (not overlapping) and return the CRC32C
+ * of them continuing from crc, in one pass over the data
+ */
+uint32_t crc32c_copy(uint32_t crc, void *dst, const void *src, size_t len){
+    return crc32c_update(crc, dst, src, len);
+}
+
+/*
+ * Synthetic frame generator. The random bytes come from four xoshiro256**
+ * streams stepped side by side in one vector (the multiplies by 5 and 9
+ * are shifts and adds, so this vectorizes without 64-bit multiplies);
+ * the distributions are mapped from those bytes in place.
+ */
+typedef uint64_t rng_vec_t __attribute__((vector_size(32)));
+
+static uint64_t splitmix64(uint64_t *x){
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * frame_rng_seed:
+ * seed the four streams; the same seed always gives the same output
+ */
+void frame_rng_seed(frame_rng_t *rng, uint64_t seed){
+    for(int k = 0; k < 4; k++){
+        for(int l = 0; l < 4; l++){
+            rng->s[k][l] = splitmix64(&seed);
+        }
+    }
+}
+
+/**
+ * frame_rng_next:
+ * next 64 random bits (from the first stream)
+ */
+uint64_t frame_rng_next(frame_rng_t *rng){
+    uint64_t *s0 = &rng->s[0][0], *s1 = &rng->s[1][0], *s2 = &rng->s[2][0], *s3 = &rng->s[3][0];
+    uint64_t x = *s1 * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t = *s1 << 17;
+    *s2 ^= *s0;
+    *s3 ^= *s1;
+    *s1 ^= *s2;
+    *s0 ^= *s3;
+    *s2 ^= t;
+    *s3 = (*s3 << 45) | (*s3 >> 19);
+    return result;
+}
+
+static inline __attribute__((always_inline))
+void frame_rng_bytes_core(frame_rng_t *rng, uint8_t *buf, size_t len){
+    rng_vec_t s0, s1, s2, s3;
+    memcpy(&s0, rng->s[0], 32);
+    memcpy(&s1, rng->s[1], 32);
+    memcpy(&s2, rng->s[2], 32);
+    memcpy(&s3, rng->s[3], 32);
+    for(size_t i = 0; i < len; i += 32){
+        rng_vec_t x = (s1 << 2) + s1;
+        x = (x << 7) | (x >> 57);
+        rng_vec_t result = (x << 3) + x;
+        rng_vec_t t = s1 << 17;
+        s2 ^= s0;
+        s3 ^= s1;
+        s1 ^= s2;
+        s0 ^= s3;
+        s2 ^= t;
+        s3 = (s3 << 45) | (s3 >> 19);
+        memcpy(buf + i, &result, len - i < 32 ? len - i : 32);
+    }
+    memcpy(rng->s[0], &s0, 32);
+    memcpy(rng->s[1], &s1, 32);
+    memcpy(rng->s[2], &s2, 32);
+    memcpy(rng->s[3], &s3, 32);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void frame_rng_bytes_avx2(frame_rng_t *rng, uint8_t *buf, size_t len){
+    frame_rng_bytes_core(rng, buf, len);
+}
+#endif
+
+/**
+ * frame_rng_bytes:
+ * fill buf with len uniformly random bytes
+ */
+void frame_rng_bytes(frame_rng_t *rng, uint8_t *buf, size_t len){
+#if defined(__x86_64__) || defined(__i386__)
+    if(__builtin_cpu_supports("avx2")){
+        frame_rng_bytes_avx2(rng, buf, len);
+        return;
+    }
+#endif
+    frame_rng_bytes_core(rng, buf, len);
+}
+
+/**
+ * frame_gen_init:
+ * set up a generator from a distribution spec:
+ *   uniform                 every byte value equally likely
+ *   alphabet:k              k distinct values, equally likely
+ *   zipf:s[:k]              k values (default 256), the value of rank r
+ *                           drawn with probability proportional to 1/r^s
+ *   runs:m[:k]              runs of one value with mean length m
+ * The values used are a random (seeded) choice of the 256 byte values.
+ * No target is forced until target is set.
+ * return 0 if success, -1 on a bad spec
+ */
+int frame_gen_init(frame_gen_t *g, const char *spec, uint64_t seed){
+    memset(g, 0, sizeof(*g));
+    frame_rng_seed(&g->rng, seed);
+    g->alphabet = 256;
+    g->target = -1;
+    g->target_pos = -1;
+    double param = 0;
+    int k = 256;
+    if(strcmp(spec, "uniform") == 0){
+        g->dist = FRAME_DIST_UNIFORM;
+    }else if(sscanf(spec, "alphabet:%d", &k) == 1){
+        g->dist = FRAME_DIST_ALPHABET;
+    }else if(sscanf(spec, "zipf:%lf:%d", &param, &k) >= 1 && param > 0){
+        g->dist = FRAME_DIST_ZIPF;
+    }else if(sscanf(spec, "runs:%lf:%d", &param, &k) >= 1 && param >= 1){
+        g->dist = FRAME_DIST_RUNS;
+        g->mean_run = (int)param;
+    }else{
+        return -1;
+    }
+    if(k < 1 || k > 256){
+        return -1;
+    }
+    g->alphabet = k;
+    // a seeded shuffle picks which byte values take part, and their ranks
+    for(int v = 0; v < 256; v++){
+        g->symbols[v] = (uint8_t)v;
+    }
+    for(int v = 255; v > 0; v--){
+        int j = (int)(frame_rng_next(&g->rng) % (v + 1));
+        uint8_t tmp = g->symbols[v];
+        g->symbols[v] = g->symbols[j];
+        g->symbols[j] = tmp;
+    }
+    if(g->dist == FRAME_DIST_ZIPF){
+        // inverse CDF quantized to FRAME_GEN_ZIPF_BUCKETS equally likely buckets
+        double total = 0, cdf = 0;
+        for(int r = 1; r <= k; r++){
+            total += pow(r, -param);
+        }
+        int r = 0;
+        for(int b = 0; b < FRAME_GEN_ZIPF_BUCKETS; b++){
+            double u = (b + 0.5) / FRAME_GEN_ZIPF_BUCKETS;
+            while(r < k - 1 && cdf + pow(r + 1, -param) / total < u){
+                cdf += pow(r + 1, -param) / total;
+                r++;
+            }
+            g->zipf_table[b] = g->symbols[r];
+        }
+    }
+    return 0;
+}
+
+/**
+ * frame_gen_fill:
+ * fill a frame from the generator's distribution. With target >= 0 the
+ * target byte is then placed at target_pos (a random position if -1),
+ * and with target_once its other occurrences are replaced first.
+ * return the position of the forced target, -1 if none
+ */
+int frame_gen_fill(frame_gen_t *g, uint8_t *buf, int len){
+    if(len <= 0){
+        return -1;
+    }
+    switch(g->dist){
+    case FRAME_DIST_UNIFORM:
+        frame_rng_bytes(&g->rng, buf, len);
+        break;
+    case FRAME_DIST_ALPHABET:
+        frame_rng_bytes(&g->rng, buf, len);
+        for(int i = 0; i < len; i++){
+            buf[i] = g->symbols[(buf[i] * g->alphabet) >> 8];
+        }
+        break;
+    case FRAME_DIST_ZIPF:{
+        uint16_t u[1024];
+        for(int i = 0; i < len; i += 1024){
+            int n = len - i < 1024 ? len - i : 1024;
+            frame_rng_bytes(&g->rng, (uint8_t *)u, n * sizeof(uint16_t));
+            for(int j = 0; j < n; j++){
+                buf[i + j] = g->zipf_table[u[j] % FRAME_GEN_ZIPF_BUCKETS];
+            }
+        }
+        break;
+    }
+    case FRAME_DIST_RUNS:
+        for(int i = 0; i < len; ){
+            uint64_t r = frame_rng_next(&g->rng);
+            // run lengths uniform in [1, 2m - 1], mean m
+            int run = 1 + (int)((r >> 32) % (2 * g->mean_run - 1));
+            uint8_t v = g->symbols[((r & 0xFF) * g->alphabet) >> 8];
+            if(run > len - i) run = len - i;
+            memset(buf + i, v, run);
+            i += run;
+        }
+        break;
+    }
+    if(g->target < 0){
+        return -1;
+    }
+    if(g->target_once){
+        uint8_t other = g->target == g->symbols[0] ? g->symbols[1] : g->symbols[0];
+        for(int i = 0; i < len; i++){
+            if(buf[i] == g->target) buf[i] = other;
+        }
+    }
+    int pos = g->target_pos >= 0 && g->target_pos < len ? g->target_pos
+                                                        : (int)(frame_rng_next(&g->rng) % len);
+    buf[pos] = (uint8_t)g->target;
+    return pos;
+}
+
+/*
+ * Text rendering of frame bytes for dumps. Decimal comes from a table of
+ * "ddd " strings; hex lines turn each nibble into a digit with pshufb and
+ * spread the digit pairs into "xx " columns with two more shuffles.
+ */
+static char format_dec[256][4];         // "d ", "dd " or "ddd "
+static uint8_t format_dec_len[256];
+static char format_hex_pair[256][2];
+static pthread_once_t format_once = PTHREAD_ONCE_INIT;
+
+static void format_init_tables(void){
+    static const char digits[] = "0123456789abcdef";
+    for(int v = 0; v < 256; v++){
+        char tmp[8];
+        int n = snprintf(tmp, sizeof(tmp), "%d ", v);
+        memcpy(format_dec[v], tmp, 4);
+        format_dec_len[v] = (uint8_t)n;
+        format_hex_pair[v][0] = digits[v >> 4];
+        format_hex_pair[v][1] = digits[v & 15];
+    }
+}
+
+/**
+ * format_decimal:
+ * write each byte as "%d " (what print_data prints), without a newline
+ * out must hold 4 * data_len bytes; return the number of bytes written
+ */
+size_t format_decimal(char *out, const uint8_t *data, int data_len){
+    pthread_once(&format_once, format_init_tables);
+    char *p = out;
+    for(int i = 0; i < data_len; i++){
+        memcpy(p, format_dec[data[i]], 4);     // fixed-size copy, then advance by the real length
+        p += format_dec_len[data[i]];
+    }
+    return p - out;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// for 8 bytes as 16 hex digits: digit index for each "xx " column, 0x80 for the spaces
+static const uint8_t hex_spread_lo[16] __attribute__((aligned(16))) = {
+    0, 1, 0x80, 2, 3, 0x80, 4, 5, 0x80, 6, 7, 0x80, 8, 9, 0x80, 10,
+};
+static const uint8_t hex_spread_hi[16] __attribute__((aligned(16))) = {
+    11, 0x80, 12, 13, 0x80, 14, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
+static const uint8_t hex_spaces_lo[16] __attribute__((aligned(16))) = {
+    0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, ' ', 0,
+};
+static const uint8_t hex_spaces_hi[16] __attribute__((aligned(16))) = {
+    0, ' ', 0, 0, ' ', 0, 0, ' ', 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+// 16 bytes as 48 chars of "xx " columns, plus the ASCII column
+__attribute__((target("ssse3")))
+static void format_hex16_ssse3(char *hex, char *ascii, const uint8_t *data){
+    const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                         '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i low4 = _mm_set1_epi8(0x0F);
+    __m128i v = _mm_loadu_si128((const __m128i *)data);
+    __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, low4));
+    __m128i pairs[2] = { _mm_unpacklo_epi8(hi, lo), _mm_unpackhi_epi8(hi, lo) };
+    const __m128i spread_lo = _mm_load_si128((const __m128i *)hex_spread_lo);
+    const __m128i spread_hi = _mm_load_si128((const __m128i *)hex_spread_hi);
+    const __m128i spaces_lo = _mm_load_si128((const __m128i *)hex_spaces_lo);
+    const __m128i spaces_hi = _mm_load_si128((const __m128i *)hex_spaces_hi);
+    for(int h = 0; h < 2; h++){
+        // 24 output bytes per half: stored as 16 + 16, the second store's
+        // tail is overwritten by the next half (or the caller's separator)
+        _mm_storeu_si128((__m128i *)(hex + 24 * h),
+                         _mm_or_si128(_mm_shuffle_epi8(pairs[h], spread_lo), spaces_lo));
+        _mm_storeu_si128((__m128i *)(hex + 24 * h + 16),
+                         _mm_or_si128(_mm_shuffle_epi8(pairs[h], spread_hi), spaces_hi));
+    }
+    // printable ASCII as is, everything else as '.'
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8(0x7F)));
+    __m128i shown = _mm_or_si128(_mm_and_si128(printable, v),
+                                 _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+    _mm_storeu_si128((__m128i *)ascii, shown);
+}
+#endif
+
+/**
+ * format_hex_line:
+ * render up to 16 bytes as one dump line,
+ *   "oooooooo  xx xx ... xx  |ascii...|\n"
+ * padding the hex columns of a short last line.
+ * out must hold FORMAT_HEX_LINE_MAX bytes; return the number of bytes written
+ */
+size_t format_hex_line(char *out, uint64_t offset, const uint8_t *data, int data_len){
+    pthread_once(&format_once, format_init_tables);
+    if(data_len > 16) data_len = 16;
+    if(data_len < 0) data_len = 0;
+    char *p = out;
+    for(int shift = 24; shift >= 0; shift -= 8){
+        memcpy(p, format_hex_pair[(offset >> shift) & 0xFF], 2);
+        p += 2;
+    }
+    *p++ = ' ';
+    *p++ = ' ';
+    char *hex = p;
+    char *ascii = p + 48 + 2;
+#if defined(__x86_64__) || defined(__i386__)
+    if(data_len == 16 && __builtin_cpu_supports("ssse3")){
+        format_hex16_ssse3(hex, ascii, data);
+    }else
+#endif
+    {
+        for(int i = 0; i < 16; i++){
+            if(i < data_len){
+                memcpy(hex + 3 * i, format_hex_pair[data[i]], 2);
+                ascii[i] = data[i] > 0x1F && data[i] < 0x7F ? (char)data[i] : '.';
+            }else{
+                hex[3 * i] = hex[3 * i + 1] = ' ';
+            }
+            hex[3 * i + 2] = ' ';
+        }
+    }
+    // ascii was stored before the separator: keep its bytes, then close it
+    hex[48] = ' ';
+    hex[49] = '|';
+    ascii[data_len] = '|';
+    ascii[data_len + 1] = '\n';
+    return ascii + data_len + 2 - out;
+}
+
+/*
+ * Line-delimited text. Newlines are found 64 bytes at a time as a bitmask
+ * (one compare per 16 or 32 bytes), and every line ending in the block is
+ * then taken from the mask with ctz, so short lines cost no rescanning.
+ */
+static inline __attribute__((always_inline))
+uint64_t newline_mask64_sse2(const uint8_t *p){
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+    uint64_t m0 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+    uint64_t m1 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), nl));
+    uint64_t m2 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), nl));
+    uint64_t m3 = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), nl));
+    return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+#else
+    uint64_t m = 0;
+    for(int i = 0; i < 64; i++){
+        m |= (uint64_t)(p[i] == '\n') << i;
+    }
+    return m;
+#endif
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2")))
+static uint64_t newline_mask64_avx2(const uint8_t *p){
+    const __m256i nl = _mm256_set1_epi8('\n');
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), nl));
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(p + 32)), nl));
+    return lo | hi << 32;
+}
+#endif
+
+static uint64_t newline_mask64_default(const uint8_t *p){
+    return newline_mask64_sse2(p);
+}
+
+static uint64_t (*newline_mask64)(const uint8_t *) = newline_mask64_default;
+static pthread_once_t newline_once = PTHREAD_ONCE_INIT;
+
+static void newline_select(void){
+#ifdef X86_KERNELS
+    if(__builtin_cpu_supports("avx2")) newline_mask64 = newline_mask64_avx2;
+#endif
+}
+
+// append to the partial line, growing its buffer up to max_line bytes
+static int line_partial_append(line_splitter_t *ls, const char *data, size_t len){
+    if(ls->partial_len + len > ls->max_line){
+        ls->overlong++;
+        ls->partial_len = 0;
+        ls->skipping = 1;       // drop the rest of this line too
+        return -1;
+    }
+    if(ls->partial_len + len > ls->partial_cap){
+        size_t cap = ls->partial_cap ? ls->partial_cap : 256;
+        while(cap < ls->partial_len + len) cap *= 2;
+        char *p = realloc(ls->partial, cap);
+        if(p == NULL){
+            return -1;
+        }
+        ls->partial = p;
+        ls->partial_cap = cap;
+    }
+    memcpy(ls->partial + ls->partial_len, data, len);
+    ls->partial_len += len;
+    return 0;
+}
+
+/**
+ * line_splitter_init:
+ * start splitting a stream into lines of at most max_line bytes
+ * (longer lines are dropped and counted in overlong)
+ */
+void line_splitter_init(line_splitter_t *ls, size_t max_line){
+    memset(ls, 0, sizeof(*ls));
+    ls->max_line = max_line;
+    pthread_once(&newline_once, newline_select);
+}
+
+void line_splitter_free(line_splitter_t *ls){
+    free(ls->partial);
+    ls->partial = NULL;
+    ls->partial_cap = ls->partial_len = 0;
+}
+
+/**
+ * line_splitter_feed:
+ * split the next chunk of the stream and call fn for every complete line
+ * (without its '\n'). Lines inside the chunk are passed in place; only a
+ * line straddling chunks is copied, into the splitter's partial buffer.
+ * return the number of lines passed to fn
+ */
+size_t line_splitter_feed(line_splitter_t *ls, const char *data, size_t len, line_fn fn, void *ctx){
+    const uint8_t *p = (const uint8_t *)data;
+    size_t start = 0, lines = 0;
+    size_t i = 0;
+
+    // the line a previous chunk left open is finished by the first newline
+    #define LINE_END(end) do{ \
+        if(ls->partial_len > 0 || ls->skipping){ \
+            if(!ls->skipping && line_partial_append(ls, data + start, (end) - start) == 0){ \
+                fn(ctx, ls->partial, ls->partial_len); \
+                lines++; \
+            } \
+            ls->partial_len = 0; \
+            ls->skipping = 0; \
+        }else if((end) - start <= ls->max_line){ \
+            fn(ctx, data + start, (end) - start); \
+            lines++; \
+        }else{ \
+            ls->overlong++; \
+        } \
+        start = (end) + 1; \
+    }while(0)
+
+    for(; i + 64 <= len; i += 64){
+        uint64_t m = newline_mask64(p + i);
+        while(m){
+            LINE_END(i + __builtin_ctzll(m));
+            m &= m - 1;
+        }
+    }
+    for(; i < len; i++){
+        if(p[i] == '\n'){
+            LINE_END(i);
+        }
+    }
+    #undef LINE_END
+    if(start < len && !ls->skipping){
+        line_partial_append(ls, data + start, len - start);
+    }
+    ls->lines += lines;
+    return lines;
+}
+
+/**
+ * parse_u64:
+ * parse the decimal digits at p (not past end) into *value. Eight digits
+ * at a time are checked and combined in a 64-bit word (SWAR); the short
+ * rest digit by digit.
+ * return the first byte after the digits, or NULL if there is no digit
+ * or the number does not fit in 19 digits
+ */
+const char *parse_u64(const char *p, const char *end, uint64_t *value){
+    uint64_t v = 0;
+    int digits = 0;
+    while(end - p >= 8){
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        // a byte is a digit when its high nibble is 3 and its low nibble <= 9
+        uint64_t bad = ((chunk & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull) |
+                       (((chunk & 0x0F0F0F0F0F0F0F0Full) + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull);
+        int n = bad ? __builtin_ctzll(bad) / 8 : 8;     // leading digits (little-endian)
+        if(n == 0){
+            break;
+        }
+        digits += n;
+        if(digits > 19){
+            return NULL;
+        }
+        uint64_t d = (chunk - 0x3030303030303030ull) & (n == 8 ? ~0ull : (1ull << (8 * n)) - 1);
+        d <<= 8 * (8 - n);  // right-align: the missing digits become leading zeros
+        d = d * 10 + (d >> 8);
+        d = (((d & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+             (((d >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >> 32;
+        static const uint64_t pow10[9] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+        v = v * pow10[n] + d;
+        p += n;
+        if(n < 8){
+            *value = v;
+            return p;
+        }
+    }
+    while(p < end && *p >= '0' && *p <= '9'){
+        if(++digits > 19){
+            return NULL;
+        }
+        v = v * 10 + (uint64_t)(*p++ - '0');
+    }
+    if(digits == 0){
+        return NULL;
+    }
+    *value = v;
+    return p;
+}
+
+/**
+ * parse_line_fields:
+ * the unsigned numbers of a text line in order, e.g. 3 and 17 for
+ * "Client 3 message #17"
+ * return the number of fields found (at most max_fields are stored)
+ */
+int parse_line_fields(const char *line, size_t len, uint64_t *fields, int max_fields){
+    const char *p = line, *end = line + len;
+    int n = 0;
+    while(p < end){
+        if(*p < '0' || *p > '9'){
+            p++;
+            continue;
+        }
+        uint64_t v;
+        const char *next = parse_u64(p, end, &v);
+        if(next == NULL){
+            // too long for 64 bits: skip the whole run of digits
+            while(p < end && *p >= '0' && *p <= '9') p++;
+            continue;
+        }
+        if(n < max_fields){
+            fields[n] = v;
+        }
+        n++;
+        p = next;
+    }
+    return n;
+}
+
+/*
+ * Refcounted frame buffers. A pool keeps up to max_free released buffers
+ * of buf_len bytes on a mutex-protected free list; the lock is held only
+ * to push or pop one pointer. Requests larger than buf_len are served
+ * from the heap and freed on their last release.
+ *
+ * A pool placed on a NUMA node carves its buffers out of page-aligned
+ * slabs whose memory policy prefers that node (mbind), so they stay
+ * node-local whichever thread touches them first. Slab buffers are
+ * never freed, only returned to the pool, which keeps its high-water
+ * mark until it is destroyed.
+ */
+#define FRAME_BUF_SLAB_LEN (256 * 1024)
+
+struct frame_buf_pool{
+    pthread_mutex_t mutex;
+    frame_buf_t *free_list;
+    int num_free;
+    int max_free;
+    size_t buf_len;
+    int node;                   // NUMA node, -1 for heap buffers
+    void **slabs;               // node pools: the slabs, for destroy
+    size_t slab_len;
+    int num_slabs;
+};
+
+static frame_buf_t *frame_buf_new(size_t cap){
+    frame_buf_t *b = aligned_alloc(64, (sizeof(frame_buf_t) + cap + 63) & ~(size_t)63);
+    if(b == NULL){
+        return NULL;
+    }
+    b->cap = cap;
+    b->pool = NULL;
+    b->next = NULL;
+    return b;
+}
+
+// map a slab preferring the pool's node and queue all but one of its buffers
+static frame_buf_t *frame_buf_slab(frame_buf_pool_t *pool){
+#ifdef __linux__
+    size_t stride = (sizeof(frame_buf_t) + pool->buf_len + 63) & ~(size_t)63;
+    uint8_t *slab = mmap(NULL, pool->slab_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(slab == MAP_FAILED){
+        return NULL;
+    }
+#ifdef SYS_mbind
+    // a preference, not a binding: a full node falls back to the others
+    unsigned long nodemask[4] = {0, 0, 0, 0};
+    if(pool->node < 256){
+        nodemask[pool->node / 64] = 1ul << (pool->node % 64);
+        syscall(SYS_mbind, slab, pool->slab_len, MPOL_PREFERRED, nodemask, 257, 0);
+    }
+#endif
+    frame_buf_t *first = NULL;
+    pthread_mutex_lock(&pool->mutex);
+    void **slabs = realloc(pool->slabs, (pool->num_slabs + 1) * sizeof(void *));
+    if(slabs == NULL){
+        pthread_mutex_unlock(&pool->mutex);
+        munmap(slab, pool->slab_len);
+        return NULL;
+    }
+    pool->slabs = slabs;
+    pool->slabs[pool->num_slabs++] = slab;
+    for(size_t off = 0; off + stride <= pool->slab_len; off += stride){
+        frame_buf_t *b = (frame_buf_t *)(slab + off);
+        b->cap = pool->buf_len;
+        b->pool = pool;
+        if(first == NULL){
+            first = b;
+            continue;
+        }
+        b->next = pool->free_list;
+        pool->free_list = b;
+        pool->num_free++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return first;
+#else
+    (void)pool;
+    return NULL;
+#endif
+}
+
+/**
+ * frame_buf_pool_create:
+ * a pool of buffers of buf_len bytes, keeping at most max_free idle ones
+ * return the pool, or NULL if out of memory
+ */
+frame_buf_pool_t *frame_buf_pool_create(size_t buf_len, int max_free){
+    return frame_buf_pool_create_on_node(buf_len, max_free, -1);
+}
+
+/**
+ * frame_buf_pool_create_on_node:
+ * like frame_buf_pool_create, with the buffers placed on a NUMA node
+ * (node < 0 for none). Placement is best effort: without mbind support
+ * the buffers land where they are first touched.
+ * return the pool, or NULL if out of memory
+ */
+frame_buf_pool_t *frame_buf_pool_create_on_node(size_t buf_len, int max_free, int node){
+    if(buf_len == 0 || buf_len > UINT32_MAX){
+        return NULL;
+    }
+    frame_buf_pool_t *pool = calloc(1, sizeof(*pool));
+    if(pool == NULL){
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pool->buf_len = buf_len;
+    pool->max_free = max_free;
+#ifndef __linux__
+    node = -1;
+#endif
+    pool->node = node;
+    if(node >= 0){
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t stride = (sizeof(frame_buf_t) + buf_len + 63) & ~(size_t)63;
+        pool->slab_len = stride > FRAME_BUF_SLAB_LEN ? (stride + page - 1) & ~(page - 1) : FRAME_BUF_SLAB_LEN;
+    }
+    return pool;
+}
+
+/**
+ * frame_buf_pool_destroy:
+ * free the pool and its idle buffers. Buffers still referenced must not
+ * be released afterwards.
+ */
+void frame_buf_pool_destroy(frame_buf_pool_t *pool){
+    if(pool == NULL){
+        return;
+    }
+    while(pool->free_list && pool->node < 0){
+        frame_buf_t *b = pool->free_list;
+        pool->free_list = b->next;
+        free(b);
+    }
+    for(int i = 0; i < pool->num_slabs; i++){
+        munmap(pool->slabs[i], pool->slab_len);
+    }
+    free(pool->slabs);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+/**
+ * frame_buf_alloc:
+ * a buffer of at least len bytes holding one reference, for the caller to
+ * fill before sharing it (len is set to 0)
+ * return the buffer, or NULL if out of memory
+ */
+frame_buf_t *frame_buf_alloc(frame_buf_pool_t *pool, size_t len){
+    frame_buf_t *b = NULL;
+    if(pool && len <= pool->buf_len){
+        pthread_mutex_lock(&pool->mutex);
+        if((b = pool->free_list) != NULL){
+            pool->free_list = b->next;
+            pool->num_free--;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+        if(b == NULL && pool->node >= 0){
+            b = frame_buf_slab(pool);
+        }else if(b == NULL && (b = frame_buf_new(pool->buf_len)) != NULL){
+            b->pool = pool;
+        }
+    }else if(len <= UINT32_MAX){
+        b = frame_buf_new(len);
+    }
+    if(b){
+        b->refs = 1;
+        b->len = 0;
+    }
+    return b;
+}
+
+/**
+ * frame_buf_release:
+ * drop one reference; the last one returns the buffer to its pool, or
+ * frees it if the pool is full or it came from the heap
+ */
+void frame_buf_release(frame_buf_t *b){
+    if(b == NULL || __atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL) != 0){
+        return;
+    }
+    frame_buf_pool_t *pool = b->pool;
+    if(pool){
+        pthread_mutex_lock(&pool->mutex);
+        if(pool->num_free < pool->max_free || pool->node >= 0){
+            b->next = pool->free_list;
+            pool->free_list = b;
+            pool->num_free++;
+            b = NULL;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    free(b);
+}
+
+/**
+ * perf_counter_open:
+ * count a hardware event for the calling thread, in user space only
+ * return the counter (stopped), or -1 if the kernel or the hypervisor
+ * does not expose the event (common in VMs and containers)
+ */
+int perf_counter_open(perf_counter_event_t event){
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    switch(event){
+    case PERF_COUNTER_CACHE_MISSES:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case PERF_COUNTER_L1D_MISSES:
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        break;
+    default:
+        return -1;
+    }
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    (void)event;
+    return -1;
+#endif
+}
+
+// zero the counter and start counting
+void perf_counter_start(int fd){
+#ifdef __linux__
+    if(fd >= 0){
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+/**
+ * perf_counter_stop:
+ * stop counting
+ * return the events counted since perf_counter_start, -1 if unavailable
+ */
+int64_t perf_counter_stop(int fd){
+    uint64_t count;
+    if(fd < 0){
+        return -1;
+    }
+#ifdef __linux__
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    if(read(fd, &count, sizeof(count)) != sizeof(count)){
+        return -1;
+    }
+    return (int64_t)count;
+}
+
+#ifdef __linux__
+#define CO_EVENTS 64    // epoll events taken per scheduler wakeup
+
+// what a suspended coroutine waits for
+enum{ CO_WAIT_NONE, CO_WAIT_FD, CO_WAIT_TIMER, CO_WAIT_PARK, CO_WAIT_JOIN };
+enum{ CO_READY, CO_RUNNING, CO_WAITING, CO_DONE };
+
+struct co{
+    ucontext_t ctx;
+    co_sched_t *sched;
+    co_fn fn;
+    void *arg;
+    uint8_t *stack;         // mapping: guard page, then the stack
+    int state;              // CO_READY, CO_RUNNING, CO_WAITING or CO_DONE
+    int wait;               // CO_WAIT_* while CO_WAITING
+    int wait_fd;            // CO_WAIT_FD: the fd
+    int wake_errno;         // errno for the suspended call, 0 if its wait completed
+    int joinable;
+    int cancelled;
+    uint64_t deadline_ns;   // CO_WAIT_TIMER: CLOCK_MONOTONIC wakeup time
+    int timer_pos;          // index in the timer heap, -1 if not in it
+    co_t *joiner;           // coroutine waiting in co_join
+    co_t *next;             // run queue or free list link
+};
+
+// coroutines waiting on an fd: one reader and one writer at a time
+typedef struct{
+    co_t *reader;
+    co_t *writer;
+    int watched;            // in the epoll set, non-blocking
+} co_fd_t;
+
+struct co_sched{
+    int epfd;
+    size_t stack_size;
+    size_t guard_len;
+    ucontext_t main_ctx;    // the thread running co_sched_run
+    co_t *current;          // running coroutine, NULL in the scheduler
+    co_t *run_head, *run_tail;
+    co_t **timers;          // min-heap on deadline_ns
+    int num_timers, timers_cap;
+    co_fd_t *fds;           // indexed by fd
+    int num_fds;
+    co_t *free;             // finished coroutines kept with their stacks
+    int live;               // coroutines not finished
+};
+
+static __thread co_sched_t *co_running;    // scheduler running on this thread
+
+static uint64_t co_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void co_timer_swap(co_sched_t *s, int a, int b){
+    co_t *t = s->timers[a];
+    s->timers[a] = s->timers[b];
+    s->timers[b] = t;
+    s->timers[a]->timer_pos = a;
+    s->timers[b]->timer_pos = b;
+}
+
+static void co_timer_up(co_sched_t *s, int pos){
+    while(pos > 0 && s->timers[(pos - 1) / 2]->deadline_ns > s->timers[pos]->deadline_ns){
+        co_timer_swap(s, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void co_timer_down(co_sched_t *s, int pos){
+    while(1){
+        int least = pos, l = 2 * pos + 1, r = l + 1;
+        if(l < s->num_timers && s->timers[l]->deadline_ns < s->timers[least]->deadline_ns) least = l;
+        if(r < s->num_timers && s->timers[r]->deadline_ns < s->timers[least]->deadline_ns) least = r;
+        if(least == pos){
+            return;
+        }
+        co_timer_swap(s, pos, least);
+        pos = least;
+    }
+}
+
+static int co_timer_add(co_sched_t *s, co_t *co){
+    if(s->num_timers == s->timers_cap){
+        int cap = s->timers_cap ? 2 * s->timers_cap : 64;
+        co_t **timers = realloc(s->timers, cap * sizeof(co_t *));
+        if(timers == NULL){
+            return -1;
+        }
+        s->timers = timers;
+        s->timers_cap = cap;
+    }
+    co->timer_pos = s->num_timers;
+    s->timers[s->num_timers++] = co;
+    co_timer_up(s, co->timer_pos);
+    return 0;
+}
+
+static void co_timer_remove(co_sched_t *s, co_t *co){
+    int pos = co->timer_pos;
+    co_t *last = s->timers[--s->num_timers];
+    if(pos < s->num_timers){
+        s->timers[pos] = last;
+        last->timer_pos = pos;
+        co_timer_up(s, pos);
+        co_timer_down(s, last->timer_pos);
+    }
+    co->timer_pos = -1;
+}
+
+static void co_make_ready(co_t *co){
+    co_sched_t *s = co->sched;
+    co->state = CO_READY;
+    co->next = NULL;
+    if(s->run_tail){
+        s->run_tail->next = co;
+    }else{
+        s->run_head = co;
+    }
+    s->run_tail = co;
+}
+
+// end a coroutine's wait: err is what the suspended call fails with, 0 if none
+static void co_unwait(co_t *co, int err){
+    co_sched_t *s = co->sched;
+    if(co->wait == CO_WAIT_FD){
+        co_fd_t *f = &s->fds[co->wait_fd];
+        if(f->reader == co) f->reader = NULL;
+        if(f->writer == co) f->writer = NULL;
+    }else if(co->wait == CO_WAIT_TIMER){
+        co_timer_remove(s, co);
+    }
+    co->wait = CO_WAIT_NONE;
+    co->wake_errno = err;
+    co_make_ready(co);
+}
+
+// switch back to the scheduler until the coroutine's wait ends
+static int co_suspend(co_t *co, int wait){
+    co->state = CO_WAITING;
+    co->wait = wait;
+    co->wake_errno = 0;
+    swapcontext(&co->ctx, &co->sched->main_ctx);
+    if(co->wake_errno){
+        errno = co->wake_errno;
+        return -1;
+    }
+    return 0;
+}
+
+static void co_entry(void){
+    co_sched_t *s = co_running;
+    co_t *co = s->current;
+    co->fn(co->arg);
+    co->state = CO_DONE;
+    s->live--;
+    if(co->joiner){
+        co_unwait(co->joiner, 0);
+    }
+    setcontext(&s->main_ctx);  // the scheduler recycles the stack
+}
+
+static void co_recycle(co_sched_t *s, co_t *co){
+    co->next = s->free;
+    s->free = co;
+}
+
+// point a coroutine's context at the start of co_entry on its stack
+static void co_init_ctx(co_t *co){
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack + co->sched->guard_len;
+    co->ctx.uc_stack.ss_size = co->sched->stack_size;
+    co->ctx.uc_link = NULL;
+    makecontext(&co->ctx, co_entry, 0);
+}
+
+/**
+ * co_sched_create:
+ * create a scheduler; run it on the thread that will own its coroutines
+ * stack_size: bytes of stack per coroutine, 0 for CO_STACK_SIZE
+ * return the scheduler, NULL on failure
+ */
+co_sched_t *co_sched_create(size_t stack_size){
+    co_sched_t *s = calloc(1, sizeof(co_sched_t));
+    if(s == NULL){
+        return NULL;
+    }
+    s->guard_len = sysconf(_SC_PAGESIZE);
+    s->stack_size = ((stack_size ? stack_size : CO_STACK_SIZE) + s->guard_len - 1) & ~(s->guard_len - 1);
+    if((s->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0){
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// destroy a scheduler whose coroutines have all finished (and been joined)
+void co_sched_destroy(co_sched_t *s){
+    while(s->free){
+        co_t *co = s->free;
+        s->free = co->next;
+        munmap(co->stack, s->guard_len + s->stack_size);
+        free(co);
+    }
+    free(s->timers);
+    free(s->fds);
+    close(s->epfd);
+    free(s);
+}
+
+/**
+ * co_spawn:
+ * start a coroutine running fn(arg); it first runs at the scheduler's next pass
+ * s: the scheduler, NULL for the calling coroutine's
+ * joinable: keep the coroutine after it finishes, until co_join; otherwise
+ *   the returned handle must not be used once it may have finished
+ * return the coroutine, NULL on failure
+ */
+co_t *co_spawn(co_sched_t *s, co_fn fn, void *arg, int joinable){
+    if(s == NULL && (s = co_running) == NULL){
+        errno = EINVAL;
+        return NULL;
+    }
+    co_t *co = s->free;
+    if(co){
+        s->free = co->next;
+    }else{
+        if((co = calloc(1, sizeof(co_t))) == NULL){
+            return NULL;
+        }
+        co->stack = mmap(NULL, s->guard_len + s->stack_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if(co->stack == MAP_FAILED){
+            free(co);
+            return NULL;
+        }
+        mprotect(co->stack, s->guard_len, PROT_NONE);   // an overflow faults instead of corrupting
+        co->sched = s;
+    }
+    co->fn = fn;
+    co->arg = arg;
+    co->joinable = joinable;
+    co->cancelled = 0;
+    co->joiner = NULL;
+    co->wait = CO_WAIT_NONE;
+    co->timer_pos = -1;
+    co_init_ctx(co);
+    s->live++;
+    co_make_ready(co);
+    return co;
+}
+
+/**
+ * co_sched_run:
+ * run the scheduler's coroutines on the calling thread until all have finished
+ * return 0, or -1 if epoll_wait failed
+ */
+int co_sched_run(co_sched_t *s){
+    struct epoll_event events[CO_EVENTS];
+    co_sched_t *outer = co_running;
+    co_running = s;
+    while(1){
+        co_t *co;
+        while((co = s->run_head) != NULL){
+            if((s->run_head = co->next) == NULL){
+                s->run_tail = NULL;
+            }
+            co->state = CO_RUNNING;
+            s->current = co;
+            swapcontext(&s->main_ctx, &co->ctx);
+            s->current = NULL;
+            if(co->state == CO_DONE && !co->joinable){
+                co_recycle(s, co);
+            }
+        }
+        if(s->live == 0){
+            break;
+        }
+        int timeout = -1;
+        if(s->num_timers > 0){
+            uint64_t now = co_now_ns(), due = s->timers[0]->deadline_ns;
+            timeout = due <= now ? 0 : (int)((due - now + 999999) / 1000000);
+        }
+        int n = epoll_wait(s->epfd, events, CO_EVENTS, timeout);
+        if(n < 0 && errno != EINTR){
+            co_running = outer;
+            return -1;
+        }
+        for(int i = 0; i < n; i++){
+            co_fd_t *f = &s->fds[events[i].data.fd];
+            uint32_t ev = events[i].events;
+            if(f->reader && (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))){
+                co_unwait(f->reader, 0);
+            }
+            if(f->writer && (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))){
+                co_unwait(f->writer, 0);
+            }
+        }
+        uint64_t now = co_now_ns();
+        while(s->num_timers > 0 && s->timers[0]->deadline_ns <= now){
+            co_unwait(s->timers[0], 0);
+        }
+    }
+    co_running = outer;
+    return 0;
+}
+
+// the running coroutine, NULL outside coroutines
+co_t *co_self(void){
+    return co_running ? co_running->current : NULL;
+}
+
+/**
+ * co_join:
+ * wait (in a coroutine) for a joinable coroutine to finish, then free it.
+ * Cancelling the waiting coroutine does not interrupt the wait.
+ */
+void co_join(co_t *co){
+    co_t *self = co_self();
+    if(co->state != CO_DONE){
+        co->joiner = self;
+        co_suspend(self, CO_WAIT_JOIN);
+    }
+    co_recycle(co->sched, co);
+}
+
+/**
+ * co_cancel:
+ * make the coroutine's pending and future co_* calls fail with ECANCELED,
+ * so it unwinds at its next suspension point; no effect once it finished
+ */
+void co_cancel(co_t *co){
+    if(co->state == CO_DONE || co->cancelled){
+        return;
+    }
+    co->cancelled = 1;
+    if(co->state == CO_WAITING && co->wait != CO_WAIT_JOIN){
+        co_unwait(co, ECANCELED);
+    }
+}
+
+// suspend the running coroutine until co_wake; return 0, -1 if cancelled
+int co_park(void){
+    co_t *self = co_self();
+    if(self == NULL){
+        errno = EPERM;
+        return -1;
+    }
+    if(self->cancelled){
+        errno = ECANCELED;
+        return -1;
+    }
+    return co_suspend(self, CO_WAIT_PARK);
+}
+
+// resume a coroutine suspended in co_park; no effect on any other
+void co_wake(co_t *co){
+    if(co->state == CO_WAITING && co->wait == CO_WAIT_PARK){
+        co_unwait(co, 0);
+    }
+}
+
+// add an fd to the scheduler's epoll set (edge triggered) on first use
+static int co_watch(co_sched_t *s, int fd){
+    if(fd >= s->num_fds){
+        int num = s->num_fds ? s->num_fds : 64;
+        while(num <= fd) num *= 2;
+        co_fd_t *fds = realloc(s->fds, num * sizeof(co_fd_t));
+        if(fds == NULL){
+            return -1;
+        }
+        memset(fds + s->num_fds, 0, (num - s->num_fds) * sizeof(co_fd_t));
+        s->fds = fds;
+        s->num_fds = num;
+    }
+    co_fd_t *f = &s->fds[fd];
+    if(!f->watched){
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.fd = fd };
+        int flags = fcntl(fd, F_GETFL);
+        if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+           (epoll_ctl(s->epfd, EPOLL_CTL_ADD, fd, &ev) < 0 && errno != EEXIST)){
+            return -1;
+        }
+        f->watched = 1;
+    }
+    return 0;
+}
+
+// suspend until the fd is readable (EPOLLIN) or writable (EPOLLOUT)
+static int co_wait_fd(co_t *co, int fd, uint32_t events){
+    co_fd_t *f = &co->sched->fds[fd];
+    co_t **slot = events == EPOLLIN ? &f->reader : &f->writer;
+    if(*slot){
+        errno = EBUSY;
+        return -1;
+    }
+    *slot = co;
+    co->wait_fd = fd;
+    return co_suspend(co, CO_WAIT_FD);
+}
+
+// checks shared by the co_* I/O calls: 1 to go on in coroutine mode, 0 to
+// block like the system call, -1 to fail
+static int co_io_begin(co_t *co, int fd){
+    if(co == NULL){
+        return 0;
+    }
+    if(co->cancelled){
+        errno = ECANCELED;
+        return -1;
+    }
+    return co_watch(co->sched, fd) < 0 ? -1 : 1;
+}
+
+/**
+ * co_read:
+ * read(2) that suspends the coroutine until data arrives
+ * return bytes read, 0 at end of file, -1 on error
+ */
+ssize_t co_read(int fd, void *buf, size_t len){
+    co_t *co = co_self();
+    int mode = co_io_begin(co, fd);
+    if(mode <= 0){
+        return mode < 0 ? -1 : read(fd, buf, len);
+    }
+    while(1){
+        ssize_t n = read(fd, buf, len);
+        if(n >= 0 || (errno != EAGAIN && errno != EINTR)){
+            return n;
+        }
+        if(errno == EAGAIN && co_wait_fd(co, fd, EPOLLIN) < 0){
+            return -1;
+        }
+    }
+}
+
+/**
+ * co_write:
+ * write all of buf, suspending while the fd is full. Sockets are written
+ * with MSG_NOSIGNAL: a closed peer is an EPIPE error, not a signal.
+ * return len, or -1 on error (some bytes may have been written)
+ */
+ssize_t co_write(int fd, const void *buf, size_t len){
+    co_t *co = co_self();
+    int mode = co_io_begin(co, fd);
+    if(mode < 0){
+        return -1;
+    }
+    const uint8_t *p = buf;
+    size_t left = len;
+    while(left > 0){
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if(n < 0 && errno == ENOTSOCK){
+            n = write(fd, p, left);
+        }
+        if(n >= 0){
+            p += n;
+            left -= n;
+            continue;
+        }
+        if(errno == EINTR){
+            continue;
+        }
+        if(errno != EAGAIN || mode == 0 || co_wait_fd(co, fd, EPOLLOUT) < 0){
+            return -1;
+        }
+    }
+    return len;
+}
 
-    while(left <= right){   // binary search loop
-        int mid = left + (right - left) / 2; // middle index
-        if(data[mid] == target){    // target found
-            return mid;             // return the index of the target byte found
+// read exactly len bytes unless the stream ends; return the bytes read, -1 on error
+static ssize_t co_read_full(int fd, uint8_t *buf, size_t len){
+    size_t got = 0;
+    while(got < len){
+        ssize_t n = co_read(fd, buf + got, len - got);
+        if(n < 0){
+            return -1;
         }
-        else if(data[mid] < target){ // target is in the right half
-            left = mid + 1;          // move the left index to the right
+        if(n == 0){
+            break;
         }
-        else{
-            right = mid - 1;         // move the right index to the left
+        got += n;
+    }
+    return got;
+}
+
+/**
+ * co_read_frame:
+ * read one whole binary frame (see frame.h): header, payload and CRC32C
+ * trailer if any, which is verified
+ * buf: receives the frame, cap bytes
+ * return the frame length (FRAME_HDR_LEN + body), 0 if the stream ended
+ * between frames, or -1: EPROTO for a bad header or a stream ending inside
+ * a frame, EMSGSIZE for a frame over cap (its header is consumed, so the
+ * stream is lost), EBADMSG for a CRC mismatch (the frame is consumed)
+ */
+ssize_t co_read_frame(int fd, uint8_t *buf, size_t cap){
+    frame_hdr_t hdr;
+    if(cap < FRAME_HDR_LEN){
+        errno = EMSGSIZE;
+        return -1;
+    }
+    ssize_t n = co_read_full(fd, buf, FRAME_HDR_LEN);
+    if(n <= 0){
+        return n;
+    }
+    if(n < FRAME_HDR_LEN || frame_decode_hdr(buf, &hdr) < 0){
+        errno = EPROTO;
+        return -1;
+    }
+    size_t body = frame_body_len(&hdr);
+    if(FRAME_HDR_LEN + body > cap){
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if((n = co_read_full(fd, buf + FRAME_HDR_LEN, body)) < 0){
+        return -1;
+    }
+    if((size_t)n < body){
+        errno = EPROTO;
+        return -1;
+    }
+    if(hdr.flags & FRAME_FLAG_CRC){
+        uint32_t sent;
+        memcpy(&sent, buf + FRAME_HDR_LEN + hdr.len, FRAME_CRC_LEN);
+        if(ntohl(sent) != crc32c(0, buf, FRAME_HDR_LEN + hdr.len)){
+            errno = EBADMSG;
+            return -1;
         }
     }
-    return -1;
+    return FRAME_HDR_LEN + body;
 }
 
 /**
- * linear_search_for_byte:
- * search for target byte in input data array (length = data_len)
- * return the index of the first occurrence of target byte
- * return -1 if target byte is not found
+ * co_sleep:
+ * suspend the coroutine for ms milliseconds (outside one, sleep the thread)
+ * return 0, -1 if cancelled
  */
-int linear_search_for_byte(uint8_t *data, int data_len, uint8_t target){
-    // check input parameters
-    if(data == NULL || data_len <= 0){
+int co_sleep(uint64_t ms){
+    co_t *co = co_self();
+    if(co == NULL){
+        usleep(ms * 1000);
+        return 0;
+    }
+    if(co->cancelled){
+        errno = ECANCELED;
+        return -1;
+    }
+    co->deadline_ns = co_now_ns() + ms * 1000000ull;
+    if(co_timer_add(co->sched, co) < 0){
         return -1;
     }
+    return co_suspend(co, CO_WAIT_TIMER);
+}
 
-    // simple linear search
-    for(int i = 0; i < data_len; i++){
-        if(data[i] == target){   // target found
-            return i;           // return the index of the target byte found
-        }
+/**
+ * co_close:
+ * close an fd, failing any coroutine still waiting on it with EBADF
+ * return close()'s result
+ */
+int co_close(int fd){
+    co_sched_t *s = co_running;
+    if(s && fd >= 0 && fd < s->num_fds){
+        co_fd_t *f = &s->fds[fd];
+        if(f->reader) co_unwait(f->reader, EBADF);
+        if(f->writer) co_unwait(f->writer, EBADF);
+        f->watched = 0;
     }
-    return -1;                  // target not found
+    return close(fd);
 }
+#endif // __linux__
 
 /**
  * print_data:
@@ -120,9 +3102,12 @@ int linear_search_for_byte(uint8_t *data, int data_len, uint8_t target){
  * print 10 bytes per line
  */
 void print_data(uint8_t *data, int data_len){
-    for(int i = 0; i < data_len; i++){
-        printf("%d ", data[i]);
-        if((i+1) % 10 == 0) printf("\n");
+    char line[10 * 4 + 1];
+    for(int i = 0; i < data_len; i += 10){
+        int n = data_len - i < 10 ? data_len - i : 10;
+        size_t len = format_decimal(line, data + i, n);
+        if(n == 10) line[len++] = '\n';
+        fwrite(line, 1, len, stdout);
     }
     printf("\n");
 }
@@ -130,19 +3115,164 @@ void print_data(uint8_t *data, int data_len){
 /**
  * generate_test_data:
  * generate test data array (length = size)
- * fill the array with random byte values
+ * fill the array with uniformly random byte values, reproducibly: the
+ * sequence depends only on the seed set with generate_test_data_seed
+ * (FRAME_GEN_DEFAULT_SEED if it was never called)
  * return 0 if success, otherwise any non-zero value
  */
+static __thread frame_rng_t test_data_rng;
+static __thread int test_data_seeded = 0;
+
+void generate_test_data_seed(uint64_t seed){
+    frame_rng_seed(&test_data_rng, seed);
+    test_data_seeded = 1;
+}
+
 int generate_test_data(uint8_t *buffer, int size){
-    for(int i = 0; i < size; i++){
-        buffer[i] = rand() % 256;
+    if(buffer == NULL || size < 0){
+        return -1;
+    }
+    if(!test_data_seeded){
+        generate_test_data_seed(FRAME_GEN_DEFAULT_SEED);
     }
+    frame_rng_bytes(&test_data_rng, buffer, size);
     return 0;
 }
 
+#ifndef ALGO_NO_MAIN
+long elapsed_ns(const struct timespec *start, const struct timespec *end){
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+// Test 4 reference: qsort order for 32-bit symbols
+static int test_cmp_u32(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Test 15 line callback: count lines and sum their numeric fields
+static void test_line_fields(void *ctx, const char *line, size_t len){
+    uint64_t *st = ctx, fields[4];
+    int n = parse_line_fields(line, len, fields, 4);
+    st[0]++;
+    for(int i = 0; i < n && i < 4; i++){
+        st[1] += fields[i];
+    }
+}
+
+// Test 16 consumer: sum a slice of a shared frame, then drop the reference
+static void *test_slice_consumer(void *arg){
+    frame_slice_t *s = arg;
+    const uint8_t *p = frame_slice_data(s);
+    uint64_t sum = 0;
+    for(uint32_t i = 0; i < s->len; i++){
+        sum += p[i];
+    }
+    frame_slice_release(s);
+    return (void *)(uintptr_t)sum;
+}
+
+// Test 17 counter thread: bump one counter as another thread would
+static void *test_counter_thread(void *arg){
+    uint64_t *counter = arg;
+    for(int i = 0; i < 10000000; i++){
+        __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+#ifdef __linux__
+// Test 19 connection pair over a socketpair: a client sends frames and an
+// echo handler returns each one, both plain blocking loops over co_* calls
+typedef struct{
+    int fd;
+    int frames;
+    int echoed;         // client: replies matching what was sent
+} test_co_conn_t;
+
+static void test_co_echo(void *arg){
+    test_co_conn_t *c = arg;
+    uint8_t buf[256];
+    ssize_t n;
+    while((n = co_read_frame(c->fd, buf, sizeof(buf))) > 0){
+        if(co_write(c->fd, buf, n) < 0){
+            break;
+        }
+    }
+    co_close(c->fd);
+}
+
+static void test_co_client(void *arg){
+    test_co_conn_t *c = arg;
+    uint8_t out[FRAME_HDR_LEN + 64 + FRAME_CRC_LEN], in[sizeof(out)];
+    for(int i = 0; i < c->frames; i++){
+        frame_hdr_t hdr = { .len = 64, .flags = FRAME_FLAG_CRC, .ts_ns = i };
+        frame_encode_hdr(out, &hdr);
+        memset(out + FRAME_HDR_LEN, c->fd + i, 64);
+        uint32_t crc = htonl(crc32c(0, out, FRAME_HDR_LEN + 64));
+        memcpy(out + FRAME_HDR_LEN + 64, &crc, FRAME_CRC_LEN);
+        if(co_write(c->fd, out, sizeof(out)) < 0 || co_read_frame(c->fd, in, sizeof(in)) != sizeof(out)){
+            break;
+        }
+        c->echoed += memcmp(in, out, sizeof(out)) == 0;
+        if(i % 10 == 9){
+            co_sleep(1);
+        }
+    }
+    co_close(c->fd);
+}
+
+// Test 19 thread baseline: run a coroutine body on its own thread
+typedef struct{
+    co_fn fn;
+    void *arg;
+} test_co_thread_t;
+
+static void *test_co_thread(void *arg){
+    test_co_thread_t *t = arg;
+    t->fn(t->arg);
+    return NULL;
+}
+
+// Test 19 cancellation: record how a blocked call ended
+static void test_co_sleeper(void *arg){
+    int *err = arg;
+    *err = co_sleep(10000) < 0 ? errno : 0;
+}
+
+static void test_co_reader(void *arg){
+    int *fd_err = arg;
+    char c;
+    fd_err[1] = co_read(fd_err[0], &c, 1) < 0 ? errno : 0;
+}
+
+// Test 19 cancellation: a long sleep and a read with no data, both ended early
+static void test_co_cancel(void *arg){
+    int *errs = arg;
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+        return;
+    }
+    int fd_err[2] = { sv[0], -1 };
+    co_t *sleeper = co_spawn(NULL, test_co_sleeper, &errs[0], 1);
+    co_t *reader = co_spawn(NULL, test_co_reader, fd_err, 1);
+    co_sleep(5);
+    co_cancel(sleeper);
+    co_close(sv[0]);
+    co_join(sleeper);
+    co_join(reader);
+    errs[1] = fd_err[1];
+    close(sv[1]);
+}
+#endif
+
 int main(){
-    // initialize random seed
-    srand(time(NULL));
+    // seed from ALGO_SEED to reproduce a run, the run prints the one it used
+    const char *seed_env = getenv("ALGO_SEED");
+    uint64_t seed = seed_env ? strtoull(seed_env, NULL, 0) : (uint64_t)time(NULL);
+    printf("Seed: %llu (set ALGO_SEED to reproduce)\n", (unsigned long long)seed);
+    srand((unsigned)seed);
+    generate_test_data_seed(seed);
 
     // Test 1: process 100-byte frame
     printf("\n=== Test 1: Process 100-byte frame ===\n\n");
@@ -224,5 +3354,1067 @@ int main(){
     printf("Binary search result: %d\n", binary_result);
     // Print the time consumed by the sorting and binary search operation
     printf("Time consumed (nanoseconds) for binary search: %ld\n", time_taken_ns);
+    // Test 3: specialized fixed-length kernels against the generic ones
+    printf("\n=== Test 3: Fixed-length specialized kernels ===\n\n");
+    const int lengths[] = {FRAME_LEN_100, FRAME_LEN_500};
+    for(int l = 0; l < 2; l++){
+        int len = lengths[l];
+        uint8_t frame[FRAME_LEN_500], expect[256], got[256];
+        int expect_len, got_len;
+        long generic_ns = 0, fixed_ns = 0;
+        for(int iter = 0; iter < 10000; iter++){
+            generate_test_data(frame, len);
+            uint8_t target = rand() % 256;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            process_byte_frame(frame, len, expect, &expect_len);
+            int expect_pos = linear_search_for_byte(frame, len, target);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            generic_ns += elapsed_ns(&start, &end);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            process_byte_frame_dispatch(frame, len, got, &got_len);
+            int got_pos = linear_search_for_byte_dispatch(frame, len, target);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            fixed_ns += elapsed_ns(&start, &end);
+            if(got_len != expect_len || memcmp(got, expect, expect_len) != 0 || got_pos != expect_pos){
+                printf("Error: specialized kernels disagree for %d-byte frame\n", len);
+                return -1;
+            }
+        }
+        printf("%d-byte frames: generic %ld ns, specialized %ld ns (10000 frames, process + search)\n",
+                len, generic_ns, fixed_ns);
+    }
+    // Test 4: distinct + sort for 16-bit and 32-bit symbol frames
+    printf("\n=== Test 4: 16-bit and 32-bit symbol frames ===\n\n");
+    const int wide_lengths[] = {100, 1000, 100000};
+    const uint32_t cardinalities[] = {16, 1024, 0}; // 0: full symbol range
+    uint32_t *u32_in = malloc(100000 * sizeof(uint32_t));
+    uint32_t *u32_out = malloc(100000 * sizeof(uint32_t));
+    uint32_t *u32_scratch = malloc(100000 * sizeof(uint32_t));
+    uint16_t *u16_in = malloc(100000 * sizeof(uint16_t));
+    uint16_t *u16_out = malloc(65536 * sizeof(uint16_t));
+    uint32_t *u32_ref = malloc(100000 * sizeof(uint32_t));
+    uint8_t *u16_seen = malloc(65536);
+    for(int l = 0; l < 3; l++){
+        for(int c = 0; c < 3; c++){
+            int len = wide_lengths[l];
+            for(int i = 0; i < len; i++){
+                uint32_t v = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+                u32_in[i] = cardinalities[c] ? (v % cardinalities[c]) * 2654435761u : v;
+                u16_in[i] = (uint16_t)(cardinalities[c] ? (v % cardinalities[c]) * 40503u : v);
+            }
+            int n16, n32;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            process_u16_frame(u16_in, len, u16_out, &n16);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long ns16 = elapsed_ns(&start, &end);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            process_u32_frame(u32_in, len, u32_out, &n32, u32_scratch);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long ns32 = elapsed_ns(&start, &end);
+
+            // compare with scalar references: a presence map for 16-bit
+            // symbols, sort and dedup for 32-bit ones
+            memset(u16_seen, 0, 65536);
+            for(int i = 0; i < len; i++){
+                u16_seen[u16_in[i]] = 1;
+            }
+            int ref16 = 0;
+            for(int v = 0; v < 65536; v++){
+                if(u16_seen[v] && (ref16 >= n16 || u16_out[ref16++] != v)){
+                    printf("Error: 16-bit result differs from the reference at symbol %d\n", v);
+                    return -1;
+                }
+            }
+            if(ref16 != n16){
+                printf("Error: 16-bit result has %d symbols, reference %d\n", n16, ref16);
+                return -1;
+            }
+            memcpy(u32_ref, u32_in, len * sizeof(uint32_t));
+            qsort(u32_ref, len, sizeof(uint32_t), test_cmp_u32);
+            int ref32 = 0;
+            for(int i = 0; i < len; i++){
+                if(ref32 == 0 || u32_ref[ref32 - 1] != u32_ref[i]){
+                    u32_ref[ref32++] = u32_ref[i];
+                }
+            }
+            if(ref32 != n32 || memcmp(u32_ref, u32_out, n32 * sizeof(uint32_t)) != 0){
+                printf("Error: 32-bit result differs from the reference (%d symbols, reference %d)\n", n32, ref32);
+                return -1;
+            }
+            printf("len %6d, cardinality %5s: u16 %6d distinct in %8ld ns, u32 %6d distinct in %8ld ns\n",
+                    len, c == 2 ? "full" : (c == 0 ? "16" : "1024"), n16, ns16, n32, ns32);
+        }
+    }
+    free(u32_in);
+    free(u32_out);
+    free(u32_scratch);
+    free(u16_in);
+    free(u16_out);
+    free(u32_ref);
+    free(u16_seen);
+    // Test 5: compile-time generated searcher for a fixed marker set
+    printf("\n=== Test 5: Byte-set searcher for markers {%d, 10, 0, 255} ===\n\n", SEARCH_BYTE);
+    const uint8_t markers[] = {SEARCH_BYTE, '\n', 0x00, 0xFF};
+    uint8_t frame_m[FRAME_LEN_500];
+    long loop_ns = 0, searcher_ns = 0;
+    for(int iter = 0; iter < 10000; iter++){
+        int len = 1 + rand() % FRAME_LEN_500;
+        generate_test_data(frame_m, len);
+        for(int i = 0; i < len; i++){
+            // keep markers rare so searches run deep into the frame
+            while(memchr(markers, frame_m[i], sizeof(markers)) != NULL){
+                frame_m[i] = rand() % 256;
+            }
+        }
+        if(rand() % 4 != 0){
+            frame_m[rand() % len] = markers[rand() % 4];
+        }
+        // reference: generic loop over the targets
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int expect = -1;
+        for(int t = 0; t < 4; t++){
+            int pos = linear_search_for_byte(frame_m, len, markers[t]);
+            if(pos >= 0 && (expect < 0 || pos < expect)){
+                expect = pos;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        loop_ns += elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int got = find_frame_markers(frame_m, len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        searcher_ns += elapsed_ns(&start, &end);
+        if(got != expect){
+            printf("Error: byte-set searcher returned %d, expected %d (len %d)\n", got, expect, len);
+            return -1;
+        }
+    }
+    printf("10000 frames: loop over targets %ld ns, generated searcher %ld ns\n", loop_ns, searcher_ns);
+    // Test 6: autotuned kernel selection
+    printf("\n=== Test 6: Kernel autotuning ===\n\n");
+    autotune_kernels(NULL);
+    char report[1024];
+    autotune_report(report, sizeof(report));
+    printf("%s\n", report);
+    for(int iter = 0; iter < 1000; iter++){
+        int len = 1 + rand() % FRAME_LEN_500;
+        uint8_t frame_t[FRAME_LEN_500], expect[256], got[256];
+        int expect_len, got_len;
+        generate_test_data(frame_t, len);
+        uint8_t target = rand() % 256;
+        process_byte_frame(frame_t, len, expect, &expect_len);
+        process_byte_frame_tuned(frame_t, len, got, &got_len);
+        if(got_len != expect_len || memcmp(got, expect, expect_len) != 0 ||
+           linear_search_for_byte_tuned(frame_t, len, target) != linear_search_for_byte(frame_t, len, target)){
+            printf("Error: tuned kernels disagree with the generic ones (len %d)\n", len);
+            return -1;
+        }
+    }
+    // Test 7: sorting network for small frames
+    printf("\n=== Test 7: Small-frame sorting network ===\n\n");
+    for(int len = 0; len <= SMALL_FRAME_MAX; len++){
+        for(int iter = 0; iter < 200; iter++){
+            uint8_t frame_s[SMALL_FRAME_MAX], expect[256], got[256];
+            int expect_len, got_len;
+            int alphabet = 1 + rand() % 256;   // vary the number of duplicates
+            for(int i = 0; i < len; i++){
+                frame_s[i] = (uint8_t)(rand() % alphabet + (iter & 1 ? 256 - alphabet : 0));
+            }
+            process_byte_frame(frame_s, len, expect, &expect_len);
+            process_byte_frame_small(frame_s, len, got, &got_len);
+            if(got_len != expect_len || memcmp(got, expect, expect_len) != 0){
+                printf("Error: sorting network result differs for %d-byte frame\n", len);
+                return -1;
+            }
+        }
+    }
+    const int small_lengths[] = {8, 16, 32, 48, 64};
+    for(int l = 0; l < 5; l++){
+        uint8_t frame_s[SMALL_FRAME_MAX], out[256];
+        int out_len;
+        long histogram_ns, network_ns;
+        generate_test_data(frame_s, small_lengths[l]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            frame_s[iter % small_lengths[l]] ^= (uint8_t)iter;
+            process_byte_frame(frame_s, small_lengths[l], out, &out_len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        histogram_ns = elapsed_ns(&start, &end) / 100000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            frame_s[iter % small_lengths[l]] ^= (uint8_t)iter;
+            process_byte_frame_small(frame_s, small_lengths[l], out, &out_len);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        network_ns = elapsed_ns(&start, &end) / 100000;
+        printf("%2d-byte frames: histogram %ld ns, sorting network %ld ns per frame\n",
+                small_lengths[l], histogram_ns, network_ns);
+    }
+    // Test 8: queries on sorted frames
+    printf("\n=== Test 8: Sorted-frame queries ===\n\n");
+    {
+        uint8_t sorted[FRAME_LEN_500];
+        uint32_t hist[256] = {0};
+        generate_test_data(sorted, FRAME_LEN_500);
+        for(int i = 0; i < FRAME_LEN_500; i++){
+            hist[sorted[i]]++;
+        }
+        for(int v = 0, pos = 0; v < 256; v++){
+            memset(sorted + pos, v, hist[v]);
+            pos += hist[v];
+        }
+        sorted_index_t index;
+        sorted_index_build(sorted, FRAME_LEN_500, &index);
+        for(int v = 0; v < 256; v++){
+            int lin_first = linear_search_for_byte(sorted, FRAME_LEN_500, (uint8_t)v);
+            int lin_count = 0, lin_below = 0;
+            for(int i = 0; i < FRAME_LEN_500; i++){
+                lin_count += sorted[i] == v;
+                lin_below += sorted[i] < v;
+            }
+            int first, last;
+            sorted_equal_range(sorted, FRAME_LEN_500, (uint8_t)v, &first, &last);
+            if(binary_search_for_byte(sorted, FRAME_LEN_500, (uint8_t)v) != lin_first ||
+               first != lin_below || last - first != lin_count ||
+               sorted_count(sorted, FRAME_LEN_500, (uint8_t)v) != lin_count ||
+               sorted_rank(sorted, FRAME_LEN_500, (uint8_t)v) != lin_below ||
+               (int)sorted_index_lower(&index, v) != lin_below ||
+               (int)sorted_index_count(&index, v) != lin_count){
+                printf("Error: sorted-frame query mismatch for value %d\n", v);
+                return -1;
+            }
+        }
+
+        // time one query per value, repeated
+        volatile int sink = 0;
+        long linear_ns, branchless_ns, rank_ns, table_ns;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            sink += linear_search_for_byte(sorted, FRAME_LEN_500, (uint8_t)iter);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        linear_ns = elapsed_ns(&start, &end) / 100000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            sink += sorted_lower_bound(sorted, FRAME_LEN_500, (uint8_t)iter);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        branchless_ns = elapsed_ns(&start, &end) / 100000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            sink += sorted_rank(sorted, FRAME_LEN_500, (uint8_t)iter);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        rank_ns = elapsed_ns(&start, &end) / 100000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            sink += sorted_index_lower(&index, (uint8_t)iter);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        table_ns = elapsed_ns(&start, &end) / 100000;
+        (void)sink;
+        printf("Per query on a sorted %d-byte frame: linear %ld ns, branchless lower_bound %ld ns, "
+               "SIMD rank %ld ns, prefix table %ld ns\n",
+               FRAME_LEN_500, linear_ns, branchless_ns, rank_ns, table_ns);
+    }
+    // Test 9: streaming kernels fed in random chunks
+    printf("\n=== Test 9: Streaming kernels ===\n\n");
+    {
+        const int big_len = 4 * 1024 * 1024;
+        uint8_t *big = malloc(big_len);
+        const uint8_t pattern[] = "MTFR-END-OF-FEED";
+        const int plen = sizeof(pattern) - 1;
+        if(big == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        for(int round = 0; round < 20; round++){
+            int alphabet = round < 10 ? 200 : 256;  // some frames lack byte values
+            for(int i = 0; i < big_len; i++){
+                big[i] = (uint8_t)(rand() % alphabet);
+            }
+            int at = rand() % (big_len - plen);
+            memcpy(big + at, pattern, plen);
+            uint8_t present[256] = {0}, expect[256], got[256];
+            int expect_len = 0, got_len;
+            for(int i = 0; i < big_len; i++){
+                present[big[i]] = 1;
+            }
+            for(int v = 0; v < 256; v++){
+                if(present[v]) expect[expect_len++] = (uint8_t)v;
+            }
+            int64_t expect_at = -1;
+            for(int i = 0; i + plen <= big_len && expect_at < 0; i++){
+                if(big[i] == pattern[0] && memcmp(big + i, pattern, plen) == 0) expect_at = i;
+            }
+
+            distinct_stream_t ds;
+            search_stream_t ss;
+            int64_t found = -1;
+            distinct_stream_init(&ds);
+            search_stream_init(&ss, pattern, plen);
+            for(int off = 0; off < big_len; ){
+                // mostly tiny chunks around the match, recv-sized ones elsewhere
+                int chunk = (off > at - 64 && off < at + 64) ? 1 + rand() % 7 : 1 + rand() % 65536;
+                if(chunk > big_len - off) chunk = big_len - off;
+                distinct_stream_update(&ds, big + off, chunk);
+                found = search_stream_update(&ss, big + off, chunk);
+                off += chunk;
+            }
+            distinct_stream_final(&ds, got, &got_len);
+            if(got_len != expect_len || memcmp(got, expect, expect_len) != 0 ||
+               ds.bytes != (uint64_t)big_len || found != expect_at){
+                printf("Error: streaming result differs (round %d, match at %lld, expected %lld)\n",
+                        round, (long long)found, (long long)expect_at);
+                free(big);
+                return -1;
+            }
+        }
+
+        // distinct_stream_update stops once all 256 values were seen, so
+        // time a frame that never saturates and, labelled, one that does
+        printf("Streaming results match whole-frame results over 20 random 4 MB frames\n");
+        for(int alphabet = 200; alphabet <= 256; alphabet += 56){
+            for(int i = 0; i < big_len; i++){
+                big[i] = (uint8_t)(rand() % alphabet);
+            }
+            long whole_ns, stream_ns;
+            uint8_t out[256];
+            int out_len;
+            distinct_stream_t ds;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            process_byte_frame(big, big_len, out, &out_len);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            whole_ns = elapsed_ns(&start, &end);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            distinct_stream_init(&ds);
+            for(int off = 0; off < big_len; off += 64 * 1024){
+                distinct_stream_update(&ds, big + off, 64 * 1024);
+            }
+            distinct_stream_final(&ds, out, &out_len);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            stream_ns = elapsed_ns(&start, &end);
+            printf("4 MB frame, %d values%s: buffered process_byte_frame %ld us, 64 KB chunks streamed %ld us\n",
+                    alphabet, alphabet == 256 ? " (saturates: streaming stops after the first 4 KB)" : "",
+                    whole_ns / 1000, stream_ns / 1000);
+        }
+        free(big);
+    }
+    // Test 10: parallel kernels on a large buffer
+    printf("\n=== Test 10: Parallel kernels ===\n\n");
+    {
+        const size_t huge_len = 64ul * 1024 * 1024;
+        uint8_t *huge = malloc(huge_len);
+        par_pool_t *pools[2] = { par_pool_create(0), par_pool_create(4) };
+        if(huge == NULL || pools[0] == NULL || pools[1] == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        for(size_t i = 0; i < huge_len; i++){
+            huge[i] = (uint8_t)(rand() % 250);  // values 250..255 absent
+        }
+        uint8_t expect[256], got[256];
+        int expect_len = 0, got_len;
+        uint64_t expect_counts[256] = {0}, got_counts[256];
+        for(size_t i = 0; i < huge_len; i++){
+            expect_counts[huge[i]]++;
+        }
+        for(int v = 0; v < 256; v++){
+            if(expect_counts[v]) expect[expect_len++] = (uint8_t)v;
+        }
+        for(int p = 0; p < 2; p++){
+            process_byte_frame_parallel(pools[p], huge, huge_len, got, &got_len);
+            byte_histogram_parallel(pools[p], huge, huge_len, got_counts);
+            if(got_len != expect_len || memcmp(got, expect, expect_len) != 0 ||
+               memcmp(got_counts, expect_counts, sizeof(expect_counts)) != 0){
+                printf("Error: parallel distinct/histogram result differs\n");
+                return -1;
+            }
+            const size_t positions[] = {0, PAR_CHUNK_LEN - 1, PAR_CHUNK_LEN, huge_len / 2 + 7, huge_len - 1};
+            for(int k = 0; k < 5; k++){
+                uint8_t saved = huge[positions[k]];
+                huge[positions[k]] = 252;
+                int64_t found = linear_search_for_byte_parallel(pools[p], huge, huge_len, 252);
+                huge[positions[k]] = saved;
+                if(found != (int64_t)positions[k]){
+                    printf("Error: parallel search found %lld, expected %zu\n", (long long)found, positions[k]);
+                    return -1;
+                }
+            }
+            if(linear_search_for_byte_parallel(pools[p], huge, huge_len, 253) != -1){
+                printf("Error: parallel search found an absent byte\n");
+                return -1;
+            }
+        }
+
+        long serial_ns, parallel_ns, serial_search_ns, parallel_search_ns;
+        distinct_stream_t ds;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        distinct_stream_init(&ds);
+        distinct_stream_update(&ds, huge, (int)huge_len);   // 250 values: never saturates
+        distinct_stream_final(&ds, got, &got_len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        serial_ns = elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        process_byte_frame_parallel(pools[0], huge, huge_len, got, &got_len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        parallel_ns = elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int64_t serial_found = -1;
+        for(size_t off = 0; off < huge_len && serial_found < 0; off += 1 << 30){
+            serial_found = linear_search_for_byte_tuned(huge + off, (int)(huge_len - off), 253);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        serial_search_ns = elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        linear_search_for_byte_parallel(pools[0], huge, huge_len, 253);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        parallel_search_ns = elapsed_ns(&start, &end);
+        printf("64 MB buffer, 1 + %ld helper threads: distinct %ld us serial, %ld us parallel; "
+               "search %ld us serial, %ld us parallel\n",
+               sysconf(_SC_NPROCESSORS_ONLN) - 1, serial_ns / 1000, parallel_ns / 1000,
+               serial_search_ns / 1000, parallel_search_ns / 1000);
+        par_pool_destroy(pools[0]);
+        par_pool_destroy(pools[1]);
+        free(huge);
+    }
+    // Test 11: fused operator pipeline
+    printf("\n=== Test 11: Fused frame pipeline ===\n\n");
+    {
+        frame_pipeline_t pipe;
+        frame_pipeline_result_t res;
+        if(frame_pipeline_init(&pipe, "validate,bogus") == 0 ||
+           frame_pipeline_init(&pipe, "validate,histogram,distinct,markers,stats") != 0 ||
+           pipe.ops != FRAME_OP_ALL){
+            printf("Error: pipeline spec parsing\n");
+            return -1;
+        }
+        pipe.min_valid = 0x20;
+        pipe.max_valid = 0xF0;
+        pipe.markers[1] = '\n';
+        pipe.num_markers = 2;
+        uint8_t frame_p[FRAME_LEN_500 + 7];
+        for(int iter = 0; iter < 2000; iter++){
+            int len = rand() % (FRAME_LEN_500 + 8);
+            generate_test_data(frame_p, len);
+            for(int i = 0; i < len; i++){
+                if(iter & 1 && frame_p[i] < 0x20) frame_p[i] += 0x20;   // some frames valid
+                if(frame_p[i] > 0xF0 && rand() % 4) frame_p[i] -= 0x10;
+            }
+            pipe.ops = rand() & FRAME_OP_ALL;
+            memset(&res, 0xAA, sizeof(res));
+            frame_pipeline_run(&pipe, frame_p, len, &res);
+
+            // the same results computed one operator at a time
+            uint32_t hist[256] = {0};
+            uint8_t expect[256];
+            int expect_len;
+            int first_invalid = -1, first_marker = -1, marker_count = 0;
+            uint64_t sum = 0;
+            uint8_t lo = 0xFF, hi = 0;
+            process_byte_frame(frame_p, len, expect, &expect_len);
+            for(int i = 0; i < len; i++){
+                hist[frame_p[i]]++;
+                sum += frame_p[i];
+                lo = frame_p[i] < lo ? frame_p[i] : lo;
+                hi = frame_p[i] > hi ? frame_p[i] : hi;
+                if(first_invalid < 0 && (frame_p[i] < 0x20 || frame_p[i] > 0xF0)) first_invalid = i;
+                if(frame_p[i] == SEARCH_BYTE || frame_p[i] == '\n'){
+                    if(first_marker < 0) first_marker = i;
+                    marker_count++;
+                }
+            }
+            if(len == 0) lo = hi = 0;
+            int ok = 1;
+            if(pipe.ops & FRAME_OP_VALIDATE){
+                ok &= res.first_invalid == first_invalid && res.valid == (first_invalid < 0);
+            }
+            if(pipe.ops & FRAME_OP_HISTOGRAM){
+                ok &= memcmp(res.histogram, hist, sizeof(hist)) == 0;
+            }
+            if(pipe.ops & FRAME_OP_DISTINCT){
+                ok &= res.distinct_len == expect_len && memcmp(res.distinct, expect, expect_len) == 0;
+            }
+            if(pipe.ops & FRAME_OP_MARKERS){
+                ok &= res.first_marker == first_marker && res.marker_count == marker_count;
+            }
+            if(pipe.ops & FRAME_OP_STATS){
+                ok &= res.sum == sum && res.min == lo && res.max == hi;
+            }
+            if(!ok){
+                printf("Error: pipeline result differs (ops 0x%x, %d-byte frame)\n", pipe.ops, len);
+                return -1;
+            }
+        }
+
+        // full chain: one pass against one call per operator
+        long separate_ns, fused_ns;
+        volatile uint64_t sink = 0;
+        pipe.ops = FRAME_OP_ALL;
+        generate_test_data(frame_p, FRAME_LEN_500);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            uint8_t out[256];
+            int out_len, bad = -1;
+            uint32_t hist[256] = {0};
+            uint64_t sum = 0;
+            frame_p[iter % FRAME_LEN_500] ^= 1;
+            for(int i = 0; i < FRAME_LEN_500 && bad < 0; i++){
+                if(frame_p[i] < 0x20 || frame_p[i] > 0xF0) bad = i;
+            }
+            for(int i = 0; i < FRAME_LEN_500; i++) hist[frame_p[i]]++;
+            process_byte_frame(frame_p, FRAME_LEN_500, out, &out_len);
+            int m1 = linear_search_for_byte(frame_p, FRAME_LEN_500, SEARCH_BYTE);
+            int m2 = linear_search_for_byte(frame_p, FRAME_LEN_500, '\n');
+            for(int i = 0; i < FRAME_LEN_500; i++) sum += frame_p[i];
+            sink += bad + hist[7] + out_len + m1 + m2 + sum;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        separate_ns = elapsed_ns(&start, &end) / 100000;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100000; iter++){
+            frame_p[iter % FRAME_LEN_500] ^= 1;
+            frame_pipeline_run(&pipe, frame_p, FRAME_LEN_500, &res);
+            sink += res.first_invalid + res.histogram[7] + res.distinct_len + res.first_marker + res.sum;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        fused_ns = elapsed_ns(&start, &end) / 100000;
+        (void)sink;
+        printf("validate,histogram,distinct,markers,stats on %d-byte frames: "
+               "separate passes %ld ns, fused %ld ns per frame\n", FRAME_LEN_500, separate_ns, fused_ns);
+    }
+    // Test 12: CRC32C
+    printf("\n=== Test 12: CRC32C ===\n\n");
+    {
+        if(crc32c(0, "123456789", 9) != 0xE3069283u){
+            printf("Error: CRC32C check value\n");
+            return -1;
+        }
+        const size_t crc_len = 1024 * 1024;
+        uint8_t *src = malloc(crc_len), *dst = malloc(crc_len);
+        if(src == NULL || dst == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        generate_test_data(src, (int)crc_len);
+        // bitwise reference over every length up to a few interleaved blocks
+        for(size_t len = 0; len <= 3 * 3 * 256 + 17; len += (len < 64 ? 1 : 37)){
+            uint32_t ref = 0xFFFFFFFFu;
+            for(size_t i = 0; i < len; i++){
+                ref ^= src[i];
+                for(int k = 0; k < 8; k++) ref = ref & 1 ? (ref >> 1) ^ 0x82F63B78u : ref >> 1;
+            }
+            ref = ~ref;
+            memset(dst, 0, len + 1);
+            size_t split = len / 3;
+            uint32_t got = crc32c_copy(crc32c_copy(0, dst, src, split), dst + split, src + split, len - split);
+            if(got != ref || crc32c(0, src, len) != ref || memcmp(dst, src, len) != 0 || dst[len] != 0){
+                printf("Error: CRC32C mismatch for %zu bytes\n", len);
+                return -1;
+            }
+        }
+        long copy_ns, crc_ns, fused_ns;
+        volatile uint32_t sink = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100; iter++){ memcpy(dst, src, crc_len); sink += dst[iter]; }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        copy_ns = elapsed_ns(&start, &end) / 100;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100; iter++){ sink += crc32c(0, src, crc_len); }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        crc_ns = elapsed_ns(&start, &end) / 100;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int iter = 0; iter < 100; iter++){ sink += crc32c_copy(0, dst, src, crc_len); }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        fused_ns = elapsed_ns(&start, &end) / 100;
+        (void)sink;
+        printf("1 MB: memcpy %ld us, crc32c %ld us, crc32c_copy %ld us\n",
+                copy_ns / 1000, crc_ns / 1000, fused_ns / 1000);
+        free(src);
+        free(dst);
+    }
+    // Test 13: synthetic frame generator
+    printf("\n=== Test 13: Synthetic frame generator ===\n\n");
+    {
+        const int gen_len = 1 << 20;
+        uint8_t *a = malloc(gen_len), *b = malloc(gen_len);
+        frame_gen_t g1, g2;
+        if(a == NULL || b == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        // reproducible: same seed, same frames
+        frame_gen_init(&g1, "uniform", 42);
+        frame_gen_init(&g2, "uniform", 42);
+        frame_gen_fill(&g1, a, gen_len);
+        frame_gen_fill(&g2, b, gen_len);
+        int same = memcmp(a, b, gen_len) == 0;
+        frame_gen_init(&g2, "uniform", 43);
+        frame_gen_fill(&g2, b, gen_len);
+        if(!same || memcmp(a, b, gen_len) == 0 || frame_gen_init(&g1, "zipf:0", 1) == 0 ||
+           frame_gen_init(&g1, "alphabet:300", 1) == 0){
+            printf("Error: generator seeding or spec parsing\n");
+            return -1;
+        }
+
+        const char *specs[] = {"uniform", "alphabet:8", "zipf:1.2", "zipf:0.8:32", "runs:16:4"};
+        for(int d = 0; d < 5; d++){
+            uint64_t hist[256] = {0};
+            frame_gen_init(&g1, specs[d], seed + d);
+            g1.target = SEARCH_BYTE;
+            g1.target_once = d != 0;    // keep the uniform histogram flat
+            g1.target_pos = d == 0 ? -1 : gen_len / 3;
+            int pos = frame_gen_fill(&g1, a, gen_len);
+            int runs = 1, distinct = 0;
+            uint64_t top = 0;
+            for(int i = 0; i < gen_len; i++){
+                hist[a[i]]++;
+                runs += i > 0 && a[i] != a[i - 1];
+            }
+            for(int v = 0; v < 256; v++){
+                distinct += hist[v] > 0;
+                top = hist[v] > top ? hist[v] : top;
+            }
+            int ok = pos >= 0 && a[pos] == SEARCH_BYTE &&
+                     (d == 0 || (pos == gen_len / 3 && hist[SEARCH_BYTE] == 1 &&
+                                 linear_search_for_byte(a, gen_len, SEARCH_BYTE) == pos));
+            // alphabet and run sizes include the forced target
+            if(d == 0) ok &= distinct == 256 && top < gen_len / 256 * 1.2;
+            if(d == 1) ok &= distinct <= 9;
+            if(d == 2) ok &= top > gen_len / 8;     // rank 1 takes ~22% at s = 1.2
+            if(d == 3) ok &= distinct <= 33;
+            if(d == 4) ok &= distinct <= 5 && gen_len / runs > 8;
+            printf("%-12s %3d distinct, most common %5.1f%%, mean run %.1f\n", specs[d], distinct,
+                    100.0 * top / gen_len, (double)gen_len / runs);
+            if(!ok){
+                printf("Error: generator distribution %s\n", specs[d]);
+                return -1;
+            }
+        }
+
+        long rand_ns, gen_ns;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int i = 0; i < gen_len; i++){
+            a[i] = rand() % 256;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        rand_ns = elapsed_ns(&start, &end);
+        frame_gen_init(&g1, "uniform", seed);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        frame_gen_fill(&g1, a, gen_len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        gen_ns = elapsed_ns(&start, &end);
+        printf("1 MB uniform: rand() %% 256 %ld us, generator %ld us\n", rand_ns / 1000, gen_ns / 1000);
+        free(a);
+        free(b);
+    }
+    // Test 14: dump formatting
+    printf("\n=== Test 14: Dump formatting ===\n\n");
+    {
+        char got_line[FORMAT_HEX_LINE_MAX], expect_line[128];
+        uint8_t bytes[16];
+        for(int iter = 0; iter < 10000; iter++){
+            int len = iter % 17;
+            uint64_t offset = (uint64_t)rand() * 16;
+            generate_test_data(bytes, 16);
+            size_t got_len = format_hex_line(got_line, offset, bytes, len);
+            int n = snprintf(expect_line, sizeof(expect_line), "%08x  ", (unsigned)offset);
+            for(int i = 0; i < 16; i++){
+                n += i < len ? snprintf(expect_line + n, 4, "%02x ", bytes[i]) : snprintf(expect_line + n, 4, "   ");
+            }
+            n += snprintf(expect_line + n, 3, " |");
+            for(int i = 0; i < len; i++){
+                expect_line[n++] = isprint(bytes[i]) ? (char)bytes[i] : '.';
+            }
+            n += snprintf(expect_line + n, 3, "|\n");
+            char dec[16 * 4], expect_dec[16 * 4 + 1];
+            size_t dec_len = format_decimal(dec, bytes, len);
+            int m = 0;
+            for(int i = 0; i < len; i++){
+                m += snprintf(expect_dec + m, 5, "%d ", bytes[i]);
+            }
+            if(got_len != (size_t)n || memcmp(got_line, expect_line, n) != 0 ||
+               dec_len != (size_t)m || memcmp(dec, expect_dec, m) != 0){
+                printf("Error: dump line differs for %d bytes:\n%.*s%.*s", len, (int)got_len, got_line, n, expect_line);
+                return -1;
+            }
+        }
+
+        const int dump_len = 16 * 1024 * 1024;
+        uint8_t *dump_in = malloc(dump_len);
+        char *dump_out = malloc((size_t)dump_len / 16 * FORMAT_HEX_LINE_MAX);
+        if(dump_in == NULL || dump_out == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        generate_test_data(dump_in, dump_len);
+        long printf_ns, table_ns, dec_ns;
+        size_t out = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int off = 0; off < dump_len / 16; off += 16){     // 1 MB of it is enough
+            out += sprintf(dump_out + out, "%08x  ", off);
+            for(int i = 0; i < 16; i++) out += sprintf(dump_out + out, "%02x ", dump_in[off + i]);
+            out += sprintf(dump_out + out, " |");
+            for(int i = 0; i < 16; i++) dump_out[out++] = isprint(dump_in[off + i]) ? dump_in[off + i] : '.';
+            out += sprintf(dump_out + out, "|\n");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        printf_ns = elapsed_ns(&start, &end) * 16;
+        out = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int off = 0; off < dump_len; off += 16){
+            out += format_hex_line(dump_out + out, off, dump_in + off, 16);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        table_ns = elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        out = format_decimal(dump_out, dump_in, dump_len);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        dec_ns = elapsed_ns(&start, &end);
+        printf("Hex dump: sprintf %.0f MB/s, format_hex_line %.0f MB/s; decimal: format_decimal %.0f MB/s\n",
+                dump_len / 1e6 / (printf_ns / 1e9), dump_len / 1e6 / (table_ns / 1e9),
+                dump_len / 1e6 / (dec_ns / 1e9));
+        free(dump_in);
+        free(dump_out);
+    }
+    // Test 15: line splitting and integer parsing
+    printf("\n=== Test 15: Line-delimited text ===\n\n");
+    {
+        const char *samples[] = {"0", "7", "42", "12345678", "123456789", "18446744073709551615",
+                                 "9999999999999999999", "00000000000000000001", "x", ""};
+        for(int k = 0; k < 10; k++){
+            uint64_t v = 0;
+            size_t slen = strlen(samples[k]);
+            const char *next = parse_u64(samples[k], samples[k] + slen, &v);
+            char *ref_end;
+            unsigned long long ref = strtoull(samples[k], &ref_end, 10);
+            int ref_ok = ref_end != samples[k] && slen <= 19;
+            if((next != NULL) != ref_ok || (next && (v != ref || next != ref_end))){
+                printf("Error: parse_u64(\"%s\") gave %llu\n", samples[k], (unsigned long long)v);
+                return -1;
+            }
+        }
+        for(int iter = 0; iter < 100000; iter++){
+            char num[32];
+            uint64_t x = ((uint64_t)rand() << 31 ^ (uint64_t)rand()) >> (rand() % 62);
+            int nlen = snprintf(num, sizeof(num), "%llu%c", (unsigned long long)x, "x \n9"[iter % 3]);
+            uint64_t v;
+            const char *next = parse_u64(num, num + nlen - (iter % 3 == 2), &v);
+            if(next == NULL || v != x){
+                printf("Error: parse_u64(\"%s\") gave %llu\n", num, (unsigned long long)v);
+                return -1;
+            }
+        }
+
+        // a stream of client messages cut into recv-sized chunks
+        const int num_lines = 1000000;
+        size_t text_cap = (size_t)num_lines * 40, text_len = 0;
+        char *text = malloc(text_cap);
+        if(text == NULL){
+            printf("Error: out of memory\n");
+            return -1;
+        }
+        uint64_t expect_sum = 0;
+        for(int i = 0; i < num_lines; i++){
+            text_len += sprintf(text + text_len, "Client %d message #%d\n", i % 97, i);
+            expect_sum += i % 97 + i;
+        }
+        struct line_stats{ uint64_t lines, sum; } st = {0, 0};
+        line_splitter_t ls;
+        for(int pass = 0; pass < 2; pass++){
+            st.lines = st.sum = 0;
+            line_splitter_init(&ls, 1024);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(size_t off = 0; off < text_len; off += 1023){
+                size_t chunk = text_len - off < 1023 ? text_len - off : 1023;
+                line_splitter_feed(&ls, text + off, chunk, test_line_fields, &st);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            line_splitter_free(&ls);
+        }
+        long split_ns = elapsed_ns(&start, &end);
+        if(st.lines != (uint64_t)num_lines || st.sum != expect_sum){
+            printf("Error: line splitter saw %lu lines, field sum %lu (expected %d, %lu)\n",
+                    st.lines, st.sum, num_lines, expect_sum);
+            return -1;
+        }
+        // the same with memchr and sscanf
+        uint64_t ref_lines = 0, ref_sum = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(char *line = text, *nl; (nl = memchr(line, '\n', text + text_len - line)) != NULL; line = nl + 1){
+            // sscanf takes the strlen of its input, so give it just the line
+            char buf[64];
+            size_t n = nl - line < (long)sizeof(buf) - 1 ? (size_t)(nl - line) : sizeof(buf) - 1;
+            memcpy(buf, line, n);
+            buf[n] = '\0';
+            int a, b;
+            if(sscanf(buf, "Client %d message #%d", &a, &b) == 2){
+                ref_sum += a + b;
+            }
+            ref_lines++;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long ref_ns = elapsed_ns(&start, &end);
+        printf("%d lines in 1023-byte chunks: splitter + parse_u64 %.1f M lines/s, memchr + sscanf %.1f M lines/s\n",
+                num_lines, num_lines / (split_ns / 1e3), ref_lines / (ref_ns / 1e3));
+        if(ref_sum != expect_sum){
+            printf("Error: reference parse\n");
+            return -1;
+        }
+        free(text);
+    }
+    // Test 16: refcounted frame buffers
+    printf("\n=== Test 16: Refcounted frame buffers ===\n\n");
+    {
+        frame_buf_pool_t *pool = frame_buf_pool_create(64 * 1024, 8);
+        frame_buf_t *b = frame_buf_alloc(pool, 1000);
+        frame_buf_t *big = frame_buf_alloc(pool, 100 * 1024);
+        if(pool == NULL || b == NULL || big == NULL || b->cap < 1000 || big->pool != NULL ||
+           ((uintptr_t)b->data & 63) != 0){
+            printf("Error: frame_buf_alloc\n");
+            return -1;
+        }
+        frame_buf_release(big);
+        // four consumers read their own slices of one buffer on their own threads
+        generate_test_data(b->data, 1000);
+        b->len = 1000;
+        uint64_t expect[4] = {0, 0, 0, 0};
+        for(int i = 0; i < 1000; i++){
+            expect[i / 250] += b->data[i];
+        }
+        pthread_t consumers[4];
+        frame_slice_t slices[4];
+        for(int k = 0; k < 4; k++){
+            slices[k] = frame_slice(b, k * 250, 250);
+            pthread_create(&consumers[k], NULL, test_slice_consumer, &slices[k]);
+        }
+        frame_buf_t *kept = b;
+        frame_buf_release(b);   // the producer's reference
+        for(int k = 0; k < 4; k++){
+            void *sum;
+            pthread_join(consumers[k], &sum);
+            if((uint64_t)(uintptr_t)sum != expect[k]){
+                printf("Error: consumer %d read a wrong slice\n", k);
+                return -1;
+            }
+        }
+        // the last release put the buffer back in the pool
+        b = frame_buf_alloc(pool, 64 * 1024);
+        if(b != kept || b->refs != 1 || !frame_buf_exclusive(b)){
+            printf("Error: buffer not returned to the pool\n");
+            return -1;
+        }
+        frame_buf_release(b);
+
+        // a 64KB frame handed to four consumers: a copy each vs a reference each
+        const int rounds = 20000, len = 64 * 1024;
+        uint8_t *src = malloc(len);
+        generate_test_data(src, len);
+        uint64_t check = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int r = 0; r < rounds; r++){
+            for(int k = 0; k < 4; k++){
+                uint8_t *copy = malloc(len);
+                memcpy(copy, src, len);
+                check += copy[r % len];
+                free(copy);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long copy_ns = elapsed_ns(&start, &end);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int r = 0; r < rounds; r++){
+            frame_buf_t *f = frame_buf_alloc(pool, len);
+            memcpy(f->data, src, len);  // the receive path writes the frame once
+            f->len = len;
+            for(int k = 0; k < 4; k++){
+                frame_slice_t s = frame_slice(f, 0, f->len);
+                check -= frame_slice_data(&s)[r % len];
+                frame_slice_release(&s);
+            }
+            frame_buf_release(f);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        long ref_ns = elapsed_ns(&start, &end);
+        if(check != 0){
+            printf("Error: consumers saw different bytes\n");
+            return -1;
+        }
+        printf("64KB frame to 4 consumers: copies %.2f us, refcounted buffer %.2f us\n",
+                copy_ns / 1e3 / rounds, ref_ns / 1e3 / rounds);
+        free(src);
+        frame_buf_pool_destroy(pool);
+    }
+    // Test 17: false sharing between threads' counters. The server's
+    // shared state is laid out so each thread writes its own lines; this
+    // times the difference that makes for counters written by 4 threads.
+    // The per-connection state layout is measured on the real conn_state_t
+    // by mt_server built with -DCONN_STATE_BENCH.
+    printf("\n=== Test 17: Cache-conscious state layout ===\n\n");
+    {
+        int misses_fd = perf_counter_open(PERF_COUNTER_CACHE_MISSES);
+        int l1_fd = perf_counter_open(PERF_COUNTER_L1D_MISSES);
+        if(misses_fd < 0 && l1_fd < 0){
+            printf("Cache miss counters unavailable here (perf_event_open), timing only\n");
+        }
+        // four threads bumping their own counters: adjacent vs a line each.
+        // This thread is one of them, so its counters see the misses.
+        uint64_t *counters = aligned_alloc(64, 4 * 64);
+        for(int padded = 0; padded < 2; padded++){
+            memset(counters, 0, 4 * 64);
+            pthread_t threads[3];
+            int stride = padded ? 8 : 1;
+            perf_counter_start(misses_fd);
+            perf_counter_start(l1_fd);
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for(int t = 0; t < 3; t++){
+                pthread_create(&threads[t], NULL, test_counter_thread, &counters[(t + 1) * stride]);
+            }
+            test_counter_thread(&counters[0]);
+            for(int t = 0; t < 3; t++){
+                pthread_join(threads[t], NULL);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            int64_t misses = perf_counter_stop(misses_fd);
+            int64_t l1 = perf_counter_stop(l1_fd);
+            for(int t = 0; t < 4; t++){
+                if(counters[t * stride] != 10000000){
+                    printf("Error: lost counter updates\n");
+                    return -1;
+                }
+            }
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            printf("4 threads x 10M increments, %s counters: %.1f ms (%ld CPUs%s)",
+                    padded ? "cache-line padded" : "adjacent", elapsed_ns(&start, &end) / 1e6, cpus,
+                    cpus < 2 ? ": threads never run at once, no false sharing to measure" : "");
+            if(misses >= 0) printf(", %.3f cache misses/increment", misses / 1e7);
+            if(l1 >= 0) printf(", %.3f L1D misses/increment", l1 / 1e7);
+            printf("\n");
+        }
+        free(counters);
+        if(misses_fd >= 0) close(misses_fd);
+        if(l1_fd >= 0) close(l1_fd);
+    }
+    // Test 18: frame buffers placed on a NUMA node
+    printf("\n=== Test 18: Node-local frame buffers ===\n\n");
+    {
+        frame_buf_pool_t *pool = frame_buf_pool_create_on_node(1024, 4, 0);
+        frame_buf_t *bufs[600];
+        for(int i = 0; i < 600; i++){
+            if((bufs[i] = frame_buf_alloc(pool, 1000)) == NULL || bufs[i]->pool != pool){
+                printf("Error: node pool allocation\n");
+                return -1;
+            }
+            memset(bufs[i]->data, i, 1000);   // first touch
+        }
+        for(int i = 0; i < 600; i++){
+            if(bufs[i]->data[999] != (uint8_t)i){
+                printf("Error: node pool buffers overlap\n");
+                return -1;
+            }
+        }
+        int node = -1;
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        if(syscall(SYS_get_mempolicy, &node, NULL, 0, bufs[0]->data, MPOL_F_NODE | MPOL_F_ADDR) < 0){
+            node = -1;
+        }
+#endif
+        // slab buffers outlive max_free: all 600 come back for reuse
+        frame_buf_t *first = bufs[599];
+        for(int i = 0; i < 600; i++){
+            frame_buf_release(bufs[i]);
+        }
+        frame_buf_t *again = frame_buf_alloc(pool, 1000);
+        if(again != first){
+            printf("Error: node pool buffer not reused\n");
+            return -1;
+        }
+        frame_buf_release(again);
+        printf("600 buffers from a node 0 pool, first one resident on node %d\n", node);
+        frame_buf_pool_destroy(pool);
+    }
+    // Test 19: connection handlers as coroutines on one thread vs a thread each
+    printf("\n=== Test 19: Coroutine connection handlers ===\n\n");
+#ifdef __linux__
+    {
+        // two fds per handler, leaving room for the rest of the process
+        long max_fds = sysconf(_SC_OPEN_MAX);
+        int pairs = max_fds > 0 && (max_fds - 64) / 2 < 1000 ? (int)(max_fds - 64) / 2 : 1000;
+        const int frames = 100;
+        test_co_conn_t *conns = calloc(2 * pairs, sizeof(test_co_conn_t));
+        for(int round = 0; round < 2; round++){
+            int threaded = round == 1;
+            for(int i = 0; i < pairs; i++){
+                int sv[2];
+                if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0){
+                    printf("Error: socketpair\n");
+                    return -1;
+                }
+                conns[2 * i] = (test_co_conn_t){ .fd = sv[0], .frames = frames };
+                conns[2 * i + 1] = (test_co_conn_t){ .fd = sv[1], .frames = frames };
+            }
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if(threaded){
+                // the same handler bodies: outside a coroutine co_* calls block
+                pthread_t *threads = malloc(2 * pairs * sizeof(pthread_t));
+                test_co_thread_t *args = malloc(2 * pairs * sizeof(test_co_thread_t));
+                pthread_attr_t attr;
+                pthread_attr_init(&attr);
+                pthread_attr_setstacksize(&attr, CO_STACK_SIZE);
+                for(int i = 0; i < 2 * pairs; i++){
+                    args[i] = (test_co_thread_t){ i % 2 ? test_co_echo : test_co_client, &conns[i] };
+                    if(pthread_create(&threads[i], &attr, test_co_thread, &args[i]) != 0){
+                        printf("Error: pthread_create\n");
+                        return -1;
+                    }
+                }
+                for(int i = 0; i < 2 * pairs; i++){
+                    pthread_join(threads[i], NULL);
+                }
+                pthread_attr_destroy(&attr);
+                free(threads);
+                free(args);
+            }else{
+                co_sched_t *sched = co_sched_create(0);
+                for(int i = 0; i < pairs; i++){
+                    co_spawn(sched, test_co_client, &conns[2 * i], 0);
+                    co_spawn(sched, test_co_echo, &conns[2 * i + 1], 0);
+                }
+                if(co_sched_run(sched) < 0){
+                    printf("Error: co_sched_run\n");
+                    return -1;
+                }
+                co_sched_destroy(sched);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            long echoed = 0;
+            for(int i = 0; i < pairs; i++){
+                echoed += conns[2 * i].echoed;
+            }
+            if(echoed != (long)pairs * frames){
+                printf("Error: %ld of %ld frames echoed back intact\n", echoed, (long)pairs * frames);
+                return -1;
+            }
+            printf("%d handlers, %ld frame round trips: %s %.1f ms\n", 2 * pairs, echoed,
+                    threaded ? "one thread each" : "coroutines on one thread", elapsed_ns(&start, &end) / 1e6);
+        }
+        free(conns);
+
+        int errs[2] = { -1, -1 };
+        co_sched_t *sched = co_sched_create(0);
+        co_spawn(sched, test_co_cancel, errs, 0);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        co_sched_run(sched);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        co_sched_destroy(sched);
+        if(errs[0] != ECANCELED || errs[1] != EBADF || elapsed_ns(&start, &end) > 1000000000L){
+            printf("Error: cancelled sleep %d, read on closed fd %d\n", errs[0], errs[1]);
+            return -1;
+        }
+        printf("Cancelled sleep and read on a closed fd ended in %.1f ms\n", elapsed_ns(&start, &end) / 1e6);
+    }
+#endif
     return 0;
 }
+#endif // ALGO_NO_MAIN
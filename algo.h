@@ -0,0 +1,425 @@
+/**
+ * algo.h
+ * Frame processing algorithms shared by algo.c's test program and mt_server
+ *
+ * Build the kernels into another program with -DALGO_NO_MAIN, e.g.
+ *   gcc -O2 -pthread -DALGO_NO_MAIN mt_server.c algo.c -o mt_server -lm
+ */
+
+#ifndef ALGO_H
+#define ALGO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* Constants */
+#define FRAME_LEN_100 100
+#define FRAME_LEN_500 500
+#define SEARCH_BYTE 62
+#define SMALL_FRAME_MAX 64  // frames up to this length use the sorting network
+
+/* Function prototypes */
+int process_byte_frame(uint8_t *data, int data_len, uint8_t *result, int *result_len);
+int binary_search_for_byte(uint8_t *data, int data_len, uint8_t target);
+int linear_search_for_byte(uint8_t *data, int data_len, uint8_t target);
+void print_data(uint8_t *data, int data_len);
+int generate_test_data(uint8_t *buffer, int size);
+void generate_test_data_seed(uint64_t seed);
+
+/* Kernels specialized for the known frame lengths, and dispatchers that
+ * pick them when data_len matches (falling back to the generic kernels) */
+int process_byte_frame_100(uint8_t *data, uint8_t *result, int *result_len);
+int process_byte_frame_500(uint8_t *data, uint8_t *result, int *result_len);
+int linear_search_for_byte_100(uint8_t *data, uint8_t target);
+int linear_search_for_byte_500(uint8_t *data, uint8_t target);
+int process_byte_frame_dispatch(uint8_t *data, int data_len, uint8_t *result, int *result_len);
+int linear_search_for_byte_dispatch(uint8_t *data, int data_len, uint8_t target);
+int process_byte_frame_small(uint8_t *data, int data_len, uint8_t *result, int *result_len);
+
+/* Queries on frames sorted in ascending order. Bounds are insertion
+ * points in [0, data_len]; sorted_rank counts bytes below target */
+int sorted_lower_bound(const uint8_t *data, int data_len, uint8_t target);
+int sorted_upper_bound(const uint8_t *data, int data_len, uint8_t target);
+void sorted_equal_range(const uint8_t *data, int data_len, uint8_t target, int *first, int *last);
+int sorted_count(const uint8_t *data, int data_len, uint8_t target);
+int sorted_rank(const uint8_t *data, int data_len, uint8_t target);
+
+/* Prefix-count table for a frame queried many times: below[v] is the
+ * number of bytes < v, so every query is O(1) */
+typedef struct{
+    uint32_t below[257];
+} sorted_index_t;
+
+void sorted_index_build(const uint8_t *data, int data_len, sorted_index_t *index);
+
+static inline uint32_t sorted_index_lower(const sorted_index_t *index, uint8_t target){
+    return index->below[target];
+}
+
+static inline uint32_t sorted_index_upper(const sorted_index_t *index, uint8_t target){
+    return index->below[target + 1];
+}
+
+static inline uint32_t sorted_index_count(const sorted_index_t *index, uint8_t target){
+    return index->below[target + 1] - index->below[target];
+}
+
+/* Distinct + sort for frames of wider symbols */
+int process_u16_frame(const uint16_t *data, int data_len, uint16_t *result, int *result_len);
+int process_u32_frame(const uint32_t *data, int data_len, uint32_t *result, int *result_len, uint32_t *scratch);
+
+/* Streaming kernels for frames processed chunk by chunk as they arrive:
+ * init, update with each chunk, then final (distinct) or read the match
+ * offset (search). The state holds no pointers into earlier chunks. */
+#define SEARCH_STREAM_MAX_PATTERN 64
+
+typedef struct{
+    uint8_t seen[256];      // presence set of the bytes seen so far
+    int distinct;           // distinct values seen, checked once per block
+    uint64_t bytes;         // frame bytes consumed
+} distinct_stream_t;
+
+typedef struct{
+    const uint8_t *pattern;
+    int pattern_len;
+    uint8_t carry[SEARCH_STREAM_MAX_PATTERN];   // tail of the previous chunks
+    int carry_len;
+    int64_t offset;         // frame offset of the next chunk
+    int64_t found;          // frame offset of the first match, -1 if none yet
+} search_stream_t;
+
+void distinct_stream_init(distinct_stream_t *st);
+void distinct_stream_update(distinct_stream_t *st, const uint8_t *data, int data_len);
+int distinct_stream_final(const distinct_stream_t *st, uint8_t *result, int *result_len);
+int search_stream_init(search_stream_t *st, const uint8_t *pattern, int pattern_len);
+int64_t search_stream_update(search_stream_t *st, const uint8_t *data, int data_len);
+
+/* Parallel kernels for buffers of many megabytes, run on a thread pool
+ * (one pool runs one job at a time) */
+typedef struct par_pool par_pool_t;
+
+par_pool_t *par_pool_create(int threads);
+void par_pool_destroy(par_pool_t *pool);
+int process_byte_frame_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len,
+                                uint8_t *result, int *result_len);
+int byte_histogram_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len, uint64_t *counts);
+int64_t linear_search_for_byte_parallel(par_pool_t *pool, const uint8_t *data, size_t data_len, uint8_t target);
+
+/* Fused frame pipeline: the operators chosen for a frame type run
+ * together in one pass over the frame */
+enum{
+    FRAME_OP_VALIDATE  = 1 << 0,    // every byte in [min_valid, max_valid], length in [min_len, max_len]
+    FRAME_OP_HISTOGRAM = 1 << 1,    // occurrences of each byte value
+    FRAME_OP_DISTINCT  = 1 << 2,    // distinct bytes, sorted (process_byte_frame)
+    FRAME_OP_MARKERS   = 1 << 3,    // first position and count of the marker bytes
+    FRAME_OP_STATS     = 1 << 4,    // byte sum, min and max
+    FRAME_OP_ALL       = (1 << 5) - 1
+};
+#define FRAME_PIPELINE_MAX_MARKERS 4
+
+typedef struct{
+    unsigned ops;               // FRAME_OP_* bits
+    uint8_t min_valid, max_valid;
+    int min_len, max_len;
+    uint8_t markers[FRAME_PIPELINE_MAX_MARKERS];
+    int num_markers;
+} frame_pipeline_t;
+
+typedef struct{
+    int valid;                  // validate
+    int first_invalid;          // validate: first out-of-range byte, -1 if none
+    uint32_t histogram[256];    // histogram (also filled for distinct)
+    uint8_t distinct[256];      // distinct
+    int distinct_len;
+    int first_marker;           // markers: -1 if none
+    int marker_count;
+    uint64_t sum;               // stats
+    uint8_t min, max;
+} frame_pipeline_result_t;
+
+int frame_pipeline_init(frame_pipeline_t *p, const char *spec);
+int frame_pipeline_run(const frame_pipeline_t *p, const uint8_t *data, int data_len,
+                       frame_pipeline_result_t *out);
+
+/* CRC32C frame integrity checks (SSE4.2 when available), chainable
+ * across chunks starting from 0 */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+uint32_t crc32c_copy(uint32_t crc, void *dst, const void *src, size_t len);
+
+/* Reproducible synthetic frames: a seeded vectorized xoshiro256** source
+ * and frame_gen_t distributions over it (see frame_gen_init for specs) */
+#define FRAME_GEN_DEFAULT_SEED 0x4D544652ull
+#define FRAME_GEN_ZIPF_BUCKETS 4096
+
+typedef struct{
+    uint64_t s[4][4];       // state word k of stream l is s[k][l]
+} frame_rng_t;
+
+typedef enum{
+    FRAME_DIST_UNIFORM,
+    FRAME_DIST_ALPHABET,
+    FRAME_DIST_ZIPF,
+    FRAME_DIST_RUNS
+} frame_dist_t;
+
+typedef struct{
+    frame_rng_t rng;
+    frame_dist_t dist;
+    int alphabet;           // byte values in use
+    int mean_run;           // runs: mean run length
+    uint8_t symbols[256];   // the byte values in use, by rank
+    uint8_t zipf_table[FRAME_GEN_ZIPF_BUCKETS];
+    int target;             // byte forced into each frame, -1 for none
+    int target_pos;         // where to force it, -1 for a random position
+    int target_once;        // remove its other occurrences
+} frame_gen_t;
+
+void frame_rng_seed(frame_rng_t *rng, uint64_t seed);
+uint64_t frame_rng_next(frame_rng_t *rng);
+void frame_rng_bytes(frame_rng_t *rng, uint8_t *buf, size_t len);
+int frame_gen_init(frame_gen_t *g, const char *spec, uint64_t seed);
+int frame_gen_fill(frame_gen_t *g, uint8_t *buf, int len);
+
+/* Dump formatting: one hex line of up to 16 bytes with offset and ASCII
+ * columns, or bytes as decimal "%d " fields */
+#define FORMAT_HEX_LINE_MAX 80
+
+size_t format_hex_line(char *out, uint64_t offset, const uint8_t *data, int data_len);
+size_t format_decimal(char *out, const uint8_t *data, int data_len);
+
+/* Line-delimited text: split a stream into lines as chunks arrive, and
+ * parse the unsigned numbers in them */
+typedef void (*line_fn)(void *ctx, const char *line, size_t len);
+
+typedef struct{
+    char *partial;          // start of a line straddling chunks
+    size_t partial_len, partial_cap;
+    size_t max_line;        // longer lines are dropped
+    int skipping;           // dropping the rest of an overlong line
+    uint64_t lines;         // lines passed on
+    uint64_t overlong;      // lines dropped for length
+} line_splitter_t;
+
+void line_splitter_init(line_splitter_t *ls, size_t max_line);
+void line_splitter_free(line_splitter_t *ls);
+size_t line_splitter_feed(line_splitter_t *ls, const char *data, size_t len, line_fn fn, void *ctx);
+const char *parse_u64(const char *p, const char *end, uint64_t *value);
+int parse_line_fields(const char *line, size_t len, uint64_t *fields, int max_fields);
+
+/* Hardware event counts for benchmarks, via perf_event_open(2). A counter
+ * is a file descriptor (close it with close()); -1 where unavailable. */
+typedef enum{
+    PERF_COUNTER_CACHE_MISSES,  // last-level cache misses
+    PERF_COUNTER_L1D_MISSES     // L1 data cache read misses
+} perf_counter_event_t;
+
+int perf_counter_open(perf_counter_event_t event);
+void perf_counter_start(int fd);
+int64_t perf_counter_stop(int fd);
+
+/* Refcounted frame buffers: written once by the receive path, then shared
+ * read-only by every consumer through references or slices. The last
+ * release returns the buffer to its pool (or frees it if it came from the
+ * heap because it was larger than the pool's buffers). A pool can be
+ * placed on a NUMA node. */
+typedef struct frame_buf_pool frame_buf_pool_t;
+
+typedef struct frame_buf{
+    uint32_t refs;              // atomic reference count
+    uint32_t cap;               // bytes of data
+    uint32_t len;               // bytes in use, set by the writer
+    frame_buf_pool_t *pool;     // where the buffer returns, NULL if from the heap
+    struct frame_buf *next;     // free list link while pooled
+    uint8_t data[] __attribute__((aligned(64)));
+} frame_buf_t;
+
+typedef struct{
+    frame_buf_t *buf;           // holds one reference
+    uint32_t off, len;
+} frame_slice_t;
+
+frame_buf_pool_t *frame_buf_pool_create(size_t buf_len, int max_free);
+frame_buf_pool_t *frame_buf_pool_create_on_node(size_t buf_len, int max_free, int node);
+void frame_buf_pool_destroy(frame_buf_pool_t *pool);
+frame_buf_t *frame_buf_alloc(frame_buf_pool_t *pool, size_t len);
+void frame_buf_release(frame_buf_t *b);
+
+static inline frame_buf_t *frame_buf_ref(frame_buf_t *b){
+    __atomic_fetch_add(&b->refs, 1, __ATOMIC_RELAXED);
+    return b;
+}
+
+// 1 if the caller holds the only reference and may write to the buffer
+static inline int frame_buf_exclusive(const frame_buf_t *b){
+    return __atomic_load_n(&b->refs, __ATOMIC_ACQUIRE) == 1;
+}
+
+static inline frame_slice_t frame_slice(frame_buf_t *b, uint32_t off, uint32_t len){
+    frame_slice_t s = { frame_buf_ref(b), off, len };
+    return s;
+}
+
+static inline const uint8_t *frame_slice_data(const frame_slice_t *s){
+    return s->buf->data + s->off;
+}
+
+static inline void frame_slice_release(frame_slice_t *s){
+    frame_buf_release(s->buf);
+    s->buf = NULL;
+}
+
+/* Coroutines for connection handlers (Linux): a co_sched_t runs thousands
+ * of coroutines, each on its own small stack, on one thread over epoll.
+ * Inside a coroutine co_read, co_write, co_read_frame and co_sleep suspend
+ * it instead of blocking the thread (the fds are made non-blocking), so a
+ * handler is written as a plain blocking loop; outside one they block
+ * like the system calls. Failures return -1 with errno, ECANCELED once the
+ * coroutine was cancelled. Close fds a coroutine waited on with co_close. */
+#define CO_STACK_SIZE (64 * 1024)  // default coroutine stack, plus a guard page
+
+typedef struct co_sched co_sched_t;
+typedef struct co co_t;
+typedef void (*co_fn)(void *arg);
+
+co_sched_t *co_sched_create(size_t stack_size);
+void co_sched_destroy(co_sched_t *s);
+int co_sched_run(co_sched_t *s);
+co_t *co_spawn(co_sched_t *s, co_fn fn, void *arg, int joinable);
+co_t *co_self(void);
+void co_join(co_t *co);
+void co_cancel(co_t *co);
+int co_park(void);
+void co_wake(co_t *co);
+ssize_t co_read(int fd, void *buf, size_t len);
+ssize_t co_write(int fd, const void *buf, size_t len);
+ssize_t co_read_frame(int fd, uint8_t *buf, size_t cap);
+int co_sleep(uint64_t ms);
+int co_close(int fd);
+
+/* Runtime kernel selection: autotune_kernels() benchmarks the scalar,
+ * SSE2, AVX2, AVX-512 and length-specialized variants on this host (or
+ * reuses the choice cached for this CPU model) and the *_tuned entry
+ * points call the winners */
+int autotune_kernels(const char *cache_path);
+void autotune_report(char *buf, size_t len);
+int process_byte_frame_tuned(uint8_t *data, int data_len, uint8_t *result, int *result_len);
+int linear_search_for_byte_tuned(uint8_t *data, int data_len, uint8_t target);
+
+/* First marker byte (SEARCH_BYTE, '\n', 0x00, 0xFF), see DEFINE_BYTE_SEARCHER */
+int find_frame_markers(const uint8_t *data, int data_len);
+
+/*
+ * Byte-set searchers generated at compile time for a fixed set of up to
+ * 8 target bytes:
+ *
+ *     DEFINE_BYTE_SEARCHER(find_markers, SEARCH_BYTE, '\n')
+ *     int pos = find_markers(data, data_len); // first index of any target, or -1
+ *
+ * Each target k owns bit k. The macro folds the targets into two 16-entry
+ * tables indexed by low and high nibble; byte b is a target exactly when
+ * lo[b & 15] & hi[b >> 4] is non-zero. With SSSE3 both lookups are one
+ * pshufb each per 16 bytes, and the scalar fallback uses the same tables,
+ * so neither path loops over the targets.
+ */
+#define SEARCHER_BIT(t, k, n, sh) \
+    (((t) >= 0 && ((((t) >> (sh)) & 15) == (n))) ? (1 << (k)) : 0)
+#define SEARCHER_NIB(n, sh, t0, t1, t2, t3, t4, t5, t6, t7, ...) \
+    (uint8_t)(SEARCHER_BIT(t0, 0, n, sh) | SEARCHER_BIT(t1, 1, n, sh) | \
+              SEARCHER_BIT(t2, 2, n, sh) | SEARCHER_BIT(t3, 3, n, sh) | \
+              SEARCHER_BIT(t4, 4, n, sh) | SEARCHER_BIT(t5, 5, n, sh) | \
+              SEARCHER_BIT(t6, 6, n, sh) | SEARCHER_BIT(t7, 7, n, sh))
+#define SEARCHER_TABLE(sh, ...) { \
+    SEARCHER_NIB(0, sh, __VA_ARGS__), \
+    SEARCHER_NIB(1, sh, __VA_ARGS__), \
+    SEARCHER_NIB(2, sh, __VA_ARGS__), \
+    SEARCHER_NIB(3, sh, __VA_ARGS__), \
+    SEARCHER_NIB(4, sh, __VA_ARGS__), \
+    SEARCHER_NIB(5, sh, __VA_ARGS__), \
+    SEARCHER_NIB(6, sh, __VA_ARGS__), \
+    SEARCHER_NIB(7, sh, __VA_ARGS__), \
+    SEARCHER_NIB(8, sh, __VA_ARGS__), \
+    SEARCHER_NIB(9, sh, __VA_ARGS__), \
+    SEARCHER_NIB(10, sh, __VA_ARGS__), \
+    SEARCHER_NIB(11, sh, __VA_ARGS__), \
+    SEARCHER_NIB(12, sh, __VA_ARGS__), \
+    SEARCHER_NIB(13, sh, __VA_ARGS__), \
+    SEARCHER_NIB(14, sh, __VA_ARGS__), \
+    SEARCHER_NIB(15, sh, __VA_ARGS__) }
+// number of targets, however many are given: the size of an array of them
+#define SEARCHER_COUNT(...) (sizeof((const int[]){ __VA_ARGS__ }) / sizeof(int))
+
+static inline __attribute__((always_inline))
+int byte_set_search_scalar(const uint8_t *data, int data_len, const uint8_t *lo, const uint8_t *hi){
+    for(int i = 0; i < data_len; i++){
+        if(lo[data[i] & 15] & hi[data[i] >> 4]){
+            return i;
+        }
+    }
+    return -1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline __attribute__((always_inline, target("ssse3")))
+unsigned byte_set_match_16(__m128i block, __m128i lo, __m128i hi){
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(block, nibble));
+    __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(block, 4), nibble));
+    __m128i hit = _mm_and_si128(l, h);
+    return ~_mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) & 0xFFFF;
+}
+
+static inline __attribute__((always_inline, target("ssse3")))
+int byte_set_search_ssse3(const uint8_t *data, int data_len, const uint8_t *lo_tbl, const uint8_t *hi_tbl){
+    const __m128i lo = _mm_load_si128((const __m128i *)lo_tbl);
+    const __m128i hi = _mm_load_si128((const __m128i *)hi_tbl);
+    int i = 0;
+    for(; i + 16 <= data_len; i += 16){
+        unsigned mask = byte_set_match_16(_mm_loadu_si128((const __m128i *)(data + i)), lo, hi);
+        if(mask){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    if(i < data_len && data_len >= 16){
+        // tail: reload the last 16 bytes and shift out the lanes already checked
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + data_len - 16));
+        unsigned mask = byte_set_match_16(block, lo, hi) >> (16 - (data_len - i));
+        return mask ? i + __builtin_ctz(mask) : -1;
+    }
+    int tail = byte_set_search_scalar(data + i, data_len - i, lo_tbl, hi_tbl);
+    return tail < 0 ? -1 : i + tail;
+}
+
+#define DEFINE_BYTE_SEARCHER_SIMD(name) \
+    __attribute__((target("ssse3"))) \
+    static int name##_ssse3(const uint8_t *data, int data_len){ \
+        return byte_set_search_ssse3(data, data_len, name##_lo, name##_hi); \
+    }
+#define BYTE_SEARCHER_SIMD_CALL(name) \
+    if(__builtin_cpu_supports("ssse3")){ \
+        return name##_ssse3(data, data_len); \
+    }
+#else
+#define DEFINE_BYTE_SEARCHER_SIMD(name)
+#define BYTE_SEARCHER_SIMD_CALL(name)
+#endif
+
+#define DEFINE_BYTE_SEARCHER(name, ...) \
+    _Static_assert(SEARCHER_COUNT(__VA_ARGS__) <= 8, "a byte searcher takes at most 8 targets"); \
+    static const uint8_t name##_lo[16] __attribute__((aligned(16))) = \
+        SEARCHER_TABLE(0, __VA_ARGS__, -1, -1, -1, -1, -1, -1, -1); \
+    static const uint8_t name##_hi[16] __attribute__((aligned(16))) = \
+        SEARCHER_TABLE(4, __VA_ARGS__, -1, -1, -1, -1, -1, -1, -1); \
+    DEFINE_BYTE_SEARCHER_SIMD(name) \
+    int name(const uint8_t *data, int data_len){ \
+        if(data == NULL || data_len <= 0){ \
+            return -1; \
+        } \
+        BYTE_SEARCHER_SIMD_CALL(name) \
+        return byte_set_search_scalar(data, data_len, name##_lo, name##_hi); \
+    }
+
+#endif // ALGO_H
@@ -0,0 +1,33 @@
+/**
+ * capture.h
+ * Capture file format shared by mt_server (-C) and mt_dump
+ *
+ * A capture is a file header followed by one record per received chunk:
+ * a record header and then len raw bytes. Fields are in host byte order;
+ * read captures on a machine of the same endianness.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC 0x4D544350u   // "MTCP"
+#define CAPTURE_VERSION 2   // 2: conn is a connection id, no longer the descriptor
+
+// file header
+typedef struct{
+    uint32_t magic;         // CAPTURE_MAGIC
+    uint32_t version;       // CAPTURE_VERSION
+    int64_t started_ns;     // capture start, nanoseconds since the epoch
+} capture_file_hdr_t;
+
+// record header, followed by len bytes of data
+typedef struct{
+    uint64_t ts_ns;         // receive time, nanoseconds since the epoch
+    uint32_t conn;          // connection id, counting up from 1 per capture;
+                            // mt_server logs "captured as conn N"
+    uint32_t len;           // data length in bytes
+} capture_rec_t;
+
+#endif // CAPTURE_H
@@ -0,0 +1,84 @@
+/**
+ * frame.h
+ * Binary frame format shared by mt_server and test_sender
+ *
+ * A frame is a fixed 16-byte header followed by len payload bytes.
+ * All header fields are in network byte order.
+ *
+ * The top byte of the length word carries flags. With FRAME_FLAG_CRC the
+ * payload is followed by a 4-byte CRC32C (network order) of the header
+ * and payload, computed with crc32c() from algo.h.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#define FRAME_MAGIC 0x4D544652u        // "MTFR"
+#define FRAME_HDR_LEN 16               // size of the encoded header
+#define FRAME_MAX_LEN (16 * 1024 * 1024) // largest accepted payload
+#define FRAME_FLAGS_MASK 0xFF000000u    // flag bits of the length word
+#define FRAME_FLAG_CRC 0x80000000u      // a CRC32C trailer follows the payload
+#define FRAME_CRC_LEN 4                 // size of the CRC32C trailer
+
+// decoded frame header
+typedef struct{
+    uint32_t len;       // payload length in bytes
+    uint32_t flags;     // FRAME_FLAG_* bits
+    uint64_t ts_ns;     // source timestamp, nanoseconds since the epoch
+} frame_hdr_t;
+
+static inline uint64_t frame_htonll(uint64_t v){
+    return ((uint64_t)htonl((uint32_t)v) << 32) | htonl((uint32_t)(v >> 32));
+}
+
+/**
+ * Encode a frame header
+ * @param out: destination, FRAME_HDR_LEN bytes
+ * @param hdr: the header to encode
+ */
+static inline void frame_encode_hdr(uint8_t *out, const frame_hdr_t *hdr){
+    uint32_t magic = htonl(FRAME_MAGIC);
+    uint32_t len = htonl(hdr->len | (hdr->flags & FRAME_FLAGS_MASK));
+    uint64_t ts = frame_htonll(hdr->ts_ns);
+    memcpy(out, &magic, 4);
+    memcpy(out + 4, &len, 4);
+    memcpy(out + 8, &ts, 8);
+}
+
+/**
+ * Decode a frame header
+ * @param in: source, FRAME_HDR_LEN bytes
+ * @param hdr: receives the decoded header
+ * return 0 if success, -1 if the magic, the flags or the length is invalid
+ */
+static inline int frame_decode_hdr(const uint8_t *in, frame_hdr_t *hdr){
+    uint32_t magic, len;
+    uint64_t ts;
+    memcpy(&magic, in, 4);
+    memcpy(&len, in + 4, 4);
+    memcpy(&ts, in + 8, 8);
+    if(ntohl(magic) != FRAME_MAGIC){
+        return -1;
+    }
+    hdr->len = ntohl(len) & ~FRAME_FLAGS_MASK;
+    hdr->flags = ntohl(len) & FRAME_FLAGS_MASK;
+    hdr->ts_ns = frame_htonll(ts); // byte swapping is its own inverse
+    if(hdr->len > FRAME_MAX_LEN || (hdr->flags & ~FRAME_FLAG_CRC)){
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Bytes that follow the header: the payload and the trailer, if any
+ * @param hdr: a decoded header
+ */
+static inline uint32_t frame_body_len(const frame_hdr_t *hdr){
+    return hdr->len + (hdr->flags & FRAME_FLAG_CRC ? FRAME_CRC_LEN : 0);
+}
+
+#endif // FRAME_H
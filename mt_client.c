@@ -4,6 +4,11 @@
  * This implementation demonstrates a simple multi-threaded TCP client that creates
  * multiple concurrent connections to a server. It uses a thread pool pattern
  * where each thread maintains its own connection to receive data independently.
+ *
+ * Usage: mt_client [-S]
+ *  -S: session mode (server started with -S). Each thread keeps a session
+ *      across reconnects, acknowledges received messages in batches and
+ *      resumes from the next unreceived sequence number after a drop.
  */
 
 #include <stdio.h>
@@ -12,6 +17,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <poll.h>
+#include <time.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -19,6 +26,8 @@
 #define SERVER_PORT 8080        // Server port number
 #define BUFFER_SIZE 1024        // Size of the buffer for receiving data
 #define NUM_CLIENT_THREADS 4    // Number of client threads to create
+#define ACK_BATCH 16            // Acknowledge after this many messages (or once a second)
+#define RECONNECT_DELAY 1       // Seconds to wait before resuming a dropped session
 
 // structure to pass socket information to the thread
 typedef struct {
@@ -40,8 +49,8 @@ void *client_send_thread(void *arg){
     int counter = 0;
 
     while(1){
-        snprintf(message, BUFFER_SIZE, "Client %d message #%d", thread_id, counter++);
-        if(send(sockfd, message, strlen(message), 0) < 0){
+        int len = snprintf(message, BUFFER_SIZE, "Client %d message #%d\n", thread_id, counter++);
+        if(send(sockfd, message, len, 0) < 0){
             printf("[CLIENT] thread %d: Failed to send data\n", thread_id);
             break;
         }
@@ -123,6 +132,127 @@ void *client_thread(void *arg){
     close(sockfd);
     return NULL;
 }
+/**
+ * Connect a TCP socket to the server
+ * return the socket, -1 on failure
+ */
+int connect_to_server(void){
+    struct sockaddr_in serv_addr;
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if(sockfd < 0){
+        return -1;
+    }
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(SERVER_PORT);
+    if(inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0 ||
+       connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0){
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/**
+ * Session client thread function:
+ * - Opens (or resumes) a session with "HELLO <id> <next_seq>".
+ * - Receives "<seq> <text>" messages, skipping duplicates and reporting gaps.
+ * - Acknowledges cumulatively every ACK_BATCH messages or once a second,
+ *   piggybacked on its own once-a-second message.
+ * - Reconnects after RECONNECT_DELAY when the connection drops, keeping
+ *   the session so only the messages missed in between are resent.
+ */
+void *client_session_thread(void *arg){
+    int thread_id = *(int *)arg;
+    free(arg);
+
+    unsigned long session_id = 0;   // 0 until the server assigns one
+    unsigned long next_seq = 0;     // first sequence number not received yet
+    unsigned long acked_seq = 0;    // last value sent in an ACK
+    int counter = 0;
+    char buffer[BUFFER_SIZE];
+    char message[BUFFER_SIZE];
+
+    while(1){
+        int sockfd = connect_to_server();
+        if(sockfd < 0){
+            printf("[CLIENT] thread %d: Failed to connect to server\n", thread_id);
+            sleep(RECONNECT_DELAY);
+            continue;
+        }
+        int len = snprintf(message, BUFFER_SIZE, "HELLO %lu %lu\n", session_id, next_seq);
+        send(sockfd, message, len, MSG_NOSIGNAL);
+
+        size_t have = 0;
+        time_t last_send = time(NULL);
+        struct pollfd pfd = { .fd = sockfd, .events = POLLIN };
+        while(1){
+            int ready = poll(&pfd, 1, 1000);
+            if(ready > 0){
+                ssize_t n = recv(sockfd, buffer + have, BUFFER_SIZE - 1 - have, 0);
+                if(n <= 0){
+                    break;
+                }
+                have += n;
+                char *line = buffer, *nl;
+                while((nl = memchr(line, '\n', buffer + have - line)) != NULL){
+                    *nl = '\0';
+                    unsigned long a, b;
+                    int text;
+                    if(sscanf(line, "SESSION %lu %lu", &a, &b) == 2){
+                        if(session_id != 0 && a != session_id){
+                            // the old session expired: whatever it had not delivered is gone
+                            printf("[CLIENT] thread %d: Session %lu expired, messages from #%lu lost, "
+                                   "resync needed (new session %lu)\n", thread_id, session_id, next_seq, a);
+                        }else if(session_id != 0 && b > next_seq){
+                            printf("[CLIENT] thread %d: Lost messages #%lu-#%lu, resync needed\n",
+                                    thread_id, next_seq, b - 1);
+                        }
+                        printf("[CLIENT] thread %d: Session %lu resumed at #%lu\n", thread_id, a, b);
+                        session_id = a;
+                        next_seq = b;
+                        acked_seq = b;  // HELLO acknowledged everything before it
+                    }else if(sscanf(line, "%lu %n", &a, &text) == 1 && a >= next_seq){
+                        if(a > next_seq){
+                            printf("[CLIENT] thread %d: Gap before message #%lu\n", thread_id, a);
+                        }
+                        next_seq = a + 1;
+                        printf("[CLIENT] thread %d: Received #%lu: %s\n", thread_id, a, line + text);
+                    }
+                    line = nl + 1;
+                }
+                have -= line - buffer;
+                if(have == BUFFER_SIZE - 1){
+                    have = 0;
+                }
+                memmove(buffer, line, have);
+            }
+
+            // batch acknowledgements instead of acking every message
+            time_t now = time(NULL);
+            if(next_seq - acked_seq >= ACK_BATCH || (now != last_send && next_seq > acked_seq)){
+                len = snprintf(message, BUFFER_SIZE, "ACK %lu\n", next_seq);
+                if(send(sockfd, message, len, MSG_NOSIGNAL) < 0){
+                    break;
+                }
+                acked_seq = next_seq;
+            }
+            if(now != last_send){
+                last_send = now;
+                len = snprintf(message, BUFFER_SIZE, "Client %d message #%d\n", thread_id, counter++);
+                if(send(sockfd, message, len, MSG_NOSIGNAL) < 0){
+                    break;
+                }
+            }
+        }
+        printf("[CLIENT] thread %d: Connection lost, resuming session %lu from #%lu\n",
+                thread_id, session_id, next_seq);
+        close(sockfd);
+        sleep(RECONNECT_DELAY);
+    }
+    return NULL;
+}
+
 /**
  * Main function:
  * - Creates NUM_CLIENT_THREADS threads.
@@ -131,12 +261,19 @@ void *client_thread(void *arg){
  */
 int main(int argc, char *argv[]){
     pthread_t threads[NUM_CLIENT_THREADS];
+    void *(*thread_fn)(void *) = client_thread;
+    if(argc > 1 && strcmp(argv[1], "-S") == 0){
+        thread_fn = client_session_thread;
+    }else if(argc > 1){
+        fprintf(stderr, "Usage: %s [-S]\n", argv[0]);
+        return 1;
+    }
 
     // Create client threads
     for(int i = 0; i < NUM_CLIENT_THREADS; i++){
         int *thread_id = (int *)malloc(sizeof(int));
         *thread_id = i;
-        if(pthread_create(&threads[i], NULL, client_thread, thread_id) != 0){
+        if(pthread_create(&threads[i], NULL, thread_fn, thread_id) != 0){
             printf("Failed to create thread %d\n", i);
             free(thread_id);
             continue;
@@ -0,0 +1,156 @@
+/**
+ * mt_dump.c
+ * Render a capture written by mt_server -C
+ *
+ * Usage: mt_dump [-d] [-c conn] [-n max_bytes] capture_file
+ *  -d: print the data as decimal bytes (16 per line) instead of hex lines
+ *  -c: only records received on the given connection id (the N of
+ *      mt_server's "captured as conn N")
+ *  -n: print at most max_bytes of each record
+ *
+ * Build: gcc -O2 -pthread -DALGO_NO_MAIN mt_dump.c algo.c -o mt_dump -lm
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "algo.h"
+#include "capture.h"
+
+#define OUT_BUF_LEN (1024 * 1024) // output gathered before each write
+
+static char out_buf[OUT_BUF_LEN];
+static size_t out_used = 0;
+
+// write the gathered output
+static void flush_out(void){
+    size_t off = 0;
+    while(off < out_used){
+        ssize_t n = write(STDOUT_FILENO, out_buf + off, out_used - off);
+        if(n <= 0){
+            perror("Failed to write output");
+            exit(EXIT_FAILURE);
+        }
+        off += n;
+    }
+    out_used = 0;
+}
+
+// room for at least len more bytes of output
+static char *reserve_out(size_t len){
+    if(out_used + len > OUT_BUF_LEN){
+        flush_out();
+    }
+    return out_buf + out_used;
+}
+
+int main(int argc, char *argv[]){
+    int decimal = 0;
+    long only_conn = -1;
+    long max_bytes = -1;
+
+    int c;
+    while((c = getopt(argc, argv, "dc:n:")) != -1){
+        switch(c){
+        case 'd':
+            decimal = 1;
+            break;
+        case 'c':
+            only_conn = atol(optarg);
+            break;
+        case 'n':
+            max_bytes = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d] [-c conn] [-n max_bytes] capture_file\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(optind >= argc){
+        fprintf(stderr, "Usage: %s [-d] [-c conn] [-n max_bytes] capture_file\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) < 0){
+        perror("Failed to open capture file");
+        exit(EXIT_FAILURE);
+    }
+    if((size_t)st.st_size < sizeof(capture_file_hdr_t)){
+        fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED){
+        perror("Failed to map capture file");
+        exit(EXIT_FAILURE);
+    }
+    madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+    close(fd);
+
+    capture_file_hdr_t hdr;
+    memcpy(&hdr, map, sizeof(hdr));
+    if(hdr.magic != CAPTURE_MAGIC || hdr.version != CAPTURE_VERSION){
+        fprintf(stderr, "%s: not a capture file (or another version)\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t records = 0, bytes = 0;
+    size_t off = sizeof(hdr);
+    while(off + sizeof(capture_rec_t) <= (size_t)st.st_size){
+        capture_rec_t rec;
+        memcpy(&rec, map + off, sizeof(rec));
+        off += sizeof(rec);
+        if(rec.len > st.st_size - off){
+            fprintf(stderr, "Capture ends inside record %" PRIu64 "\n", records);
+            break;
+        }
+        const uint8_t *data = map + off;
+        off += rec.len;
+        records++;
+        if(only_conn >= 0 && rec.conn != (uint32_t)only_conn){
+            continue;
+        }
+        bytes += rec.len;
+
+        char *p = reserve_out(128);
+        out_used += snprintf(p, 128, "#%" PRIu64 " %" PRIu64 ".%09" PRIu64 " +%.6fs conn %u len %u\n", records - 1,
+                             rec.ts_ns / UINT64_C(1000000000), rec.ts_ns % UINT64_C(1000000000),
+                             (double)((int64_t)rec.ts_ns - hdr.started_ns) / 1e9, rec.conn, rec.len);
+        uint32_t shown = max_bytes >= 0 && rec.len > max_bytes ? (uint32_t)max_bytes : rec.len;
+        for(uint32_t i = 0; i < shown; i += 16){
+            int n = shown - i < 16 ? shown - i : 16;
+            if(decimal){
+                p = reserve_out(16 * 4 + 1);
+                size_t len = format_decimal(p, data + i, n);
+                p[len++] = '\n';
+                out_used += len;
+            }else{
+                out_used += format_hex_line(reserve_out(FORMAT_HEX_LINE_MAX), i, data + i, n);
+            }
+        }
+        if(shown < rec.len){
+            p = reserve_out(64);
+            out_used += snprintf(p, 64, "... %u more bytes\n", rec.len - shown);
+        }
+    }
+    flush_out();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " data bytes rendered in %.3f s (%.0f MB/s)\n",
+            records, bytes, secs, secs > 0 ? bytes / 1e6 / secs : 0.0);
+    munmap((void *)map, st.st_size);
+    return 0;
+}
@@ -2,16 +2,132 @@
  * mt_server.c
  * Multi-threaded server implementation
  * 
+ * Usage: mt_server [-p port] [-u upstream_ip:port | -B backends_file | -w processes |
+ *                   -s lateness_ms[:subscriber_port]]
+ *                  [-t name:port:workers[:cpus] ... [-o workers[:cpus]]]
+ *                  [-c checkpoint_file[:interval_s]] [-S ring_messages] [-k kernel_cache]
+ *                  [-C capture_file] [-l] [-x ifname[:queue]] [-e connections]
+ *  -p: listen on the given port instead of PORT
+ *  -u: relay mode, forward each connection's byte stream to an upstream
+ *      server using splice() (no userspace copies). Each client gets its
+ *      own upstream connection, taken from a small pool of spares opened
+ *      ahead of time; if the upstream fails mid-stream the client is
+ *      dropped, since the stream cannot be resumed elsewhere.
+ *  -B: router mode, route each feed to one of the backends listed in the
+ *      file (one ip:port per line) by consistent hashing of its feed key.
+ *      A client names its feed with a first line "FEED <key>\n"; clients
+ *      that do not are routed by their IP address. Send SIGHUP to reload
+ *      the file after adding or removing backends.
+ *  -w: prefork mode, run N worker processes, each with its own epoll loop
+ *      and SO_REUSEPORT listening socket, supervised by the parent which
+ *      restarts crashed children and reports aggregate stats
+ *  -t: add a tenant listening on its own port, served by a dedicated group
+ *      of worker threads, optionally pinned to a CPU list like "2-3,6".
+ *      Repeat for each tenant; without -t all connections share one pool.
+ *  -o: size (and optional CPU list) of the overflow pool shared by all
+ *      tenants, used when a tenant's own workers are all busy. One tenant
+ *      may hold at most half of the overflow workers; the cap is per
+ *      tenant, so two bursting tenants together can still fill the pool.
+ *  -e: coroutine workers. Each worker thread serves up to this many
+ *      connections at once, each in a coroutine on the thread's epoll loop
+ *      (see co_spawn in algo.h) running the same handler as a blocking
+ *      worker; the test message sender of a connection is a coroutine too
+ *      instead of a thread. Tenant and overflow capacity count connections
+ *      instead of workers. Default threaded mode only, without -S.
+ *  -x: XDP ingest mode, for UDP feeds. An XDP program attached to the
+ *      interface (generic mode, so it works on any driver, veth and lo
+ *      included) steers UDP datagrams for the -p port arriving on the RX
+ *      queue (default 0) into an AF_XDP socket; all other traffic passes
+ *      to the stack. Each datagram carries one or more binary frames (see
+ *      frame.h), which are checked and aggregated straight from the UMEM
+ *      packet buffer, without copies; a datagram that is not a frame is
+ *      aggregated as a chunk of raw bytes. Packets must fit a UMEM chunk
+ *      (XDP_CHUNK_SIZE); the kernel drops larger ones and counts them in
+ *      rx_dropped. Needs root (CAP_NET_ADMIN and CAP_BPF).
+ *  On hosts with several NUMA nodes, the workers of each tenant without a
+ *  CPU list are split into one group per node, pinned to the node's CPUs
+ *  and receiving into buffers placed on the node. A connection goes to the
+ *  node whose CPU processes its packets (SO_INCOMING_CPU, i.e. where its
+ *  NIC queue interrupt lands), and per-node stats report connections
+ *  served remotely and the kernel's cross-node allocation counters. On a
+ *  single node nothing changes.
+ *  -s: sequencer mode, accept binary frames (see frame.h) from any number
+ *      of feeds and merge them into one stream ordered by source timestamp,
+ *      sent to every client of the subscriber port (default PORT + 1).
+ *      A frame is released once every open feed has a later frame queued
+ *      or it is older than the newest timestamp seen minus lateness_ms;
+ *      frames arriving behind the released stream are dropped as late.
+ *      Frames with a CRC32C trailer are verified while being copied in and
+ *      dropped if it does not match.
+ *  -c: periodically checkpoint the aggregation state built from received
+ *      data to the file (default every CHECKPOINT_INTERVAL seconds), and
+ *      restore it from the file at startup
+ *  -S: sessions that outlive connections. A client opens with
+ *      "HELLO <session_id> <next_seq>\n" (id 0 for a new session) and the
+ *      server answers "SESSION <session_id> <resume_seq>\n". Server messages
+ *      are "<seq> <text>\n"; the last ring_messages of them are kept per
+ *      session and the client acknowledges with "ACK <next_seq>\n". On
+ *      reconnect the server resends from next_seq; a resume_seq above the
+ *      requested one means the gap fell out of the ring.
+ *  Without -u/-B/-S, a connection whose first bytes are a frame header
+ *  (see frame.h) is read as binary frames. Each payload is aggregated and
+ *  searched chunk by chunk as it arrives, so multi-megabyte frames are
+ *  never buffered whole.
+ *  -k: cache file for the startup kernel autotuning. At startup the server
+ *      benchmarks the frame kernel variants and uses the fastest; with -k
+ *      the choice is remembered per CPU model and the benchmark skipped.
+ *  -l: line mode. Text connections are split into '\n'-terminated lines
+ *      (at most MAX_LINE_LEN bytes; longer ones are dropped) and each line
+ *      is aggregated and its numeric fields parsed, instead of treating
+ *      every recv chunk as one message. One summary is printed per chunk.
+ *  -C: capture every received chunk, raw and timestamped, to the file (see
+ *      capture.h; render it with mt_dump). In sequencer mode the merged
+ *      stream is captured instead. Workers only queue a reference to the
+ *      buffer the data was received into; a writer thread writes batches
+ *      out with writev(). When the writer falls behind, records are
+ *      dropped and counted instead of stalling the workers. Records
+ *      name their connection by an id that is never reused, logged as
+ *      "captured as conn N"; the queue is flushed on exit and on
+ *      SIGINT/SIGTERM.
+ *
+ * Build: gcc -O2 -pthread -DALGO_NO_MAIN mt_server.c algo.c -o mt_server -lm
+ * Add -DCONN_STATE_BENCH for a binary that benchmarks the per-chunk
+ * connection state path (conn_state_bench) instead of serving.
  */
 
+#define _GNU_SOURCE // splice()
+
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+
+#include "algo.h"
+#include "frame.h"
+#include "capture.h"
 
 
 #define PORT 8080   // server listens on this port
@@ -19,31 +135,345 @@
 #define BUFFER_SIZE 1024 // buffer size for receiving data
 #define NUM_WORKER_THREADS 4 // number of worker threads
 #define MAX_CLIENTS 100 // maximum number of clients
+#define RELAY_POOL_SIZE NUM_WORKER_THREADS // spare upstream connections opened ahead of time
+#define RELAY_SPLICE_LEN (64 * 1024) // bytes moved per splice() call in relay mode
+#define MAX_BACKENDS 64 // maximum number of backends known to the router
+#define VNODES_PER_BACKEND 160 // virtual nodes per backend on the hash ring
+#define MAX_FEED_KEY 128 // maximum length of a feed key
+#define FEED_HANDSHAKE_TIMEOUT 5 // seconds a routed client has to send its first bytes
+#define MAX_WORKER_PROCESSES 64 // maximum number of prefork worker processes
+#define MAX_EVENTS 64 // epoll events handled per wakeup in a worker process
+#define STATS_INTERVAL 5 // seconds between aggregate stats reports in prefork mode
+#define CACHE_LINE 64
+#define MAX_TENANTS 16 // maximum number of tenants (-t)
+#define MAX_GROUP_WORKERS 64 // maximum worker threads in one group
+#define MAX_TENANT_NAME 32 // maximum length of a tenant name
+#define SEQ_MAX_INPUTS 8192 // maximum number of feeds merged by the sequencer
+#define SEQ_MAX_SUBSCRIBERS 64 // maximum number of sequencer subscribers
+#define SEQ_RECV_LEN (64 * 1024) // staging buffer for sequencer input reads
+#define AGG_WINDOWS 60 // one-second windows of frame counts kept in the aggregation state
+#define CHECKPOINT_INTERVAL 10 // default seconds between checkpoints
+#define CHECKPOINT_MAGIC 0x4D54434Bu // "MTCK"
+#define CHECKPOINT_VERSION 1
+#define MAX_SESSIONS 256 // maximum number of live sessions
+#define SESSION_MSG_LEN 128 // maximum length of a session message
+#define SESSION_TIMEOUT 60 // seconds a detached session is kept for resumption
+#define CAPTURE_QUEUE_LEN 8192 // captured chunks held by reference before they are written
+#define CAPTURE_BATCH 256 // queued chunks that wake the capture writer
+#define CAPTURE_IOV 512 // iovecs per writev() of the capture writer, two per record
+#define RX_POOL_FREE (2 * CAPTURE_QUEUE_LEN) // idle receive buffers kept for reuse
+#define SEQ_BUF_LEN 4096 // frames up to this size come from the sequencer's buffer pool
+#define SEQ_POOL_FREE 1024 // idle sequencer frame buffers kept for reuse
+#define MAX_LINE_LEN 4096 // longest line accepted in line mode
+#define LINE_MAX_FIELDS 4 // numeric fields parsed from each line
+#define LINE_PREVIEW_LEN 64 // bytes of the last line shown in a chunk summary
+#define MAX_NUMA_NODES 8 // NUMA nodes workers are split across
+#define NODE_SYSFS "/sys/devices/system/node" // where the kernel describes NUMA nodes
+#define XDP_RING_SIZE 2048 // descriptors in the fill and RX rings, and UMEM chunks
+#define XDP_CHUNK_SIZE 2048 // bytes per UMEM chunk, one packet each
+#define XDP_BATCH 64 // RX descriptors taken per ring pass
+#define XDP_MAP_ENTRIES 64 // RX queues the steering map can hold
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
 
 
 // define a connection node structure for queue
 typedef struct conn_node{
     int connfd;
+    int tenant;     // index of the tenant the connection belongs to
     struct conn_node *next;
 } conn_node_t;
 
-// define a queue structure for connection nodes
+// define a queue structure for connection nodes. Shared structures like
+// this one start on their own cache line and are padded to whole lines,
+// so neighbouring globals never share one; a mutex sits on the same line
+// as the fields it protects, which are always touched together with it.
 typedef struct{
+    pthread_mutex_t mutex;  // mutex to protect queue operations
     conn_node_t *head;
     conn_node_t *tail;
-    pthread_mutex_t mutex;  // mutex to protect queue operations
+    int length;             // number of queued connections, atomic: the acceptor reads it unlocked
     pthread_cond_t cond;    // condition variable to signal available data
-} conn_queue_t;
+    int notify_fd;          // coroutine workers: eventfd counting queued connections, else -1
+} __attribute__((aligned(CACHE_LINE))) conn_queue_t;
 
 // structure to manage client connections
 typedef struct{
+    pthread_mutex_t mutex; // mutex to protect connection list
     int *client_fds;    // dynamic array of client file descriptors
     int count;          // current connection count
-    pthread_mutex_t mutex; // mutex to protect connection list
-} client_manager_t;
+} __attribute__((aligned(CACHE_LINE))) client_manager_t;
+
+// spare connections to the upstream server (relay mode). A spare has
+// never carried data; each client stream gets one to itself.
+typedef struct{
+    pthread_mutex_t mutex;          // mutex to protect the pool
+    int fds[RELAY_POOL_SIZE];       // spare upstream connections
+    int count;                      // number of spare connections
+    int active;                     // 0 once a reload removed the backend: no new spares
+    struct sockaddr_in addr;        // upstream server address
+} __attribute__((aligned(CACHE_LINE))) upstream_pool_t;
+
+// a point on the consistent hash ring
+typedef struct{
+    uint32_t hash;  // position on the ring
+    int backend;    // index into the router's backend table
+} ring_point_t;
+
+// consistent hash router over a set of backend servers
+typedef struct{
+    upstream_pool_t backends[MAX_BACKENDS]; // every backend ever seen, never freed
+    int num_backends;       // number of entries used in backends[]
+    ring_point_t *ring;     // ring points sorted by hash
+    int ring_len;           // number of ring points
+    pthread_rwlock_t lock;  // protects ring and num_backends
+} router_t;
+
+// per-process counters published in shared memory (prefork mode),
+// each worker process writes only its own cache-line aligned slot
+typedef struct{
+    pid_t pid;                  // current process in this slot, 0 if none
+    uint32_t restarts;          // times the supervisor restarted this slot
+    uint64_t accepted;          // connections accepted
+    uint64_t active;            // connections currently open
+    uint64_t bytes_received;    // payload bytes received
+    uint64_t messages;          // recv() calls returning data
+} __attribute__((aligned(CACHE_LINE))) process_stats_t;
+
+// a tenant: a listening port with a dedicated group of worker threads
+typedef struct{
+    char name[MAX_TENANT_NAME];
+    int port;           // port the tenant's feeds connect to
+    int listenfd;       // the tenant's listening socket
+    int num_workers;    // size of the tenant's worker group
+    cpu_set_t cpus;     // CPUs the group is pinned to
+    int pinned;         // 0 if the group may run on any CPU
+    conn_queue_t *queue; // connections waiting for the tenant's workers
+    int by_node;        // workers are split into one group per NUMA node
+    conn_queue_t *node_queue[MAX_NUMA_NODES]; // by_node: each node group's queue
+    int next_node;      // by_node: round robin when the arrival CPU is unknown
+    // written by the workers for every connection, read by the acceptor:
+    // kept off the line of the read-mostly fields above
+    int busy __attribute__((aligned(CACHE_LINE))); // tenant workers currently serving a connection
+    int in_overflow;    // connections of this tenant held by the overflow pool
+} __attribute__((aligned(CACHE_LINE))) tenant_t;
+
+typedef struct worker worker_t;
+
+// a group of worker threads serving one queue
+typedef struct{
+    conn_queue_t *queue;
+    cpu_set_t cpus;
+    int pinned;
+    tenant_t *tenant;   // owning tenant, NULL for the shared overflow pool
+    int node;           // NUMA node index the group serves, -1 if not placed by node
+    worker_t *workers;  // the group's threads
+} worker_group_t;
+
+// a NUMA node with CPUs. Workers serving it bump the counters, which sit
+// on their own line; the stats thread reads them.
+typedef struct{
+    int id;                     // kernel node number
+    cpu_set_t cpus;             // the node's CPUs
+    frame_buf_pool_t *rx_pool;  // receive buffers placed on the node
+    uint64_t last_miss, last_other; // numastat at the last report
+    uint64_t connections __attribute__((aligned(CACHE_LINE))); // served by the node's workers
+    uint64_t remote;            // of those, with packets processed on another node
+    uint64_t bytes;             // bytes received by the node's workers
+} __attribute__((aligned(CACHE_LINE))) numa_node_t;
+
+// streaming aggregates built from received data with process_byte_frame.
+// Plain fixed-size data, so a checkpoint is a straight copy of the struct.
+typedef struct{
+    uint64_t frames;                    // frames (recv chunks) aggregated
+    uint64_t bytes;                     // payload bytes aggregated
+    uint64_t frames_with_byte[256];     // frames in which each byte value occurs
+    uint64_t window_frames[AGG_WINDOWS];    // frames per second, ring indexed by time
+    int64_t window_start;               // second of the oldest window in the ring
+} agg_state_t;
+
+// one thread's share of the aggregates. Only its owner updates it, so the
+// lock is contended only while a checkpoint merges the shards.
+typedef struct agg_shard{
+    pthread_mutex_t mutex;      // taken by the owner and by agg_snapshot
+    agg_state_t state;          // aggregated by this thread
+    struct agg_shard *next;     // next shard in agg_shards
+} __attribute__((aligned(CACHE_LINE))) agg_shard_t;
+
+_Static_assert(offsetof(agg_shard_t, state.bytes) + sizeof(uint64_t) <= CACHE_LINE,
+               "a shard's lock must share a cache line with its frame and byte counters");
+
+// a captured chunk waiting to be written: its record header and a
+// reference to the buffer it was received into
+typedef struct{
+    capture_rec_t rec;
+    frame_slice_t data;
+} capture_entry_t;
+
+// capture of received data (-C): workers queue references, the writer
+// thread writes them in batches and drops the references
+typedef struct{
+    pthread_mutex_t mutex;  // protects the fields below
+    uint64_t tail;          // next entry to fill
+    uint64_t records;       // records captured
+    uint64_t head;          // next entry to write
+    uint64_t dropped;       // records dropped while the queue was full
+    pthread_cond_t cond;    // a batch is waiting to be written
+    pthread_cond_t written; // the writer moved head
+    capture_entry_t *queue; // ring of CAPTURE_QUEUE_LEN entries
+    int fd;                 // capture file
+    uint32_t conn_ids;      // connection ids handed out, atomic
+} __attribute__((aligned(CACHE_LINE))) capture_t;
+
+// binary frames read from one connection, processed as the payload arrives
+typedef struct{
+    uint8_t hdr_buf[FRAME_HDR_LEN]; // header being assembled
+    uint32_t hdr_got;               // header bytes received
+    frame_hdr_t hdr;                // header of the frame in progress
+    uint32_t payload_got;           // payload bytes received
+    int in_payload;                 // the header is complete
+    uint32_t crc;                   // CRC32C so far, if the frame has a trailer
+    uint8_t trailer[FRAME_CRC_LEN]; // CRC32C trailer received so far
+    uint32_t trailer_got;
+    distinct_stream_t distinct;     // distinct bytes of the payload so far
+    search_stream_t search;         // first SEARCH_BYTE of the payload
+} frame_rx_t;
+
+// text lines read from one connection in line mode
+typedef struct{
+    line_splitter_t splitter;
+    uint64_t lines;                 // lines in the current chunk
+    uint64_t fields[LINE_MAX_FIELDS]; // numeric fields of the last line
+    int num_fields;
+    char last[LINE_PREVIEW_LEN + 1]; // start of the last line, NUL-terminated
+} line_rx_t;
+
+// how a threaded-mode connection's bytes are read
+enum{ CONN_NEW, CONN_TEXT, CONN_LINES, CONN_FRAMES };
+
+// state of the connection a worker is serving, in one aligned block. The
+// first cache line holds all a received chunk touches; the protocol state
+// behind it is used by one mode only and the bookkeeping once per
+// connection, so a chunk costs one line of connection state plus the
+// data it actually reads.
+typedef struct{
+    // hot
+    int fd;
+    int mode;                   // CONN_TEXT, CONN_LINES or CONN_FRAMES, CONN_NEW until decided
+    frame_buf_t *buf;           // buffer the next chunk is received into
+    uint64_t bytes;             // bytes received: the read cursor in the stream
+    uint64_t chunks;            // recv calls returning data
+    uint32_t pending;           // bytes of an unfinished line or frame held over
+    uint8_t head[3];            // CONN_NEW: first bytes, a prefix of FRAME_MAGIC so far
+    uint8_t head_len;
+    uint32_t capture_id;        // id the connection's chunks are captured under
+    // cold
+    frame_rx_t frames __attribute__((aligned(CACHE_LINE))); // CONN_FRAMES
+    line_rx_t lines;            // CONN_LINES
+    struct timespec opened;     // when the worker took the connection
+} conn_state_t;
+
+_Static_assert(offsetof(conn_state_t, frames) == CACHE_LINE, "hot connection state must fit one cache line");
+
+// one worker thread. Aligned so a worker's writes never share a line
+// with another's; the connection state is reused for every connection.
+struct worker{
+    worker_group_t *group;
+    frame_buf_pool_t *rx_pool;  // receive buffers, on the worker's node if placed
+    int pipefd[2];              // pipe for splice() in relay and router modes
+    conn_state_t *conn;         // state of the connection being served
+    uint64_t connections;       // connections served
+    co_t *intake;               // coroutine workers: takes connections off the queue
+    int open;                   // coroutine workers: connections being served
+} __attribute__((aligned(CACHE_LINE)));
+
+// a connection handed to a coroutine worker
+typedef struct{
+    worker_t *w;
+    int connfd;
+    int tenant;
+} conn_task_t;
+
+// checkpoint file header, followed by the agg_state_t image
+typedef struct{
+    uint32_t magic;         // CHECKPOINT_MAGIC
+    uint32_t version;       // CHECKPOINT_VERSION
+    uint64_t size;          // sizeof(agg_state_t) when written
+    uint64_t checksum;      // FNV-1a over the state image
+    int64_t written_at;     // time the checkpoint was taken
+} checkpoint_hdr_t;
+
+// an outbound message kept for retransmission
+typedef struct{
+    uint64_t seq;
+    int len;
+    char data[SESSION_MSG_LEN]; // encoded "<seq> <text>\n"
+} session_msg_t;
+
+// a session: outbound message stream that survives reconnects
+typedef struct{
+    uint64_t id;            // session id, 0 if the slot is free
+    int connfd;             // attached connection, -1 while detached
+    time_t detached_at;     // when the last connection went away
+    uint64_t next_seq;      // sequence number of the next message
+    uint64_t acked_seq;     // every message below this was acknowledged or dropped
+    uint64_t overwritten;   // unacknowledged messages pushed out of the ring
+    int resending;          // session_attach is still catching the connection up
+    session_msg_t *ring;    // last config.session_ring messages, slot seq % ring size
+    pthread_mutex_t mutex;  // protects the session, initialized once for the slot
+} session_t;
+
+// runtime configuration, filled from command-line options in main
+typedef struct{
+    int port;   // listening port
+    int relay;  // forward connection byte streams to the upstream pool
+    const char *backends_file; // router mode: file listing backend addresses
+    int processes;  // prefork mode: number of worker processes, 0 for threads
+    int overflow_workers;   // size of the shared overflow pool
+    cpu_set_t overflow_cpus;    // CPUs the overflow pool is pinned to
+    int overflow_pinned;    // 0 if the overflow pool may run on any CPU
+    int sequencer;          // merge binary frames from all feeds by timestamp
+    uint64_t seq_lateness_ns;   // how long the sequencer waits for stragglers
+    int seq_sub_port;       // port subscribers connect to for the merged stream
+    const char *checkpoint_file;    // where aggregation state is checkpointed
+    int checkpoint_interval;    // seconds between checkpoints
+    int session_ring;       // session mode: messages kept per session, 0 if off
+    const char *kernel_cache;   // where autotuned kernel choices are cached
+    const char *capture_file;   // where received data is captured
+    int line_mode;          // split text connections into lines
+    const char *xdp_ifname; // XDP ingest mode: interface to attach to, NULL if off
+    int xdp_queue;          // XDP ingest mode: RX queue to read
+    int coroutines;         // connections served at once per worker as coroutines, 0 for one
+} server_config_t;
 
 client_manager_t clients;   // global client manager
 conn_queue_t queue; // global queue for connections
+upstream_pool_t upstream;   // global upstream pool (relay mode)
+router_t router;    // global feed router (router mode)
+volatile sig_atomic_t reload_backends = 0; // set by SIGHUP in router mode
+volatile sig_atomic_t shutdown_requested = 0; // set by SIGINT/SIGTERM in prefork mode
+process_stats_t *process_stats; // shared stats segment, one slot per worker process
+tenant_t tenants[MAX_TENANTS];  // tenants from -t, or one default tenant
+int num_tenants = 0;
+conn_queue_t overflow_queue;    // connections handed to the shared overflow pool
+agg_state_t agg;    // aggregates restored from the checkpoint, the shards add to it
+agg_shard_t *agg_shards;    // one shard per thread that has aggregated data
+pthread_mutex_t agg_mutex = PTHREAD_MUTEX_INITIALIZER; // protects agg and the shard list
+static __thread agg_shard_t *agg_shard; // this thread's shard, created on first use
+capture_t capture = { .fd = -1, .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER,
+                      .written = PTHREAD_COND_INITIALIZER };
+frame_buf_pool_t *rx_pool;  // receive buffers, shared by reference with the capture
+numa_node_t numa_nodes[MAX_NUMA_NODES];    // NUMA nodes with CPUs
+int num_numa_nodes = 1;
+uint8_t cpu_node[CPU_SETSIZE];  // index in numa_nodes of each CPU
+session_t sessions[MAX_SESSIONS];   // session table
+pthread_mutex_t sessions_mutex = PTHREAD_MUTEX_INITIALIZER; // protects session allocation and lookup
+server_config_t config = { .port = PORT, .relay = 0, .backends_file = NULL, .processes = 0 };
 
 // initialize the client manager
 void init_client_manager(client_manager_t *cm){
@@ -112,22 +542,31 @@ void broadcast_to_clients(client_manager_t *cm, const char *data, size_t len){
  */
 void init_queue(conn_queue_t *q){
     q->head = q->tail = NULL;
+    q->length = 0;
     pthread_mutex_init(&q->mutex, NULL);
     pthread_cond_init(&q->cond, NULL);
+    q->notify_fd = -1;
+    // coroutine workers wait for connections in epoll: one eventfd token each
+    if(config.coroutines > 0 && (q->notify_fd = eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC)) < 0){
+        perror("Failed to create queue eventfd");
+        exit(EXIT_FAILURE);
+    }
 }
 
 /**
  * Enqueue a connection file descriptor into the queue
  * @param q: pointer to the queue
  * @param connfd: the connection file descriptor to enqueue
+ * @param tenant: the index of the tenant owning the connection
  */
-void enqueue(conn_queue_t *q, int connfd){
+void enqueue(conn_queue_t *q, int connfd, int tenant){
     conn_node_t *node = (conn_node_t *)malloc(sizeof(conn_node_t));
     if(!node){
         perror("Failed to allocate memory for connection node");
         return;
     }
     node->connfd = connfd;
+    node->tenant = tenant;
     node->next = NULL;
 
     pthread_mutex_lock(&q->mutex);
@@ -137,32 +576,498 @@ void enqueue(conn_queue_t *q, int connfd){
         q->tail->next = node; // add the new node to the end of the queue
         q->tail = node; // update the tail to the new node
     }
+    __atomic_fetch_add(&q->length, 1, __ATOMIC_RELAXED);
     
     // signal one waiting worker thread that a new connection is available
     pthread_cond_signal(&q->cond);
     pthread_mutex_unlock(&q->mutex);
+    uint64_t one = 1;
+    if(q->notify_fd >= 0 && write(q->notify_fd, &one, sizeof(one)) < 0){
+        perror("Failed to signal queued connection");
+    }
 }
 
 /**
- * Dequeue a connection file descriptor from the queue
- * @param q: pointer to the queue
+ * Take the head of a locked, non-empty queue
+ * @param q: pointer to the queue, locked by the caller
+ * @param tenant: receives the index of the tenant owning the connection
  */
-int dequeue(conn_queue_t *q){
-    pthread_mutex_lock(&q->mutex);
-    while(q->head==NULL){   // if queue is empty, wait for a new connection
-        pthread_cond_wait(&q->cond, &q->mutex);
-    }
+int queue_pop(conn_queue_t *q, int *tenant){
     conn_node_t *node = q->head; // get the head node
     int connfd = node->connfd; // get the connection file descriptor
+    *tenant = node->tenant;
     q->head = node->next; // remove the head node from the queue
     if(q->head==NULL){
         q->tail = NULL; // if the queue is empty, set the tail to NULL
     }
     free(node); // free the memory allocated for the node
+    __atomic_fetch_sub(&q->length, 1, __ATOMIC_RELAXED);
+    return connfd;
+}
+
+/**
+ * Dequeue a connection file descriptor from the queue
+ * @param q: pointer to the queue
+ * @param tenant: receives the index of the tenant owning the connection
+ */
+int dequeue(conn_queue_t *q, int *tenant){
+    pthread_mutex_lock(&q->mutex);
+    while(q->head==NULL){   // if queue is empty, wait for a new connection
+        pthread_cond_wait(&q->cond, &q->mutex);
+    }
+    int connfd = queue_pop(q, tenant);
     pthread_mutex_unlock(&q->mutex);
     return connfd; // return the connection file descriptor
 }
 
+/**
+ * Dequeue a connection file descriptor without waiting
+ * @param q: pointer to the queue
+ * @param tenant: receives the index of the tenant owning the connection
+ * return the connection, -1 if the queue is empty
+ */
+int try_dequeue(conn_queue_t *q, int *tenant){
+    pthread_mutex_lock(&q->mutex);
+    int connfd = q->head ? queue_pop(q, tenant) : -1;
+    pthread_mutex_unlock(&q->mutex);
+    return connfd;
+}
+
+/**
+ * Parse an "ip:port" string into an IPv4 socket address
+ * @param str: the address string
+ * @param addr: pointer to the address to fill
+ * return 0 if success, -1 if the string is malformed
+ */
+int parse_addr(const char *str, struct sockaddr_in *addr){
+    char ip[INET_ADDRSTRLEN];
+    const char *colon = strrchr(str, ':');
+    if(colon == NULL || colon == str || (size_t)(colon - str) >= sizeof(ip)){
+        return -1;
+    }
+    memcpy(ip, str, colon - str);
+    ip[colon - str] = '\0';
+    int port = atoi(colon + 1);
+    if(port <= 0 || port > 65535){
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if(inet_pton(AF_INET, ip, &addr->sin_addr) <= 0){
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Initialize the upstream connection pool
+ * @param p: pointer to the pool
+ * @param addr: the upstream server address
+ */
+void init_upstream_pool(upstream_pool_t *p, const struct sockaddr_in *addr){
+    p->addr = *addr;
+    p->count = 0;
+    p->active = 1;
+    pthread_mutex_init(&p->mutex, NULL);
+}
+
+/**
+ * Mark a pool active or not; a pool made inactive closes its spares.
+ * Client streams already using its connections run to completion.
+ * @param p: pointer to the pool
+ * @param active: 0 to retire the pool
+ */
+void upstream_set_active(upstream_pool_t *p, int active){
+    pthread_mutex_lock(&p->mutex);
+    p->active = active;
+    while(!active && p->count > 0){
+        close(p->fds[--p->count]);
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
+
+/**
+ * Open a new connection to the upstream server
+ * @param p: pointer to the pool
+ * return the upstream file descriptor, -1 if the upstream is unreachable
+ */
+int upstream_connect(upstream_pool_t *p){
+    int fd;
+    if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+        perror("Failed to create upstream socket");
+        return -1;
+    }
+    if(connect(fd, (struct sockaddr *)&p->addr, sizeof(p->addr)) < 0){
+        perror("Failed to connect to upstream");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Take a connection to the upstream server for one client stream: a spare
+ * if one is still open, otherwise a new connection. The connection is the
+ * client's alone and is closed with it, so client streams never mix.
+ * @param p: pointer to the pool
+ * return the upstream file descriptor, -1 if the upstream is unreachable
+ */
+int upstream_acquire(upstream_pool_t *p){
+    while(1){
+        int fd = -1;
+        pthread_mutex_lock(&p->mutex);
+        if(p->count > 0){
+            fd = p->fds[--p->count];
+        }
+        pthread_mutex_unlock(&p->mutex);
+        if(fd < 0){
+            return upstream_connect(p);
+        }
+        // a spare has sent nothing yet: readable means the upstream closed it
+        char probe;
+        ssize_t n = recv(fd, &probe, 1, MSG_DONTWAIT | MSG_PEEK);
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return fd;
+        }
+        close(fd);
+    }
+}
+
+/**
+ * Close a client's upstream connection and open a spare in its place if
+ * the pool is short of one
+ * @param p: pointer to the pool
+ * @param fd: the upstream file descriptor
+ */
+void upstream_release(upstream_pool_t *p, int fd){
+    close(fd);
+    pthread_mutex_lock(&p->mutex);
+    int short_of_spares = p->active && p->count < RELAY_POOL_SIZE;
+    pthread_mutex_unlock(&p->mutex);
+    if(!short_of_spares || (fd = upstream_connect(p)) < 0){
+        return;
+    }
+    pthread_mutex_lock(&p->mutex);
+    if(p->active && p->count < RELAY_POOL_SIZE){
+        p->fds[p->count++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    if(fd >= 0){
+        close(fd);
+    }
+}
+
+/**
+ * Forward the byte stream of a connection to an upstream server.
+ * Data moves socket -> pipe -> socket with splice(), so the payload
+ * never gets copied into userspace.
+ * @param pool: the upstream pool to forward to
+ * @param connfd: the client connection file descriptor
+ * @param pipefd: the worker's pipe, must be empty on entry and is empty on return
+ * @param preamble: bytes already consumed from the connection to send first (may be NULL)
+ * @param preamble_len: the length of the preamble
+ * return bytes forwarded, -1 if the upstream could not be reached or failed
+ * mid-stream (the client must then be dropped)
+ */
+ssize_t relay_connection(upstream_pool_t *pool, int connfd, int pipefd[2],
+                         const char *preamble, size_t preamble_len){
+    int upfd = upstream_acquire(pool);
+    if(upfd < 0){
+        return -1;
+    }
+    if(preamble_len > 0 && send(upfd, preamble, preamble_len, 0) < 0){
+        perror("Failed to forward data upstream");
+        upstream_release(pool, upfd);
+        return -1;
+    }
+    ssize_t total = preamble_len, n;
+    while((n = splice(connfd, NULL, pipefd[1], NULL, RELAY_SPLICE_LEN,
+                      SPLICE_F_MOVE | SPLICE_F_MORE)) > 0){
+        // drain the pipe into the upstream connection
+        while(n > 0){
+            ssize_t m = splice(pipefd[0], NULL, upfd, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if(m <= 0){
+                break;
+            }
+            n -= m;
+            total += m;
+        }
+        if(n > 0){
+            // upstream failed mid-stream: another connection would see the
+            // stream start mid-frame, so give up on this client. Drop the
+            // bytes stuck in the pipe so the next connection starts clean.
+            perror("Failed to forward data upstream");
+            char discard[BUFFER_SIZE];
+            while(n > 0){
+                ssize_t m = read(pipefd[0], discard, n < BUFFER_SIZE ? n : BUFFER_SIZE);
+                if(m <= 0){
+                    break;
+                }
+                n -= m;
+            }
+            upstream_release(pool, upfd);
+            return -1;
+        }
+    }
+    if(n < 0){
+        perror("Failed to receive data from connection");
+    }
+    upstream_release(pool, upfd);
+    return total;
+}
+
+/**
+ * Hash a string onto the ring: FNV-1a followed by a murmur3 finalizer
+ * so that similar keys ("10.0.0.1:9001#1", "#2", ...) spread evenly
+ * @param str: the bytes to hash
+ * @param len: the number of bytes
+ */
+uint32_t ring_hash(const char *str, size_t len){
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++){
+        h ^= (uint8_t)str[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+int compare_ring_points(const void *a, const void *b){
+    uint32_t ha = ((const ring_point_t *)a)->hash;
+    uint32_t hb = ((const ring_point_t *)b)->hash;
+    return (ha > hb) - (ha < hb);
+}
+
+/**
+ * Initialize the router
+ * @param r: pointer to the router
+ */
+void init_router(router_t *r){
+    r->num_backends = 0;
+    r->ring = NULL;
+    r->ring_len = 0;
+    pthread_rwlock_init(&r->lock, NULL);
+}
+
+/**
+ * (Re)load the backend list and rebuild the hash ring. Each backend owns
+ * VNODES_PER_BACKEND points derived from its address only, so adding or
+ * removing a backend moves just the feeds on the arcs it gains or loses.
+ * @param r: pointer to the router
+ * @param path: the backends file, one ip:port per line ('#' starts a comment)
+ * return the number of active backends, -1 if the file cannot be read
+ */
+int load_backends(router_t *r, const char *path){
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL){
+        perror("Failed to open backends file");
+        return -1;
+    }
+    char line[BUFFER_SIZE];
+    char active[MAX_BACKENDS] = {0};
+    int num_active = 0;
+
+    pthread_rwlock_wrlock(&r->lock);
+    while(fgets(line, sizeof(line), fp) != NULL){
+        line[strcspn(line, " \t\r\n#")] = '\0';
+        if(line[0] == '\0'){
+            continue;
+        }
+        struct sockaddr_in addr;
+        if(parse_addr(line, &addr) < 0){
+            fprintf(stderr, "Ignoring invalid backend address: %s\n", line);
+            continue;
+        }
+        // find the backend by address, keep its pool if it was seen before
+        int idx = -1;
+        for(int i = 0; i < r->num_backends; i++){
+            if(r->backends[i].addr.sin_addr.s_addr == addr.sin_addr.s_addr &&
+               r->backends[i].addr.sin_port == addr.sin_port){
+                idx = i;
+                break;
+            }
+        }
+        if(idx < 0){
+            if(r->num_backends == MAX_BACKENDS){
+                fprintf(stderr, "Too many backends, ignoring %s\n", line);
+                continue;
+            }
+            idx = r->num_backends++;
+            init_upstream_pool(&r->backends[idx], &addr);
+        }
+        if(!active[idx]){
+            active[idx] = 1;
+            num_active++;
+        }
+    }
+    fclose(fp);
+
+    ring_point_t *ring = malloc((size_t)num_active * VNODES_PER_BACKEND * sizeof(ring_point_t));
+    if(ring == NULL && num_active > 0){
+        perror("Failed to allocate memory for hash ring");
+        pthread_rwlock_unlock(&r->lock);
+        return -1;
+    }
+    int len = 0;
+    for(int i = 0; i < r->num_backends; i++){
+        if(!active[i]){
+            continue;
+        }
+        char name[64];
+        for(int v = 0; v < VNODES_PER_BACKEND; v++){
+            int n = snprintf(name, sizeof(name), "%s:%d#%d",
+                             inet_ntoa(r->backends[i].addr.sin_addr),
+                             ntohs(r->backends[i].addr.sin_port), v);
+            ring[len].hash = ring_hash(name, n);
+            ring[len].backend = i;
+            len++;
+        }
+    }
+    qsort(ring, len, sizeof(ring_point_t), compare_ring_points);
+    // removed backends keep no spare connections open
+    for(int i = 0; i < r->num_backends; i++){
+        upstream_set_active(&r->backends[i], active[i]);
+    }
+    free(r->ring);
+    r->ring = ring;
+    r->ring_len = len;
+    pthread_rwlock_unlock(&r->lock);
+
+    printf("Router: %d active backends, %d ring points\n", num_active, len);
+    return num_active;
+}
+
+/**
+ * Find the backend owning a feed key: the first ring point at or after
+ * the key's hash, wrapping around to the start of the ring
+ * @param r: pointer to the router
+ * @param key: the feed key
+ * @param len: the length of the key
+ * return the backend pool, NULL if there are no active backends
+ */
+upstream_pool_t *route_feed(router_t *r, const char *key, size_t len){
+    uint32_t h = ring_hash(key, len);
+    upstream_pool_t *pool = NULL;
+    pthread_rwlock_rdlock(&r->lock);
+    if(r->ring_len > 0){
+        int left = 0, right = r->ring_len; // lower bound search
+        while(left < right){
+            int mid = left + (right - left) / 2;
+            if(r->ring[mid].hash < h){
+                left = mid + 1;
+            }else{
+                right = mid;
+            }
+        }
+        if(left == r->ring_len){
+            left = 0;
+        }
+        pool = &r->backends[r->ring[left].backend];
+    }
+    pthread_rwlock_unlock(&r->lock);
+    return pool;
+}
+
+/**
+ * Read the "FEED <key>\n" handshake line from a new connection.
+ * The line is consumed byte by byte so nothing past it is read. A client
+ * gets FEED_HANDSHAKE_TIMEOUT seconds for its first bytes, so one that
+ * connects and stays silent does not hold a worker.
+ * @param connfd: the client connection file descriptor
+ * @param line: buffer receiving the consumed bytes (at least MAX_FEED_KEY + 8)
+ * @param line_len: receives the number of bytes consumed
+ * @param key: receives a pointer to the key inside line, NULL if there is no handshake
+ * @param key_len: receives the length of the key
+ * return 0 if success, -1 if the connection closed or failed
+ */
+int read_feed_handshake(int connfd, char *line, size_t *line_len, const char **key, size_t *key_len){
+    static const char prefix[] = "FEED ";
+    size_t n = 0;
+    *key = NULL;
+    *key_len = 0;
+    struct timeval timeout = { .tv_sec = FEED_HANDSHAKE_TIMEOUT };
+    setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while(n < MAX_FEED_KEY + sizeof(prefix)){
+        ssize_t r = recv(connfd, &line[n], 1, 0);
+        if(r <= 0){
+            if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+                printf("[ROUTER] No data on connection %d within %d s, dropped\n", connfd, FEED_HANDSHAKE_TIMEOUT);
+            }
+            return -1;
+        }
+        n++;
+        // not a handshake: stop at the first byte that breaks the prefix
+        if(n <= sizeof(prefix) - 1 && line[n - 1] != prefix[n - 1]){
+            break;
+        }
+        if(line[n - 1] == '\n'){
+            *key = line + sizeof(prefix) - 1;
+            *key_len = n - sizeof(prefix); // excludes the newline
+            if(*key_len > 0 && (*key)[*key_len - 1] == '\r'){
+                (*key_len)--;
+            }
+            break;
+        }
+    }
+    *line_len = n;
+    timeout.tv_sec = 0;     // splice() waits as long as the stream lasts
+    setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return 0;
+}
+
+/**
+ * Route a connection to its backend and forward its byte stream,
+ * handshake included. The backend connection carries this client's
+ * stream only, so the handshake is always the first thing it sees.
+ * @param connfd: the client connection file descriptor
+ * @param pipefd: the worker's pipe for splice()
+ * return bytes forwarded, -1 if the connection could not be routed
+ */
+ssize_t route_connection(int connfd, int pipefd[2]){
+    char line[MAX_FEED_KEY + 8];
+    size_t line_len;
+    const char *key;
+    size_t key_len;
+    if(read_feed_handshake(connfd, line, &line_len, &key, &key_len) < 0){
+        return -1;
+    }
+
+    char addr_key[INET_ADDRSTRLEN];
+    if(key == NULL){
+        // no feed key, keep all connections from one host together
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        if(getpeername(connfd, (struct sockaddr *)&peer, &peer_len) < 0){
+            return -1;
+        }
+        inet_ntop(AF_INET, &peer.sin_addr, addr_key, sizeof(addr_key));
+        key = addr_key;
+        key_len = strlen(addr_key);
+    }
+
+    upstream_pool_t *pool = route_feed(&router, key, key_len);
+    if(pool == NULL){
+        return -1;
+    }
+    printf("[ROUTER] Feed '%.*s' on connection %d -> backend %s:%d\n", (int)key_len, key, connfd,
+            inet_ntoa(pool->addr.sin_addr), ntohs(pool->addr.sin_port));
+    return relay_connection(pool, connfd, pipefd, line, line_len);
+}
+
+/**
+ * SIGHUP handler: ask the accept loop to reload the backends file
+ */
+void handle_sighup(int sig){
+    (void)sig;
+    reload_backends = 1;
+}
+
 /**
  * Sender thread function: continuously send test messages to the client
  * @param arg: pointer to the thread argument (unused)
@@ -191,119 +1096,2781 @@ void* sender_thread(void* arg){
 }
 
 /**
- * Worker thread function: continuously dequeue a connection and process data
- * @param arg: pointer to the thread argument (unused)
+ * Sender coroutine (coroutine workers): sender_thread for a connection
+ * served by a coroutine. Its handler cancels it when the connection ends.
+ * @param arg: the connection file descriptor
  */
-void *worker_thread(void *arg){
-    (void)arg;
-    char buffer[BUFFER_SIZE];
-    ssize_t n;
-    while(1){
-        // get a connection from the shared queue (blocking if none available)
-        int connfd = dequeue(&queue);
-        printf("[SERVER]Worker thread processing connection %d\n", connfd);
-
-        // create a sender thread for this connection
-        pthread_t send_thread;
-        int *conn_arg = malloc(sizeof(int));
-        *conn_arg = connfd;
-        if(pthread_create(&send_thread, NULL, sender_thread, conn_arg) != 0){
-            perror("Failed to create sender thread");
-            free(conn_arg);
-        }else{
-            pthread_detach(send_thread); // detach the sender thread
+void sender_coroutine(void *arg){
+    int connfd = (int)(intptr_t)arg;
+    char test_message[BUFFER_SIZE];
+    for(int counter = 0; ; counter++){
+        int len = snprintf(test_message, BUFFER_SIZE, "Server test message #%d", counter);
+        if(co_write(connfd, test_message, len) < 0){
+            if(errno != ECANCELED){
+                perror("Failed to send data");
+            }
+            break;
         }
-
-        // Process the data from the connection
-        while((n = recv(connfd, buffer, BUFFER_SIZE - 1, 0)) > 0){
-            // // read data from the connection
-            buffer[n] = '\0'; // null-terminate the buffer
-            printf("[SERVER] Received %zd bytes from connection %d: %s\n", n, connfd, buffer);
-    }
-    if(n < 0){
-        perror("Failed to receive data from connection");
-    }else{
-        printf("[SERVER] Connection %d closed by client\n", connfd);
+        printf("[SERVER] Sent to client %d: %s\n", connfd, test_message);
+        if(co_sleep(1000) < 0){
+            break;
         }
-        close(connfd); // close the connection
     }
-    return NULL;
 }
 
+/**
+ * Slide a window ring forward to a second, clearing the seconds that went by
+ * @param state: the aggregation state
+ * @param now: the current second
+ */
+void agg_slide(agg_state_t *state, int64_t now){
+    if(now - state->window_start >= AGG_WINDOWS){
+        int64_t start = now - AGG_WINDOWS + 1;
+        for(int64_t t = state->window_start; t < start && t < state->window_start + AGG_WINDOWS; t++){
+            state->window_frames[t % AGG_WINDOWS] = 0;
+        }
+        state->window_start = start;
+    }
+}
 
 /**
- * Main function: create the listening socket,
- * initialize the connection queue and thread pool,
- * accept connections and enqueue them for processing
+ * Fold a frame already reduced to its distinct bytes into the calling
+ * thread's shard, registering the shard on the thread's first frame
+ * @param distinct: the frame's distinct bytes
+ * @param distinct_len: number of distinct bytes
+ * @param len: the frame length
  */
-int main(){
-    int opt = 1;
-    int sockfd, connfd; // socket file descriptors
-    // set socket options to reuse address and port
-    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt));
-    struct sockaddr_in serv_addr, cli_addr; // server and client addresses
-    socklen_t cli_len = sizeof(cli_addr);  // client address length
+void aggregate_distinct(const uint8_t *distinct, int distinct_len, uint64_t len){
+    agg_shard_t *shard = agg_shard;
+    if(shard == NULL){
+        if((shard = aligned_alloc(CACHE_LINE, sizeof(agg_shard_t))) == NULL){
+            return;
+        }
+        memset(shard, 0, sizeof(agg_shard_t));
+        pthread_mutex_init(&shard->mutex, NULL);
+        pthread_mutex_lock(&agg_mutex);
+        shard->next = agg_shards;
+        agg_shards = shard;
+        pthread_mutex_unlock(&agg_mutex);
+        agg_shard = shard;
+    }
+    int64_t now = time(NULL);
+    agg_state_t *state = &shard->state;
+    pthread_mutex_lock(&shard->mutex);
+    state->frames++;
+    state->bytes += len;
+    for(int i = 0; i < distinct_len; i++){
+        state->frames_with_byte[distinct[i]]++;
+    }
+    agg_slide(state, now);
+    if(now >= state->window_start){
+        state->window_frames[now % AGG_WINDOWS]++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
 
-    // initialize the connection queue
-    init_queue(&queue);
+/**
+ * Merge the restored aggregates and every thread's shard into one state
+ * @param out: filled with the merged state
+ */
+void agg_snapshot(agg_state_t *out){
+    int64_t now = time(NULL);
+    pthread_mutex_lock(&agg_mutex);
+    *out = agg;
+    agg_slide(out, now);
+    for(agg_shard_t *shard = agg_shards; shard != NULL; shard = shard->next){
+        pthread_mutex_lock(&shard->mutex);
+        const agg_state_t *state = &shard->state;
+        out->frames += state->frames;
+        out->bytes += state->bytes;
+        for(int b = 0; b < 256; b++){
+            out->frames_with_byte[b] += state->frames_with_byte[b];
+        }
+        // add the seconds the shard's ring still holds that fall in ours
+        for(int64_t t = out->window_start; t < out->window_start + AGG_WINDOWS; t++){
+            if(t >= state->window_start && t < state->window_start + AGG_WINDOWS){
+                out->window_frames[t % AGG_WINDOWS] += state->window_frames[t % AGG_WINDOWS];
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+    pthread_mutex_unlock(&agg_mutex);
+}
 
-    // create a TCP socket
-    if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
-        perror("Failed to create socket");
-        exit(EXIT_FAILURE);
+/**
+ * Fold one received frame into the aggregation state
+ * @param data: the frame bytes
+ * @param len: the frame length
+ */
+void aggregate_frame(uint8_t *data, int len){
+    uint8_t distinct[256];
+    int distinct_len;
+    if(process_byte_frame_tuned(data, len, distinct, &distinct_len) != 0){
+        return;
     }
+    aggregate_distinct(distinct, distinct_len, len);
+}
 
-    // Configure the server address (bind to all local IP addresses)
-    memset(&serv_addr, 0, sizeof(serv_addr));
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_addr.s_addr = INADDR_ANY;
-    serv_addr.sin_port = htons(PORT);
+uint64_t checkpoint_checksum(const void *data, size_t len){
+    const uint8_t *p = data;
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i = 0; i < len; i++){
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+/**
+ * Write one checkpoint: merge the shards into a snapshot, holding
+ * agg_mutex and each shard's own lock in turn while its few KB are added
+ * (so a worker stalls for microseconds at most), then write and fsync a
+ * temporary file with no lock held and rename it over the old
+ * checkpoint, so a crash mid-write never leaves a torn file behind.
+ * @param path: the checkpoint file
+ * return 0 if success, -1 on I/O failure
+ */
+int write_checkpoint(const char *path){
+    struct{
+        checkpoint_hdr_t hdr;
+        agg_state_t state;
+    } image;
+    agg_snapshot(&image.state);
+    image.hdr.magic = CHECKPOINT_MAGIC;
+    image.hdr.version = CHECKPOINT_VERSION;
+    image.hdr.size = sizeof(agg_state_t);
+    image.hdr.checksum = checkpoint_checksum(&image.state, sizeof(agg_state_t));
+    image.hdr.written_at = time(NULL);
+
+    char tmp[BUFFER_SIZE];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        perror("Failed to open checkpoint file");
+        return -1;
+    }
+    if(write(fd, &image, sizeof(image)) != (ssize_t)sizeof(image) || fsync(fd) < 0){
+        perror("Failed to write checkpoint");
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    if(rename(tmp, path) < 0){
+        perror("Failed to replace checkpoint");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Restore the aggregation state from a checkpoint: map the file and copy
+ * the image in, no replay needed
+ * @param path: the checkpoint file
+ * return 0 if restored, -1 if there is no usable checkpoint
+ */
+int restore_checkpoint(const char *path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return -1;
+    }
+    size_t len = sizeof(checkpoint_hdr_t) + sizeof(agg_state_t);
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size != len){
+        fprintf(stderr, "Ignoring checkpoint %s: unexpected size\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED){
+        perror("Failed to map checkpoint");
+        return -1;
+    }
+    const checkpoint_hdr_t *hdr = map;
+    const agg_state_t *state = (const agg_state_t *)(hdr + 1);
+    int ok = hdr->magic == CHECKPOINT_MAGIC && hdr->version == CHECKPOINT_VERSION &&
+             hdr->size == sizeof(agg_state_t) &&
+             hdr->checksum == checkpoint_checksum(state, sizeof(agg_state_t));
+    if(ok){
+        pthread_mutex_lock(&agg_mutex);
+        agg = *state;
+        pthread_mutex_unlock(&agg_mutex);
+        printf("Restored checkpoint from %s (%ld s old): %" PRIu64 " frames, %" PRIu64 " bytes\n", path,
+                (long)(time(NULL) - hdr->written_at), agg.frames, agg.bytes);
+    }else{
+        fprintf(stderr, "Ignoring checkpoint %s: corrupt or incompatible\n", path);
+    }
+    munmap(map, len);
+    return ok ? 0 : -1;
+}
+
+/**
+ * Open the capture file, write its header and allocate the queue
+ * @param path: the capture file
+ * return 0 if success, -1 on failure
+ */
+int capture_open(const char *path){
+    capture.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(capture.fd < 0){
+        perror("Failed to open capture file");
+        return -1;
+    }
+    capture.queue = calloc(CAPTURE_QUEUE_LEN, sizeof(capture_entry_t));
+    if(capture.queue == NULL){
+        perror("Failed to allocate capture queue");
+        return -1;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    capture_file_hdr_t hdr = { .magic = CAPTURE_MAGIC, .version = CAPTURE_VERSION,
+                               .started_ns = (int64_t)now.tv_sec * 1000000000ll + now.tv_nsec };
+    if(write(capture.fd, &hdr, sizeof(hdr)) != sizeof(hdr)){
+        perror("Failed to write capture file");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Hand out the id a connection's records are captured under. Unlike the
+ * descriptor, which the kernel reuses once it is closed, ids only count up.
+ * return the id, 0 if nothing is being captured
+ */
+uint32_t capture_conn_id(void){
+    if(capture.fd < 0){
+        return 0;
+    }
+    return __atomic_add_fetch(&capture.conn_ids, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Capture a received chunk. Only takes a reference to the buffer holding
+ * it, which must not change afterwards; the writer thread is woken once a
+ * batch is queued. The record is dropped if the queue is full.
+ * @param conn: capture id of the connection the data arrived on
+ * @param buf: the buffer the data was received into
+ * @param off: offset of the data in buf
+ * @param len: number of received bytes
+ */
+void capture_record(uint32_t conn, frame_buf_t *buf, uint32_t off, uint32_t len){
+    if(capture.fd < 0){
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    pthread_mutex_lock(&capture.mutex);
+    if(capture.tail - capture.head == CAPTURE_QUEUE_LEN){
+        capture.dropped++;
+        pthread_mutex_unlock(&capture.mutex);
+        return;
+    }
+    capture_entry_t *e = &capture.queue[capture.tail % CAPTURE_QUEUE_LEN];
+    e->rec = (capture_rec_t){ .ts_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec,
+                              .conn = conn, .len = len };
+    e->data = frame_slice(buf, off, len);
+    if(++capture.tail - capture.head == CAPTURE_BATCH){
+        pthread_cond_signal(&capture.cond);
+    }
+    capture.records++;
+    pthread_mutex_unlock(&capture.mutex);
+}
+
+/**
+ * Capture a chunk from a buffer that will be modified: copies it into a
+ * pooled buffer first
+ * @param pool: where the copy is allocated
+ * @param conn: capture id of the connection the data arrived on
+ * @param data: the received bytes
+ * @param len: number of received bytes
+ */
+void capture_copy(frame_buf_pool_t *pool, uint32_t conn, const void *data, size_t len){
+    if(capture.fd < 0){
+        return;
+    }
+    frame_buf_t *buf = frame_buf_alloc(pool, len);
+    if(buf == NULL){
+        return;
+    }
+    memcpy(buf->data, data, len);
+    buf->len = len;
+    capture_record(conn, buf, 0, len);
+    frame_buf_release(buf);
+}
+
+/**
+ * Write a whole iovec array, resuming after short writes
+ * @param fd: the file
+ * @param iov: the iovecs, modified as they are consumed
+ * @param count: number of iovecs
+ * return 0 if success, -1 on failure
+ */
+int write_iov(int fd, struct iovec *iov, int count){
+    while(count > 0){
+        ssize_t n = writev(fd, iov, count);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        while(count > 0 && (size_t)n >= iov->iov_len){
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if(count > 0){
+            iov->iov_base = (uint8_t *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Capture writer thread: writes the queued records straight from the
+ * receive buffers whenever a batch is queued, and at least once a
+ * second, so a capture is never more than a second behind
+ * @param arg: pointer to the thread argument (unused)
+ */
+void *capture_thread(void *arg){
+    (void)arg;
+    uint64_t reported_drops = 0;
+    struct iovec iov[CAPTURE_IOV];
+    pthread_mutex_lock(&capture.mutex);
+    while(1){
+        if(capture.tail - capture.head < CAPTURE_BATCH){
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += 1;
+            pthread_cond_timedwait(&capture.cond, &capture.mutex, &deadline);
+            if(capture.tail == capture.head){
+                continue;
+            }
+        }
+        // entries from head to tail belong to the writer until head moves
+        uint64_t from = capture.head, to = capture.tail;
+        uint64_t dropped = capture.dropped;
+        pthread_mutex_unlock(&capture.mutex);
+
+        int count = 0, failed = 0;
+        for(uint64_t i = from; i < to; i++){
+            capture_entry_t *e = &capture.queue[i % CAPTURE_QUEUE_LEN];
+            iov[count++] = (struct iovec){ &e->rec, sizeof(e->rec) };
+            iov[count++] = (struct iovec){ (void *)frame_slice_data(&e->data), e->data.len };
+            if(count == CAPTURE_IOV || i + 1 == to){
+                if(!failed && write_iov(capture.fd, iov, count) < 0){
+                    perror("Failed to write capture file");
+                    failed = 1;
+                }
+                count = 0;
+            }
+        }
+        for(uint64_t i = from; i < to; i++){
+            frame_slice_release(&capture.queue[i % CAPTURE_QUEUE_LEN].data);
+        }
+        if(dropped > reported_drops){
+            printf("[SERVER] Capture fell behind, %" PRIu64 " records dropped so far\n", dropped);
+            reported_drops = dropped;
+        }
+
+        pthread_mutex_lock(&capture.mutex);
+        capture.head = to;
+        pthread_cond_broadcast(&capture.written);
+    }
+    return NULL;
+}
+
+/**
+ * Wait until everything captured so far is written. Runs at exit and on
+ * SIGINT/SIGTERM, so the last second of queued records is not lost.
+ */
+void capture_flush(void){
+    pthread_mutex_lock(&capture.mutex);
+    uint64_t to = capture.tail;
+    pthread_cond_signal(&capture.cond);
+    while(capture.head < to){
+        pthread_cond_wait(&capture.written, &capture.mutex);
+    }
+    pthread_mutex_unlock(&capture.mutex);
+}
+
+/**
+ * Capture signal thread: takes SIGINT/SIGTERM, which every other thread
+ * blocks, flushes the capture and lets the signal end the process
+ * @param arg: the set of signals to wait for
+ */
+void *capture_signal_thread(void *arg){
+    sigset_t *set = arg;
+    int sig;
+    if(sigwait(set, &sig) != 0){
+        return NULL;
+    }
+    capture_flush();
+    signal(sig, SIG_DFL);
+    pthread_sigmask(SIG_UNBLOCK, set, NULL);
+    raise(sig);
+    return NULL;
+}
+
+/**
+ * Open the capture file and start its writer thread. Must run before
+ * any other thread is started: SIGINT and SIGTERM are blocked here, so
+ * threads created afterwards inherit the mask and only the capture
+ * signal thread takes them.
+ * return 0 if success, -1 on failure
+ */
+int start_capture(void){
+    static sigset_t stop_signals;
+    pthread_t writer, stopper;
+    if(capture_open(config.capture_file) < 0){
+        return -1;
+    }
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    if(pthread_create(&writer, NULL, capture_thread, NULL) != 0){
+        perror("Failed to create capture thread");
+        return -1;
+    }
+    pthread_detach(writer);
+    atexit(capture_flush);
+    if(pthread_create(&stopper, NULL, capture_signal_thread, &stop_signals) != 0){
+        perror("Failed to create capture signal thread");
+        return -1;
+    }
+    pthread_detach(stopper);
+    return 0;
+}
+
+/**
+ * Checkpoint thread function: write a checkpoint every interval
+ * @param arg: pointer to the thread argument (unused)
+ */
+void *checkpoint_thread(void *arg){
+    (void)arg;
+    while(1){
+        sleep(config.checkpoint_interval);
+        write_checkpoint(config.checkpoint_file);
+    }
+    return NULL;
+}
+
+/**
+ * Session producer thread: appends a test message to its session every
+ * second, sending it right away if a connection is attached. The message
+ * is copied out and sent without the session lock, so a client that stops
+ * reading stalls only its producer, not ACK processing. Messages
+ * produced while detached wait in the ring for the client to resume.
+ * The session is freed after SESSION_TIMEOUT seconds without a connection.
+ * @param arg: pointer to the session
+ */
+void *session_thread(void *arg){
+    session_t *sess = (session_t *)arg;
+    while(1){
+        sleep(1);
+        pthread_mutex_lock(&sessions_mutex);
+        pthread_mutex_lock(&sess->mutex);
+        if(sess->connfd < 0 && time(NULL) - sess->detached_at > SESSION_TIMEOUT){
+            printf("[SERVER] Session %" PRIu64 " expired\n", sess->id);
+            free(sess->ring);
+            sess->ring = NULL;
+            sess->id = 0;
+            pthread_mutex_unlock(&sess->mutex);
+            pthread_mutex_unlock(&sessions_mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&sessions_mutex);
+
+        uint64_t seq = sess->next_seq++;
+        if(seq >= sess->acked_seq + config.session_ring){
+            sess->overwritten++;    // the client is too far behind, drop its oldest message
+            sess->acked_seq = seq - config.session_ring + 1;
+        }
+        session_msg_t *msg = &sess->ring[seq % config.session_ring];
+        msg->seq = seq;
+        msg->len = snprintf(msg->data, SESSION_MSG_LEN, "%" PRIu64 " Server test message #%" PRIu64 "\n", seq, seq);
+        session_msg_t out = *msg;
+        // dup so the descriptor stays ours even if the handler closes the
+        // connection and its number is reused before we send
+        // while a resume is being resent, session_attach sends this one too
+        int fd = sess->connfd >= 0 && !sess->resending ? dup(sess->connfd) : -1;
+        pthread_mutex_unlock(&sess->mutex);
+        if(fd >= 0){
+            if(send(fd, out.data, out.len, MSG_NOSIGNAL) < 0){
+                perror("Failed to send data");
+            }
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Attach a connection to a session, creating the session if the id is
+ * unknown, and resend everything the client has not received yet
+ * @param connfd: the connection file descriptor
+ * @param id: the session id from HELLO, 0 for a new session
+ * @param next_seq: the first sequence number the client has not received
+ * return the session (with its mutex released), NULL if the table is full
+ */
+session_t *session_attach(int connfd, uint64_t id, uint64_t next_seq){
+    static uint64_t id_counter = 0;
+    session_t *sess = NULL, *free_slot = NULL;
+    pthread_mutex_lock(&sessions_mutex);
+    for(int i = 0; i < MAX_SESSIONS && id != 0; i++){
+        if(sessions[i].id == id){
+            sess = &sessions[i];
+            break;
+        }
+    }
+    for(int i = 0; i < MAX_SESSIONS && sess == NULL && free_slot == NULL; i++){
+        if(sessions[i].id == 0 && sessions[i].ring == NULL){
+            free_slot = &sessions[i];
+        }
+    }
+    if(sess == NULL){
+        if(free_slot == NULL || (free_slot->ring = calloc(config.session_ring, sizeof(session_msg_t))) == NULL){
+            pthread_mutex_unlock(&sessions_mutex);
+            return NULL;
+        }
+        sess = free_slot;
+        sess->id = ((uint64_t)time(NULL) << 20) | (++id_counter & 0xFFFFF);
+        sess->connfd = -1;
+        sess->next_seq = sess->acked_seq = next_seq = 0;
+        sess->overwritten = 0;
+        pthread_t producer;
+        if(pthread_create(&producer, NULL, session_thread, sess) != 0){
+            perror("Failed to create session thread");
+            free(sess->ring);
+            sess->ring = NULL;
+            sess->id = 0;
+            pthread_mutex_unlock(&sessions_mutex);
+            return NULL;
+        }
+        pthread_detach(producer);
+        printf("[SERVER] Session %" PRIu64 " created for connection %d\n", sess->id, connfd);
+    }
+    pthread_mutex_lock(&sess->mutex);
+    pthread_mutex_unlock(&sessions_mutex);
+
+    if(sess->connfd >= 0){
+        shutdown(sess->connfd, SHUT_RDWR); // the client reconnected, drop the stale connection
+    }
+    sess->connfd = connfd;
+    // resume from what the client has, bounded by what the ring still holds
+    uint64_t oldest = sess->next_seq > (uint64_t)config.session_ring ? sess->next_seq - config.session_ring : 0;
+    if(oldest < sess->acked_seq){
+        oldest = sess->acked_seq;
+    }
+    uint64_t resume = next_seq < oldest ? oldest : next_seq;
+    if(resume > sess->next_seq){
+        resume = sess->next_seq;
+    }
+    sess->acked_seq = resume;   // HELLO acknowledges everything before next_seq
+    uint64_t from = resume, resent = sess->next_seq - resume;
+    char reply[SESSION_MSG_LEN];
+    int len = snprintf(reply, sizeof(reply), "SESSION %" PRIu64 " %" PRIu64 "\n", sess->id, resume);
+    // send from a copy, without the lock: a client that reads slowly must
+    // not hold up its producer, which waits for the lock holding
+    // sessions_mutex. Messages produced meanwhile are picked up by the
+    // next pass, so the connection sees them in order.
+    sess->resending = 1;
+    int fd = dup(connfd);
+    int failed = fd < 0 || send(fd, reply, len, MSG_NOSIGNAL) < 0;
+    session_msg_t *copy = malloc(config.session_ring * sizeof(session_msg_t));
+    failed |= copy == NULL;
+    while(!failed && resume < sess->next_seq){
+        int count = 0;
+        for(uint64_t seq = resume; seq < sess->next_seq; seq++){
+            copy[count++] = sess->ring[seq % config.session_ring];
+        }
+        resume = sess->next_seq;
+        pthread_mutex_unlock(&sess->mutex);
+        for(int i = 0; i < count && !failed; i++){
+            failed = send(fd, copy[i].data, copy[i].len, MSG_NOSIGNAL) < 0;
+        }
+        pthread_mutex_lock(&sess->mutex);
+        // messages pushed out of the ring meanwhile are lost to this client
+        if(resume < sess->acked_seq){
+            resume = sess->acked_seq;
+        }
+    }
+    sess->resending = 0;
+    free(copy);
+    if(fd >= 0){
+        close(fd);
+    }
+    printf("[SERVER] Session %" PRIu64 " attached to connection %d, resending %" PRIu64 " messages from #%" PRIu64 "\n",
+            sess->id, connfd, resent, from);
+    pthread_mutex_unlock(&sess->mutex);
+    return sess;
+}
+
+/**
+ * Serve a connection in session mode: the first line must be HELLO,
+ * then ACK lines release retransmit slots and any other line is data
+ * @param pool: receive buffer pool, for the capture
+ * @param connfd: the connection file descriptor
+ */
+void handle_session_connection(frame_buf_pool_t *pool, int connfd){
+    char buffer[BUFFER_SIZE];
+    size_t have = 0;
+    ssize_t n;
+    session_t *sess = NULL;
+    uint32_t capture_id = capture_conn_id();
+    while((n = recv(connfd, buffer + have, BUFFER_SIZE - 1 - have, 0)) > 0){
+        capture_copy(pool, capture_id, buffer + have, n);
+        have += n;
+        char *line = buffer, *nl;
+        while((nl = memchr(line, '\n', buffer + have - line)) != NULL){
+            *nl = '\0';
+            unsigned long a, b;
+            if(sess == NULL){
+                if(sscanf(line, "HELLO %lu %lu", &a, &b) != 2 ||
+                   (sess = session_attach(connfd, a, b)) == NULL){
+                    printf("[SERVER] Connection %d: bad HELLO or session table full\n", connfd);
+                    close(connfd);
+                    return;
+                }
+            }else if(sscanf(line, "ACK %lu", &a) == 1){
+                pthread_mutex_lock(&sess->mutex);
+                if(a > sess->acked_seq && a <= sess->next_seq){
+                    sess->acked_seq = a;
+                }
+                pthread_mutex_unlock(&sess->mutex);
+            }else{
+                aggregate_frame((uint8_t *)line, nl - line);
+                printf("[SERVER] Received from session %" PRIu64 ": %s\n", sess->id, line);
+            }
+            line = nl + 1;
+        }
+        have -= line - buffer;
+        if(have == BUFFER_SIZE - 1){
+            have = 0;   // no newline in a full buffer: drop the overlong line
+        }
+        memmove(buffer, line, have);
+    }
+    if(n < 0){
+        perror("Failed to receive data from connection");
+    }
+    if(sess){
+        pthread_mutex_lock(&sess->mutex);
+        if(sess->connfd == connfd){
+            sess->connfd = -1;
+            sess->detached_at = time(NULL);
+        }
+        printf("[SERVER] Connection %d detached from session %" PRIu64 " (acked up to #%" PRIu64 ")\n",
+                connfd, sess->id, sess->acked_seq);
+        close(connfd);
+        pthread_mutex_unlock(&sess->mutex);
+    }else{
+        close(connfd);
+    }
+}
+
+/**
+ * Consume received bytes of a binary frame connection. Payload bytes are
+ * handed to the streaming kernels straight from the receive buffer and the
+ * frame is aggregated when its last byte arrives, unless its CRC32C
+ * trailer does not match.
+ * @param rx: the connection's frame state
+ * @param connfd: the connection file descriptor, for logging
+ * @param data: received bytes
+ * @param len: number of received bytes
+ * return 0 if success, -1 on an invalid frame header
+ */
+int frame_rx_consume(frame_rx_t *rx, int connfd, const uint8_t *data, size_t len){
+    static const uint8_t search_pattern[] = { SEARCH_BYTE };
+    while(len > 0){
+        if(!rx->in_payload){
+            size_t take = FRAME_HDR_LEN - rx->hdr_got;
+            if(take > len) take = len;
+            memcpy(rx->hdr_buf + rx->hdr_got, data, take);
+            rx->hdr_got += take;
+            data += take;
+            len -= take;
+            if(rx->hdr_got < FRAME_HDR_LEN){
+                break;
+            }
+            if(frame_decode_hdr(rx->hdr_buf, &rx->hdr) < 0){
+                return -1;
+            }
+            rx->hdr_got = 0;
+            rx->payload_got = 0;
+            rx->trailer_got = 0;
+            rx->in_payload = 1;
+            rx->crc = crc32c(0, rx->hdr_buf, FRAME_HDR_LEN);
+            distinct_stream_init(&rx->distinct);
+            search_stream_init(&rx->search, search_pattern, sizeof(search_pattern));
+        }
+        // runs even when the header used up the chunk, so a zero-length
+        // frame is finished here as soon as its header is complete
+        size_t take = rx->hdr.len - rx->payload_got;
+        if(take > len) take = len;
+        distinct_stream_update(&rx->distinct, data, take);
+        search_stream_update(&rx->search, data, take);
+        if(rx->hdr.flags & FRAME_FLAG_CRC){
+            rx->crc = crc32c(rx->crc, data, take);
+        }
+        rx->payload_got += take;
+        data += take;
+        len -= take;
+        if(rx->payload_got < rx->hdr.len){
+            break;
+        }
+        if(rx->hdr.flags & FRAME_FLAG_CRC){
+            take = FRAME_CRC_LEN - rx->trailer_got;
+            if(take > len) take = len;
+            memcpy(rx->trailer + rx->trailer_got, data, take);
+            rx->trailer_got += take;
+            data += take;
+            len -= take;
+            if(rx->trailer_got < FRAME_CRC_LEN){
+                break;
+            }
+            uint32_t sent;
+            memcpy(&sent, rx->trailer, FRAME_CRC_LEN);
+            if(ntohl(sent) != rx->crc){
+                printf("[SERVER] CRC mismatch on %u-byte frame from connection %d, dropped\n",
+                        rx->hdr.len, connfd);
+                rx->in_payload = 0;
+                continue;
+            }
+        }
+        uint8_t distinct[256];
+        int distinct_len;
+        distinct_stream_final(&rx->distinct, distinct, &distinct_len);
+        aggregate_distinct(distinct, distinct_len, rx->hdr.len);
+        printf("[SERVER] Frame of %u bytes from connection %d: %d distinct bytes, byte %d first at %lld\n",
+                rx->hdr.len, connfd, distinct_len, SEARCH_BYTE, (long long)rx->search.found);
+        rx->in_payload = 0;
+    }
+    return 0;
+}
+
+/**
+ * Bytes of an unfinished frame a connection holds over
+ * @param rx: the connection's frame state
+ * return the bytes received of the current frame, header included
+ */
+static inline uint32_t frame_rx_pending(const frame_rx_t *rx){
+    return rx->in_payload ? FRAME_HDR_LEN + rx->payload_got + rx->trailer_got : rx->hdr_got;
+}
+
+/**
+ * Line mode callback: aggregate one line and parse its numeric fields
+ * @param ctx: the connection's line_rx_t
+ * @param line: the line, without its '\n'
+ * @param len: the line length
+ */
+void line_rx_line(void *ctx, const char *line, size_t len){
+    line_rx_t *lr = ctx;
+    aggregate_frame((uint8_t *)line, len);
+    lr->num_fields = parse_line_fields(line, len, lr->fields, LINE_MAX_FIELDS);
+    size_t shown = len < LINE_PREVIEW_LEN ? len : LINE_PREVIEW_LEN;
+    memcpy(lr->last, line, shown);
+    lr->last[shown] = '\0';
+    lr->lines++;
+}
+
+/**
+ * Parse a CPU list like "0-3,6" into a CPU set
+ * @param str: the CPU list
+ * @param cpus: the CPU set to fill
+ * return 0 if success, -1 if the list is malformed
+ */
+int parse_cpu_list(const char *str, cpu_set_t *cpus){
+    CPU_ZERO(cpus);
+    while(*str){
+        char *end;
+        long first = strtol(str, &end, 10), last = first;
+        if(end == str || first < 0){
+            return -1;
+        }
+        if(*end == '-'){
+            str = end + 1;
+            last = strtol(str, &end, 10);
+            if(end == str || last < first){
+                return -1;
+            }
+        }
+        if(last >= CPU_SETSIZE){
+            return -1;
+        }
+        for(long c = first; c <= last; c++){
+            CPU_SET(c, cpus);
+        }
+        if(*end == ','){
+            end++;
+        }else if(*end != '\0'){
+            return -1;
+        }
+        str = end;
+    }
+    return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+/**
+ * Read a small sysfs file
+ * @param path: the file
+ * @param buf: receives the contents, NUL-terminated, trailing newline removed
+ * @param len: size of buf
+ * return 0 if success, -1 if it cannot be read
+ */
+int read_sys_file(const char *path, char *buf, size_t len){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0){
+        return -1;
+    }
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    if(n < 0){
+        return -1;
+    }
+    while(n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' ')){
+        n--;
+    }
+    buf[n] = '\0';
+    return 0;
+}
+
+/**
+ * Find the NUMA nodes that have CPUs and map each CPU to its node. Memory
+ * only nodes are skipped. Without node information in sysfs everything
+ * is one node.
+ * return the number of nodes
+ */
+int numa_discover(void){
+    char buf[BUFFER_SIZE], path[128];
+    cpu_set_t online;
+    int n = 0;
+    memset(cpu_node, 0, sizeof(cpu_node));
+    if(read_sys_file(NODE_SYSFS "/online", buf, sizeof(buf)) < 0 || parse_cpu_list(buf, &online) < 0){
+        return 1;
+    }
+    for(int id = 0; id < CPU_SETSIZE && n < MAX_NUMA_NODES; id++){
+        if(!CPU_ISSET(id, &online)){
+            continue;
+        }
+        snprintf(path, sizeof(path), NODE_SYSFS "/node%d/cpulist", id);
+        if(read_sys_file(path, buf, sizeof(buf)) < 0 || parse_cpu_list(buf, &numa_nodes[n].cpus) < 0){
+            continue;
+        }
+        numa_nodes[n].id = id;
+        for(int c = 0; c < CPU_SETSIZE; c++){
+            if(CPU_ISSET(c, &numa_nodes[n].cpus)){
+                cpu_node[c] = n;
+            }
+        }
+        n++;
+    }
+    return n > 0 ? n : 1;
+}
+
+/**
+ * The NUMA node whose CPU processes a connection's incoming packets: the
+ * CPU its NIC receive queue interrupt is steered to
+ * @param fd: the connection
+ * return the node index, -1 if unknown
+ */
+int connection_node(int fd){
+#ifdef SO_INCOMING_CPU
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if(num_numa_nodes > 1 && getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+       cpu >= 0 && cpu < CPU_SETSIZE){
+        return cpu_node[cpu];
+    }
+#else
+    (void)fd;
+#endif
+    return -1;
+}
+
+/**
+ * Read a node's cross-node page allocation counters from numastat
+ * @param node: the node
+ * @param miss: pages placed on this node although another was preferred
+ * @param other: pages placed on this node for a task running elsewhere
+ * return 0 if success, -1 if unavailable
+ */
+int numa_read_stat(const numa_node_t *node, uint64_t *miss, uint64_t *other){
+    char buf[BUFFER_SIZE], path[128];
+    snprintf(path, sizeof(path), NODE_SYSFS "/node%d/numastat", node->id);
+    if(read_sys_file(path, buf, sizeof(buf)) < 0){
+        return -1;
+    }
+    const char *m = strstr(buf, "numa_miss "), *o = strstr(buf, "other_node ");
+    if(m == NULL || o == NULL){
+        return -1;
+    }
+    *miss = strtoull(m + 10, NULL, 10);
+    *other = strtoull(o + 11, NULL, 10);
+    return 0;
+}
+
+/**
+ * NUMA stats thread: every STATS_INTERVAL seconds, per node, the
+ * connections served and how many arrived on another node's CPU, and
+ * the growth of the kernel's cross-node allocation counters
+ * @param arg: pointer to the thread argument (unused)
+ */
+void *numa_stats_thread(void *arg){
+    (void)arg;
+    for(int n = 0; n < num_numa_nodes; n++){
+        numa_read_stat(&numa_nodes[n], &numa_nodes[n].last_miss, &numa_nodes[n].last_other);
+    }
+    while(1){
+        sleep(STATS_INTERVAL);
+        for(int n = 0; n < num_numa_nodes; n++){
+            numa_node_t *node = &numa_nodes[n];
+            uint64_t miss = node->last_miss, other = node->last_other;
+            numa_read_stat(node, &miss, &other);
+            printf("[STATS] node%d: connections=%" PRIu64 " remote=%" PRIu64 " bytes=%" PRIu64
+                   " numa_miss=+%" PRIu64 " other_node=+%" PRIu64 "\n",
+                    node->id, __atomic_load_n(&node->connections, __ATOMIC_RELAXED),
+                    __atomic_load_n(&node->remote, __ATOMIC_RELAXED),
+                    __atomic_load_n(&node->bytes, __ATOMIC_RELAXED),
+                    miss - node->last_miss, other - node->last_other);
+            node->last_miss = miss;
+            node->last_other = other;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Serve one connection until the client closes it. In a coroutine worker
+ * this runs as the connection's coroutine: co_read and co_close only
+ * suspend it, and behave as read() and close() for a worker thread.
+ * @param w: the worker serving it
+ * @param cs: the connection's state
+ * @param connfd: the connection file descriptor
+ */
+void handle_connection(worker_t *w, conn_state_t *cs, int connfd){
+    ssize_t n;
+
+    if(config.session_ring > 0){
+        handle_session_connection(w->rx_pool, connfd);
+        return;
+    }
+
+    // relayed streams belong to the upstream: no test messages on them
+    if(config.relay || config.backends_file){
+        ssize_t forwarded = config.relay ? relay_connection(&upstream, connfd, w->pipefd, NULL, 0)
+                                         : route_connection(connfd, w->pipefd);
+        if(forwarded < 0){
+            printf("[SERVER] Upstream unavailable or failed, dropping connection %d\n", connfd);
+        }else{
+            printf("[SERVER] Connection %d closed, relayed %zd bytes upstream\n", connfd, forwarded);
+        }
+        close(connfd);
+        return;
+    }
+
+    // create a sender thread (or coroutine) for this connection
+    co_t *sender = NULL;
+    if(co_self()){
+        if((sender = co_spawn(NULL, sender_coroutine, (void *)(intptr_t)connfd, 1)) == NULL){
+            perror("Failed to create sender coroutine");
+        }
+    }else{
+        pthread_t send_thread;
+        int *conn_arg = malloc(sizeof(int));
+        *conn_arg = connfd;
+        if(pthread_create(&send_thread, NULL, sender_thread, conn_arg) != 0){
+            perror("Failed to create sender thread");
+            free(conn_arg);
+        }else{
+            pthread_detach(send_thread); // detach the sender thread
+        }
+    }
+
+    // Process the data from the connection. Each chunk is received into a
+    // pooled buffer that the capture can keep a reference to, so it is
+    // written to memory once and read in place by every consumer.
+    memset(cs, 0, offsetof(conn_state_t, frames));
+    cs->fd = connfd;
+    if((cs->capture_id = capture_conn_id()) != 0){
+        printf("[SERVER] Connection %d captured as conn %u\n", connfd, cs->capture_id);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &cs->opened);
+    while(1){
+        if(cs->buf == NULL || !frame_buf_exclusive(cs->buf)){
+            // the capture still holds the last chunk: receive into another buffer
+            frame_buf_release(cs->buf);
+            if((cs->buf = frame_buf_alloc(w->rx_pool, BUFFER_SIZE)) == NULL){
+                perror("Failed to allocate receive buffer");
+                n = 0;
+                break;
+            }
+        }
+        char *buffer = (char *)cs->buf->data;
+        if((n = co_read(connfd, buffer, BUFFER_SIZE)) <= 0){
+            break;
+        }
+        cs->buf->len = n;
+        capture_record(cs->capture_id, cs->buf, 0, n);
+        cs->chunks++;
+        cs->bytes += n;
+        size_t held = 0;    // bytes of earlier chunks to process before this one
+        if(cs->mode == CONN_NEW){
+            // the first 4 bytes decide how the connection is read. A short
+            // first read that may still be FRAME_MAGIC is held back until
+            // enough has arrived to tell.
+            uint32_t magic = htonl(FRAME_MAGIC);
+            size_t have = cs->head_len + (size_t)n;
+            if(have < 4 && memcmp(cs->head, &magic, cs->head_len) == 0 &&
+               memcmp(buffer, (uint8_t *)&magic + cs->head_len, n) == 0){
+                memcpy(cs->head + cs->head_len, buffer, n);
+                cs->head_len = have;
+                cs->pending = have;
+                continue;
+            }
+            held = cs->head_len;
+            if(have >= 4 && memcmp(cs->head, &magic, held) == 0 &&
+               memcmp(buffer, (uint8_t *)&magic + held, 4 - held) == 0){
+                cs->mode = CONN_FRAMES;
+                memset(&cs->frames, 0, sizeof(frame_rx_t));
+            }else if(config.line_mode){
+                cs->mode = CONN_LINES;
+                memset(&cs->lines, 0, sizeof(line_rx_t));
+                line_splitter_init(&cs->lines.splitter, MAX_LINE_LEN);
+            }else{
+                cs->mode = CONN_TEXT;
+            }
+        }
+        if(cs->mode == CONN_FRAMES){
+            frame_rx_t *rx = &cs->frames;
+            if(frame_rx_consume(rx, connfd, cs->head, held) < 0 ||
+               frame_rx_consume(rx, connfd, (uint8_t *)buffer, n) < 0){
+                printf("[SERVER] Invalid frame header from connection %d\n", connfd);
+                break;
+            }
+            cs->pending = frame_rx_pending(rx);
+            continue;
+        }
+        if(cs->mode == CONN_LINES){
+            line_rx_t *lr = &cs->lines;
+            lr->lines = 0;
+            if(held > 0){
+                line_splitter_feed(&lr->splitter, (char *)cs->head, held, line_rx_line, lr);
+            }
+            line_splitter_feed(&lr->splitter, buffer, n, line_rx_line, lr);
+            cs->pending = lr->splitter.partial_len;
+            if(lr->lines > 0){
+                printf("[SERVER] Received %" PRIu64 " lines (%zd bytes) from connection %d, last: %s [%d fields",
+                        lr->lines, n, connfd, lr->last, lr->num_fields);
+                for(int i = 0; i < lr->num_fields && i < LINE_MAX_FIELDS; i++){
+                    printf("%s%" PRIu64, i ? " " : ": ", lr->fields[i]);
+                }
+                printf("]\n");
+            }
+            continue;
+        }
+        // // read data from the connection
+        if(held > 0){
+            aggregate_frame(cs->head, held);
+        }
+        aggregate_frame((uint8_t *)buffer, n);
+        int shown = n > 0 && buffer[n - 1] == '\n' ? n - 1 : n;   // clients end messages with '\n'
+        printf("[SERVER] Received %zd bytes from connection %d: %.*s%.*s\n", n + (ssize_t)held, connfd,
+                (int)held, (char *)cs->head, shown, buffer);
+    }
+    if(n < 0){
+        perror("Failed to receive data from connection");
+    }else if(n == 0){
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        printf("[SERVER] Connection %d closed by client after %" PRIu64 " bytes in %" PRIu64 " chunks (%.1f s)\n",
+                connfd, cs->bytes, cs->chunks,
+                (now.tv_sec - cs->opened.tv_sec) + (now.tv_nsec - cs->opened.tv_nsec) / 1e9);
+        if(cs->pending > 0){
+            printf("[SERVER] Connection %d: %u bytes of an unfinished %s discarded\n",
+                    connfd, cs->pending, cs->mode == CONN_FRAMES ? "frame" : "line");
+        }
+    }
+    if(cs->mode == CONN_LINES){
+        if(cs->lines.splitter.overlong > 0){
+            printf("[SERVER] Connection %d: %" PRIu64 " lines over %d bytes dropped\n",
+                    connfd, cs->lines.splitter.overlong, MAX_LINE_LEN);
+        }
+        line_splitter_free(&cs->lines.splitter);
+    }
+    if(w->group->node >= 0){
+        numa_node_t *node = &numa_nodes[w->group->node];
+        int arrival = connection_node(connfd);
+        __atomic_fetch_add(&node->connections, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&node->bytes, cs->bytes, __ATOMIC_RELAXED);
+        if(arrival >= 0 && arrival != w->group->node){
+            __atomic_fetch_add(&node->remote, 1, __ATOMIC_RELAXED);
+        }
+    }
+    frame_buf_release(cs->buf);
+    cs->buf = NULL;
+    if(sender){
+        co_cancel(sender);
+        co_join(sender);
+    }
+    co_close(connfd); // close the connection
+}
+
+/**
+ * Serve a dequeued connection, keeping the tenant's load counters
+ * @param w: the worker serving it
+ * @param cs: the connection's state
+ * @param connfd: the connection file descriptor
+ * @param tenant: index of the tenant owning the connection
+ */
+void serve_connection(worker_t *w, conn_state_t *cs, int connfd, int tenant){
+    worker_group_t *group = w->group;
+    w->connections++;
+    printf("[SERVER]Worker thread (%s) processing connection %d (its #%" PRIu64 ")\n",
+            group->tenant ? group->tenant->name : "overflow", connfd, w->connections);
+
+    if(group->tenant){
+        __atomic_fetch_add(&group->tenant->busy, 1, __ATOMIC_RELAXED);
+    }
+    handle_connection(w, cs, connfd);
+    if(group->tenant){
+        __atomic_fetch_sub(&group->tenant->busy, 1, __ATOMIC_RELAXED);
+    }else{
+        __atomic_fetch_sub(&tenants[tenant].in_overflow, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Connection coroutine (coroutine workers): serve one connection with its
+ * own state, then make room for the next one
+ * @param arg: the conn_task_t, freed here
+ */
+void connection_coroutine(void *arg){
+    conn_task_t task = *(conn_task_t *)arg;
+    free(arg);
+    conn_state_t *cs = aligned_alloc(CACHE_LINE, sizeof(conn_state_t));
+    if(cs == NULL){
+        perror("Failed to allocate connection state");
+        co_close(task.connfd);
+    }else{
+        serve_connection(task.w, cs, task.connfd, task.tenant);
+        free(cs);
+    }
+    if(task.w->open-- == config.coroutines){
+        co_wake(task.w->intake);
+    }
+}
+
+/**
+ * Intake coroutine (coroutine workers): take connections off the group's
+ * queue while the worker has room, one eventfd token per connection, and
+ * start a coroutine for each
+ * @param arg: the worker_t
+ */
+void intake_coroutine(void *arg){
+    worker_t *w = arg;
+    conn_queue_t *q = w->group->queue;
+    while(1){
+        if(w->open == config.coroutines){
+            co_park();  // woken by a connection coroutine as it finishes
+            continue;
+        }
+        uint64_t token;
+        if(co_read(q->notify_fd, &token, sizeof(token)) < 0){
+            perror("Failed to wait for connections");
+            return;
+        }
+        int tenant;
+        int connfd = try_dequeue(q, &tenant);
+        if(connfd < 0){
+            continue;
+        }
+        conn_task_t *task = malloc(sizeof(conn_task_t));
+        if(task == NULL){
+            perror("Failed to allocate connection task");
+            close(connfd);
+            continue;
+        }
+        *task = (conn_task_t){ .w = w, .connfd = connfd, .tenant = tenant };
+        w->open++;
+        if(co_spawn(NULL, connection_coroutine, task, 0) == NULL){
+            perror("Failed to create connection coroutine");
+            free(task);
+            close(connfd);
+            w->open--;
+        }
+    }
+}
+
+/**
+ * Run a coroutine worker: the intake and every connection it takes are
+ * coroutines on this thread's scheduler
+ * @param w: the worker
+ */
+void run_worker_coroutines(worker_t *w){
+    co_sched_t *sched = co_sched_create(0);
+    if(sched == NULL || (w->intake = co_spawn(sched, intake_coroutine, w, 0)) == NULL){
+        perror("Failed to start coroutine worker");
+        return;
+    }
+    if(co_sched_run(sched) < 0){
+        perror("Coroutine worker failed");
+    }
+}
+
+/**
+ * Worker thread function: continuously dequeue a connection and process data
+ * @param arg: pointer to the worker_t of the thread
+ */
+void *worker_thread(void *arg){
+    worker_t *w = (worker_t *)arg;
+    worker_group_t *group = w->group;
+    w->pipefd[0] = w->pipefd[1] = -1;
+    if((config.relay || config.backends_file) && pipe(w->pipefd) < 0){
+        perror("Failed to create relay pipe");
+        return NULL;
+    }
+    if(group->pinned && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &group->cpus) != 0){
+        fprintf(stderr, "Failed to pin worker thread to its CPU set\n");
+    }
+    if(config.coroutines > 0){
+        run_worker_coroutines(w);
+        return NULL;
+    }
+    // allocated by the worker itself once pinned, from its own malloc arena
+    if((w->conn = aligned_alloc(CACHE_LINE, sizeof(conn_state_t))) == NULL){
+        perror("Failed to allocate connection state");
+        return NULL;
+    }
+    while(1){
+        // get a connection from the group's queue (blocking if none available)
+        int tenant;
+        int connfd = dequeue(group->queue, &tenant);
+        serve_connection(w, w->conn, connfd, tenant);
+    }
+    return NULL;
+}
+
+/**
+ * Hand a new connection to its tenant's workers, or to the shared overflow
+ * pool when all of the tenant's workers are busy. A tenant is capped at half
+ * of the overflow pool so one tenant's burst cannot take all of it; the cap
+ * is per tenant, and two tenants bursting at once may share the whole pool.
+ * @param t: index of the tenant the connection arrived on
+ * @param connfd: the connection file descriptor
+ */
+void dispatch_connection(int t, int connfd){
+    tenant_t *tenant = &tenants[t];
+    conn_queue_t *q = tenant->queue;
+    if(tenant->by_node){
+        // to the workers on the node where the connection's packets land
+        int node = connection_node(connfd);
+        if(node < 0){
+            node = tenant->next_node++ % num_numa_nodes;
+        }
+        q = tenant->node_queue[node];
+    }
+    // a coroutine worker takes config.coroutines connections at once
+    int per_worker = config.coroutines > 0 ? config.coroutines : 1;
+    int max_overflow = (config.overflow_workers * per_worker + 1) / 2;
+    int waiting = __atomic_load_n(&tenant->busy, __ATOMIC_RELAXED) +
+                  __atomic_load_n(&q->length, __ATOMIC_RELAXED);
+    if(waiting >= tenant->num_workers * per_worker &&
+       __atomic_load_n(&tenant->in_overflow, __ATOMIC_RELAXED) < max_overflow){
+        __atomic_fetch_add(&tenant->in_overflow, 1, __ATOMIC_RELAXED);
+        enqueue(&overflow_queue, connfd, t);
+        return;
+    }
+    enqueue(q, connfd, t);
+}
+
+/**
+ * Parse a tenant specification "name:port:workers[:cpus]" into the next tenant slot
+ * @param spec: the specification
+ * return 0 if success, -1 if the specification is malformed
+ */
+int parse_tenant(const char *spec){
+    if(num_tenants == MAX_TENANTS){
+        return -1;
+    }
+    tenant_t *t = &tenants[num_tenants];
+    memset(t, 0, sizeof(*t));
+    const char *p1 = strchr(spec, ':');
+    const char *p2 = p1 ? strchr(p1 + 1, ':') : NULL;
+    if(p1 == NULL || p2 == NULL || p1 == spec || (size_t)(p1 - spec) >= sizeof(t->name)){
+        return -1;
+    }
+    memcpy(t->name, spec, p1 - spec);
+    t->port = atoi(p1 + 1);
+    t->num_workers = atoi(p2 + 1);
+    if(t->port <= 0 || t->port > 65535 || t->num_workers < 1 || t->num_workers > MAX_GROUP_WORKERS){
+        return -1;
+    }
+    const char *p3 = strchr(p2 + 1, ':');
+    if(p3 != NULL){
+        if(parse_cpu_list(p3 + 1, &t->cpus) < 0){
+            return -1;
+        }
+        t->pinned = 1;
+    }
+    num_tenants++;
+    return 0;
+}
+
+/**
+ * Start a group of worker threads
+ * @param group: the group, must stay valid for the lifetime of the threads
+ * @param count: the number of threads
+ * return 0 if success, -1 if a thread could not be created
+ */
+int start_worker_group(worker_group_t *group, int count){
+    if(count > 0 && (group->workers = aligned_alloc(CACHE_LINE, count * sizeof(worker_t))) == NULL){
+        perror("Failed to allocate worker state");
+        return -1;
+    }
+    for(int i = 0; i < count; i++){
+        pthread_t worker;
+        memset(&group->workers[i], 0, sizeof(worker_t));
+        group->workers[i].group = group;
+        group->workers[i].rx_pool = group->node >= 0 ? numa_nodes[group->node].rx_pool : rx_pool;
+        if(pthread_create(&worker, NULL, worker_thread, &group->workers[i]) != 0){
+            perror("pthread_create failed");
+            return -1;
+        }
+        pthread_detach(worker); // detach threads for independent cleanup
+    }
+    return 0;
+}
+
+/**
+ * Create a TCP socket listening on all local addresses
+ * @param port: the port to listen on
+ * return the listening socket, -1 on failure
+ */
+int create_listen_socket(int port){
+    int opt = 1;
+    int sockfd;
+    struct sockaddr_in serv_addr;
+
+    // create a TCP socket
+    if((sockfd = socket(AF_INET, SOCK_STREAM, 0)) < 0){
+        perror("Failed to create socket");
+        return -1;
+    }
+    // set socket options to reuse address and port
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+    // Configure the server address (bind to all local IP addresses)
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = INADDR_ANY;
+    serv_addr.sin_port = htons(port);
 
     // Bind the socket to the specified port
     if(bind(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0){
         perror("Failed to bind socket");
         close(sockfd);
+        return -1;
+    }
+
+    // Set the socket to listen for incoming connections
+    if(listen(sockfd, BACKLOG) < 0){
+        perror("Failed to listen for connections");
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+/**
+ * Worker process main loop (prefork mode): accept from this process's own
+ * SO_REUSEPORT listening socket and serve connections with epoll. Every
+ * second each connection gets a test message, like sender_thread does in
+ * threaded mode.
+ * @param stats: this process's slot in the shared stats segment
+ */
+void worker_process(process_stats_t *stats){
+    // one listening socket per process: the kernel spreads new connections
+    // across the SO_REUSEPORT group, where a single shared socket would keep
+    // waking the same process
+    int listenfd = create_listen_socket(config.port);
+    if(listenfd < 0){
+        exit(EXIT_FAILURE);
+    }
+    fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL) | O_NONBLOCK);
+
+    int epfd = epoll_create1(0);
+    if(epfd < 0){
+        perror("Failed to create epoll instance");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = listenfd };
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0){
+        perror("Failed to watch listening socket");
+        exit(EXIT_FAILURE);
+    }
+
+    int conns[MAX_CLIENTS];
+    int num_conns = 0;
+    int counter = 0;
+    time_t last_tick = time(NULL);
+    struct epoll_event events[MAX_EVENTS];
+    char buffer[BUFFER_SIZE];
+    pid_t pid = getpid();
+
+    while(1){
+        int nev = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+        if(nev < 0 && errno != EINTR){
+            perror("epoll_wait failed");
+            exit(EXIT_FAILURE);
+        }
+        for(int i = 0; i < nev; i++){
+            int fd = events[i].data.fd;
+            if(fd == listenfd){
+                int connfd = accept(listenfd, NULL, NULL);
+                if(connfd < 0){
+                    continue;
+                }
+                if(num_conns == MAX_CLIENTS){
+                    printf("[WORKER %d] Maximum clients reached, connection rejected\n", pid);
+                    close(connfd);
+                    continue;
+                }
+                struct epoll_event cev = { .events = EPOLLIN, .data.fd = connfd };
+                if(epoll_ctl(epfd, EPOLL_CTL_ADD, connfd, &cev) < 0){
+                    perror("Failed to watch connection");
+                    close(connfd);
+                    continue;
+                }
+                conns[num_conns++] = connfd;
+                __atomic_fetch_add(&stats->accepted, 1, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&stats->active, 1, __ATOMIC_RELAXED);
+                printf("[WORKER %d] Processing connection %d\n", pid, connfd);
+                continue;
+            }
+
+            ssize_t n = recv(fd, buffer, BUFFER_SIZE - 1, 0);
+            if(n > 0){
+                buffer[n] = '\0';
+                __atomic_fetch_add(&stats->bytes_received, n, __ATOMIC_RELAXED);
+                __atomic_fetch_add(&stats->messages, 1, __ATOMIC_RELAXED);
+                printf("[WORKER %d] Received %zd bytes from connection %d: %s\n", pid, n, fd, buffer);
+                continue;
+            }
+            if(n < 0){
+                perror("Failed to receive data from connection");
+            }else{
+                printf("[WORKER %d] Connection %d closed by client\n", pid, fd);
+            }
+            close(fd); // also removes it from the epoll set
+            for(int j = 0; j < num_conns; j++){
+                if(conns[j] == fd){
+                    conns[j] = conns[--num_conns];
+                    break;
+                }
+            }
+            __atomic_fetch_sub(&stats->active, 1, __ATOMIC_RELAXED);
+        }
+
+        time_t now = time(NULL);
+        if(now != last_tick){
+            last_tick = now;
+            char message[BUFFER_SIZE];
+            int len = snprintf(message, BUFFER_SIZE, "Server test message #%d", counter++);
+            for(int j = 0; j < num_conns; j++){
+                if(send(conns[j], message, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0 && errno != EAGAIN){
+                    perror("Failed to send data");
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Fork a worker process into a stats slot
+ * @param slot: the stats slot index
+ * return the child pid, -1 if fork failed
+ */
+pid_t spawn_worker_process(int slot){
+    process_stats_t *stats = &process_stats[slot];
+    pid_t pid = fork();
+    if(pid == 0){
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGPIPE, SIG_IGN);   // a client that reset must not take the whole process down
+        stats->pid = getpid();
+        worker_process(stats);
+        _exit(EXIT_SUCCESS);
+    }
+    if(pid < 0){
+        perror("Failed to fork worker process");
+    }
+    return pid;
+}
+
+/**
+ * SIGINT/SIGTERM handler for the prefork supervisor
+ */
+void handle_shutdown(int sig){
+    (void)sig;
+    shutdown_requested = 1;
+}
+
+/**
+ * Prefork supervisor: start config.processes workers listening on the same
+ * port, restart any that die, and periodically print aggregate stats.
+ * Each child owns its accepted connections, so a crash only drops those
+ * (plus any connections still pending in its accept queue).
+ */
+void run_prefork(void){
+    int n = config.processes;
+    process_stats = mmap(NULL, n * sizeof(process_stats_t), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(process_stats == MAP_FAILED){
+        perror("Failed to map shared stats segment");
+        exit(EXIT_FAILURE);
+    }
+    memset(process_stats, 0, n * sizeof(process_stats_t));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_shutdown;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    fflush(stdout); // do not duplicate buffered output into the children
+    pid_t pids[MAX_WORKER_PROCESSES];
+    for(int i = 0; i < n; i++){
+        pids[i] = spawn_worker_process(i);
+    }
+
+    time_t last_report = time(NULL);
+    while(!shutdown_requested){
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if(pid > 0){
+            for(int i = 0; i < n; i++){
+                if(pids[i] != pid){
+                    continue;
+                }
+                if(WIFSIGNALED(status)){
+                    printf("Worker process %d killed by signal %d, restarting\n", pid, WTERMSIG(status));
+                }else{
+                    // exited on its own (e.g. could not bind): back off before retrying
+                    printf("Worker process %d exited with status %d, restarting\n", pid, WEXITSTATUS(status));
+                    sleep(1);
+                }
+                process_stats[i].restarts++;
+                process_stats[i].active = 0; // its connections died with it
+                process_stats[i].pid = 0;
+                fflush(stdout);
+                pids[i] = spawn_worker_process(i);
+                break;
+            }
+            continue;
+        }
+        // retry slots whose fork failed
+        for(int i = 0; i < n; i++){
+            if(pids[i] < 0){
+                pids[i] = spawn_worker_process(i);
+            }
+        }
+
+        time_t now = time(NULL);
+        if(now - last_report >= STATS_INTERVAL){
+            last_report = now;
+            uint64_t accepted = 0, active = 0, bytes = 0, messages = 0;
+            uint32_t restarts = 0;
+            for(int i = 0; i < n; i++){
+                accepted += __atomic_load_n(&process_stats[i].accepted, __ATOMIC_RELAXED);
+                active += __atomic_load_n(&process_stats[i].active, __ATOMIC_RELAXED);
+                bytes += __atomic_load_n(&process_stats[i].bytes_received, __ATOMIC_RELAXED);
+                messages += __atomic_load_n(&process_stats[i].messages, __ATOMIC_RELAXED);
+                restarts += process_stats[i].restarts;
+            }
+            printf("[STATS] processes=%d accepted=%" PRIu64 " active=%" PRIu64 " messages=%" PRIu64
+                   " bytes=%" PRIu64 " restarts=%u\n",
+                    n, accepted, active, messages, bytes, restarts);
+            fflush(stdout);
+        }
+        usleep(100 * 1000);
+    }
+
+    printf("Shutting down worker processes\n");
+    for(int i = 0; i < n; i++){
+        if(pids[i] > 0){
+            kill(pids[i], SIGTERM);
+        }
+    }
+    while(wait(NULL) > 0){
+    }
+    exit(EXIT_SUCCESS);
+}
+
+// a frame held by the sequencer. The buffer holds it encoded (header,
+// payload, CRC trailer) and is sent and captured as is, by reference.
+typedef struct seq_frame{
+    uint64_t ts_ns;             // source timestamp
+    uint32_t conn;              // capture id of the feed it arrived on
+    frame_buf_t *buf;           // the encoded frame, buf->len bytes
+    struct seq_frame *next;     // next frame of the same feed
+} seq_frame_t;
+
+// one feed connected to the sequencer
+typedef struct{
+    int fd;                     // connection, -1 once the feed closed
+    uint32_t capture_id;        // id the feed's frames are captured under
+    uint8_t hdr_buf[FRAME_HDR_LEN]; // header bytes received so far
+    uint32_t hdr_got;
+    seq_frame_t *cur;           // frame being received
+    uint32_t cur_got;           // bytes of cur received, header included
+    uint32_t payload_end;       // offset of cur's CRC trailer, 0 if it has none
+    uint32_t crc;               // CRC32C of the bytes of cur received so far
+    seq_frame_t *head, *tail;   // complete frames waiting to be merged, in arrival order
+    int heap_pos;               // position in the merge heap, -1 if no frames are waiting
+} seq_input_t;
+
+// sequencer state, owned by the single thread running run_sequencer()
+typedef struct{
+    seq_input_t *inputs;        // feed slots, indexed by epoll data
+    int num_slots;              // slots in use or freed (high-water mark)
+    int *free_slots;            // stack of reusable slots
+    int num_free;
+    int *heap;                  // min-heap of slots keyed by their head frame's timestamp
+    int heap_len;
+    int open_inputs;            // feeds still connected
+    int starved_inputs;         // connected feeds with no frame waiting
+    uint64_t max_seen_ns;       // newest timestamp received
+    uint64_t released_ns;       // timestamp of the last frame released
+    int subscribers[SEQ_MAX_SUBSCRIBERS];
+    int num_subscribers;
+    frame_buf_pool_t *pool;     // frame buffers
+    uint64_t frames_in, frames_out, late_drops, crc_drops;
+} sequencer_t;
+
+void seq_frame_free(seq_frame_t *f){
+    if(f){
+        frame_buf_release(f->buf);
+        free(f);
+    }
+}
+
+uint64_t seq_key(sequencer_t *sq, int slot){
+    return sq->inputs[sq->heap[slot]].head->ts_ns;
+}
+
+void seq_heap_swap(sequencer_t *sq, int a, int b){
+    int t = sq->heap[a];
+    sq->heap[a] = sq->heap[b];
+    sq->heap[b] = t;
+    sq->inputs[sq->heap[a]].heap_pos = a;
+    sq->inputs[sq->heap[b]].heap_pos = b;
+}
+
+void seq_heap_up(sequencer_t *sq, int pos){
+    while(pos > 0 && seq_key(sq, (pos - 1) / 2) > seq_key(sq, pos)){
+        seq_heap_swap(sq, pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+void seq_heap_down(sequencer_t *sq, int pos){
+    while(1){
+        int smallest = pos, l = 2 * pos + 1, r = l + 1;
+        if(l < sq->heap_len && seq_key(sq, l) < seq_key(sq, smallest)) smallest = l;
+        if(r < sq->heap_len && seq_key(sq, r) < seq_key(sq, smallest)) smallest = r;
+        if(smallest == pos){
+            return;
+        }
+        seq_heap_swap(sq, pos, smallest);
+        pos = smallest;
+    }
+}
+
+/**
+ * Queue a complete frame on its feed, dropping it if the merged stream
+ * has already moved past its timestamp
+ * @param sq: the sequencer
+ * @param idx: the feed slot
+ * @param f: the frame
+ */
+void seq_push_frame(sequencer_t *sq, int idx, seq_frame_t *f){
+    seq_input_t *in = &sq->inputs[idx];
+    sq->frames_in++;
+    if(sq->frames_out > 0 && f->ts_ns < sq->released_ns){
+        sq->late_drops++;
+        seq_frame_free(f);
+        return;
+    }
+    if(f->ts_ns > sq->max_seen_ns){
+        sq->max_seen_ns = f->ts_ns;
+    }
+    f->next = NULL;
+    if(in->tail){
+        in->tail->next = f;
+        in->tail = f;
+        return;
+    }
+    // first waiting frame: the feed joins the merge heap
+    in->head = in->tail = f;
+    if(in->fd >= 0){
+        sq->starved_inputs--;
+    }
+    in->heap_pos = sq->heap_len;
+    sq->heap[sq->heap_len++] = idx;
+    seq_heap_up(sq, in->heap_pos);
+}
+
+/**
+ * Send a frame to every subscriber. A subscriber that cannot take the
+ * whole frame right away is disconnected, a partial frame would corrupt
+ * its stream and waiting would stall every other subscriber.
+ * @param sq: the sequencer
+ * @param f: the frame
+ */
+void seq_broadcast(sequencer_t *sq, const seq_frame_t *f){
+    for(int i = 0; i < sq->num_subscribers; i++){
+        ssize_t n = send(sq->subscribers[i], f->buf->data, f->buf->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(n == (ssize_t)f->buf->len){
+            continue;
+        }
+        printf("[SEQUENCER] Dropping slow or closed subscriber %d\n", sq->subscribers[i]);
+        close(sq->subscribers[i]);
+        sq->subscribers[i--] = sq->subscribers[--sq->num_subscribers];
+    }
+}
+
+/**
+ * Release frames in timestamp order. The oldest queued frame is safe to
+ * release when every open feed has a frame waiting (feeds send in order,
+ * so nothing older can still arrive) or when it falls behind the
+ * watermark: newest timestamp seen minus the lateness bound.
+ * @param sq: the sequencer
+ * @param flush: release everything regardless of the watermark
+ */
+void seq_release(sequencer_t *sq, int flush){
+    uint64_t watermark = sq->max_seen_ns > config.seq_lateness_ns ?
+                         sq->max_seen_ns - config.seq_lateness_ns : 0;
+    while(sq->heap_len > 0){
+        int idx = sq->heap[0];
+        seq_input_t *in = &sq->inputs[idx];
+        seq_frame_t *f = in->head;
+        if(!flush && sq->starved_inputs > 0 && f->ts_ns > watermark){
+            break;
+        }
+        seq_broadcast(sq, f);
+        capture_record(f->conn, f->buf, 0, f->buf->len);
+        sq->released_ns = f->ts_ns;
+        sq->frames_out++;
+
+        in->head = f->next;
+        seq_frame_free(f);
+        if(in->head){
+            seq_heap_down(sq, 0);
+            continue;
+        }
+        // the feed ran dry: leave the heap, and free the slot if it is closed
+        in->tail = NULL;
+        in->heap_pos = -1;
+        sq->heap[0] = sq->heap[--sq->heap_len];
+        if(sq->heap_len > 0){
+            sq->inputs[sq->heap[0]].heap_pos = 0;
+            seq_heap_down(sq, 0);
+        }
+        if(in->fd >= 0){
+            sq->starved_inputs++;
+        }else{
+            sq->free_slots[sq->num_free++] = idx;
+        }
+    }
+}
+
+/**
+ * Read whatever a feed has sent and cut it into frames
+ * @param sq: the sequencer
+ * @param idx: the feed slot
+ * @param buf: staging buffer, SEQ_RECV_LEN bytes
+ * return 0 while the feed is open, -1 once it closed or sent a bad frame
+ */
+int seq_read_input(sequencer_t *sq, int idx, uint8_t *buf){
+    seq_input_t *in = &sq->inputs[idx];
+    ssize_t n;
+    while((n = recv(in->fd, buf, SEQ_RECV_LEN, MSG_DONTWAIT)) > 0){
+        const uint8_t *p = buf, *end = buf + n;
+        while(p < end){
+            if(in->cur == NULL){
+                uint32_t take = FRAME_HDR_LEN - in->hdr_got;
+                if(take > end - p) take = end - p;
+                memcpy(in->hdr_buf + in->hdr_got, p, take);
+                in->hdr_got += take;
+                p += take;
+                if(in->hdr_got < FRAME_HDR_LEN){
+                    break;
+                }
+                frame_hdr_t hdr;
+                if(frame_decode_hdr(in->hdr_buf, &hdr) < 0){
+                    printf("[SEQUENCER] Invalid frame header from feed %d\n", in->fd);
+                    return -1;
+                }
+                in->cur = malloc(sizeof(seq_frame_t));
+                if(in->cur == NULL ||
+                   (in->cur->buf = frame_buf_alloc(sq->pool, FRAME_HDR_LEN + frame_body_len(&hdr))) == NULL){
+                    perror("Failed to allocate memory for frame");
+                    free(in->cur);
+                    in->cur = NULL;
+                    return -1;
+                }
+                in->cur->ts_ns = hdr.ts_ns;
+                in->cur->conn = in->capture_id;
+                in->cur->buf->len = FRAME_HDR_LEN + frame_body_len(&hdr);
+                memcpy(in->cur->buf->data, in->hdr_buf, FRAME_HDR_LEN);
+                in->cur_got = FRAME_HDR_LEN;
+                in->hdr_got = 0;
+                in->payload_end = hdr.flags & FRAME_FLAG_CRC ? FRAME_HDR_LEN + hdr.len : 0;
+                in->crc = crc32c(0, in->hdr_buf, FRAME_HDR_LEN);
+            }
+            uint8_t *data = in->cur->buf->data;
+            uint32_t take = in->cur->buf->len - in->cur_got;
+            if(take > end - p) take = end - p;
+            if(in->payload_end > in->cur_got){
+                // the payload is checked as it is copied out of the staging buffer
+                uint32_t payload = in->payload_end - in->cur_got < take ? in->payload_end - in->cur_got : take;
+                in->crc = crc32c_copy(in->crc, data + in->cur_got, p, payload);
+                memcpy(data + in->cur_got + payload, p + payload, take - payload);
+            }else{
+                memcpy(data + in->cur_got, p, take);
+            }
+            in->cur_got += take;
+            p += take;
+            if(in->cur_got == in->cur->buf->len){
+                uint32_t sent = 0;
+                if(in->payload_end){
+                    memcpy(&sent, data + in->payload_end, FRAME_CRC_LEN);
+                    sent = ntohl(sent);
+                }
+                if(in->payload_end && sent != in->crc){
+                    printf("[SEQUENCER] CRC mismatch on frame from feed %d, dropped\n", in->fd);
+                    sq->crc_drops++;
+                    seq_frame_free(in->cur);
+                }else{
+                    seq_push_frame(sq, idx, in->cur);
+                }
+                in->cur = NULL;
+            }
+        }
+    }
+    if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)){
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Close a feed. Its queued frames stay in the merge until released.
+ * @param sq: the sequencer
+ * @param idx: the feed slot
+ */
+void seq_close_input(sequencer_t *sq, int idx){
+    seq_input_t *in = &sq->inputs[idx];
+    printf("[SEQUENCER] Feed %d closed\n", in->fd);
+    close(in->fd);
+    in->fd = -1;
+    seq_frame_free(in->cur);
+    in->cur = NULL;
+    sq->open_inputs--;
+    if(in->head == NULL){
+        sq->starved_inputs--;
+        sq->free_slots[sq->num_free++] = idx;
+    }
+}
+
+/**
+ * Sequencer main loop: a single epoll thread reads every feed, merges the
+ * queued frames with a min-heap keyed by each feed's oldest frame (log k
+ * per frame for k feeds) and streams the result to subscribers.
+ * @param listenfd: the listening socket for feeds
+ */
+void run_sequencer(int listenfd){
+    int subfd = create_listen_socket(config.seq_sub_port);
+    if(subfd < 0){
+        exit(EXIT_FAILURE);
+    }
+    sequencer_t sq;
+    memset(&sq, 0, sizeof(sq));
+    sq.inputs = calloc(SEQ_MAX_INPUTS, sizeof(seq_input_t));
+    sq.free_slots = malloc(SEQ_MAX_INPUTS * sizeof(int));
+    sq.heap = malloc(SEQ_MAX_INPUTS * sizeof(int));
+    sq.pool = frame_buf_pool_create(SEQ_BUF_LEN, SEQ_POOL_FREE);
+    uint8_t *buf = malloc(SEQ_RECV_LEN);
+    int epfd = epoll_create1(0);
+    if(!sq.inputs || !sq.free_slots || !sq.heap || !sq.pool || !buf || epfd < 0){
+        perror("Failed to set up sequencer");
         exit(EXIT_FAILURE);
     }
+    // listening sockets are tagged past the slot range
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = SEQ_MAX_INPUTS };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev);
+    ev.data.u32 = SEQ_MAX_INPUTS + 1;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, subfd, &ev);
 
-    // Set the socket to listen for incoming connections
-    if(listen(sockfd, BACKLOG) < 0){
-        perror("Failed to listen for connections");
-        close(sockfd);
+    printf("Sequencer: feeds on port %d, subscribers on port %d, lateness %" PRIu64 " ms\n",
+            config.port, config.seq_sub_port, config.seq_lateness_ns / 1000000);
+    int idle_ms = config.seq_lateness_ns / 1000000;
+    time_t last_report = time(NULL);
+    struct epoll_event events[MAX_EVENTS];
+    while(1){
+        int nev = epoll_wait(epfd, events, MAX_EVENTS, idle_ms > 0 ? idle_ms : 1);
+        if(nev < 0 && errno != EINTR){
+            perror("epoll_wait failed");
+            exit(EXIT_FAILURE);
+        }
+        for(int i = 0; i < nev; i++){
+            uint32_t tag = events[i].data.u32;
+            if(tag == SEQ_MAX_INPUTS + 1){
+                int fd = accept(subfd, NULL, NULL);
+                if(fd < 0){
+                    continue;
+                }
+                if(sq.num_subscribers == SEQ_MAX_SUBSCRIBERS){
+                    printf("[SEQUENCER] Maximum subscribers reached, connection rejected\n");
+                    close(fd);
+                    continue;
+                }
+                shutdown(fd, SHUT_RD);
+                sq.subscribers[sq.num_subscribers++] = fd;
+                printf("[SEQUENCER] Subscriber %d connected\n", fd);
+            }else if(tag == SEQ_MAX_INPUTS){
+                int fd = accept(listenfd, NULL, NULL);
+                if(fd < 0){
+                    continue;
+                }
+                if(sq.num_free == 0 && sq.num_slots == SEQ_MAX_INPUTS){
+                    printf("[SEQUENCER] Maximum feeds reached, connection rejected\n");
+                    close(fd);
+                    continue;
+                }
+                int idx = sq.num_free > 0 ? sq.free_slots[--sq.num_free] : sq.num_slots++;
+                memset(&sq.inputs[idx], 0, sizeof(seq_input_t));
+                sq.inputs[idx].fd = fd;
+                sq.inputs[idx].capture_id = capture_conn_id();
+                sq.inputs[idx].heap_pos = -1;
+                sq.open_inputs++;
+                sq.starved_inputs++;
+                struct epoll_event cev = { .events = EPOLLIN, .data.u32 = idx };
+                epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &cev);
+                printf("[SEQUENCER] Feed %d connected\n", fd);
+            }else if(seq_read_input(&sq, tag, buf) < 0){
+                seq_close_input(&sq, tag);
+            }
+        }
+        // nothing arrived for a whole lateness period: stragglers are not coming
+        seq_release(&sq, nev == 0);
+
+        time_t now = time(NULL);
+        if(now - last_report >= STATS_INTERVAL){
+            last_report = now;
+            printf("[STATS] feeds=%d subscribers=%d frames_in=%" PRIu64 " frames_out=%" PRIu64
+                   " late=%" PRIu64 " crc_errors=%" PRIu64 "\n",
+                    sq.open_inputs, sq.num_subscribers, sq.frames_in, sq.frames_out, sq.late_drops, sq.crc_drops);
+        }
+    }
+}
+
+
+// an AF_XDP ring shared with the kernel, one producer and one consumer
+typedef struct{
+    uint32_t *producer;
+    uint32_t *consumer;
+    void *desc;             // struct xdp_desc[] for RX, uint64_t[] UMEM addresses for fill
+    uint32_t mask;          // ring size - 1
+    void *map;              // the mapping, for munmap
+    size_t map_len;
+} xdp_ring_t;
+
+// XDP ingest state, owned by the thread running run_xdp_ingest()
+typedef struct{
+    int fd;                 // AF_XDP socket
+    uint8_t *umem;          // packet buffers, XDP_RING_SIZE chunks
+    xdp_ring_t rx, fill;
+    uint64_t packets, bytes, frames, bad_frames, crc_drops, raw;
+} xdp_ingest_t;
+
+int bpf_sys(int cmd, union bpf_attr *attr){
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Load the steering XDP program. It passes everything but IPv4 UDP
+ * datagrams (without IP options) for the port, which it redirects to the
+ * AF_XDP socket registered in the map for the RX queue they arrived on;
+ * with no socket there the datagram goes to the stack too.
+ * @param map_fd: the XSKMAP, RX queue index -> AF_XDP socket
+ * @param port: the UDP destination port
+ * return the program fd, -1 on failure
+ */
+int xdp_load_program(int map_fd, uint16_t port){
+    uint16_t be_port = htons(port);
+    struct bpf_insn prog[] = {
+        // r2 = data, r3 = data_end; pass unless eth + IPv4 + UDP headers are there
+        { .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+          .off = offsetof(struct xdp_md, data) },
+        { .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_3, .src_reg = BPF_REG_1,
+          .off = offsetof(struct xdp_md, data_end) },
+        { .code = BPF_ALU64 | BPF_MOV | BPF_X, .dst_reg = BPF_REG_4, .src_reg = BPF_REG_2 },
+        { .code = BPF_ALU64 | BPF_ADD | BPF_K, .dst_reg = BPF_REG_4, .imm = 14 + 20 + 8 },
+        { .code = BPF_JMP | BPF_JGT | BPF_X, .dst_reg = BPF_REG_4, .src_reg = BPF_REG_3, .off = 14 },
+        // ethertype IPv4 (loaded in network order), no IP options, protocol UDP
+        { .code = BPF_LDX | BPF_MEM | BPF_H, .dst_reg = BPF_REG_5, .src_reg = BPF_REG_2, .off = 12 },
+        { .code = BPF_JMP | BPF_JNE | BPF_K, .dst_reg = BPF_REG_5, .off = 12, .imm = htons(0x0800) },
+        { .code = BPF_LDX | BPF_MEM | BPF_B, .dst_reg = BPF_REG_5, .src_reg = BPF_REG_2, .off = 14 },
+        { .code = BPF_JMP | BPF_JNE | BPF_K, .dst_reg = BPF_REG_5, .off = 10, .imm = 0x45 },
+        { .code = BPF_LDX | BPF_MEM | BPF_B, .dst_reg = BPF_REG_5, .src_reg = BPF_REG_2, .off = 14 + 9 },
+        { .code = BPF_JMP | BPF_JNE | BPF_K, .dst_reg = BPF_REG_5, .off = 8, .imm = IPPROTO_UDP },
+        // UDP destination port
+        { .code = BPF_LDX | BPF_MEM | BPF_H, .dst_reg = BPF_REG_5, .src_reg = BPF_REG_2, .off = 14 + 20 + 2 },
+        { .code = BPF_JMP | BPF_JNE | BPF_K, .dst_reg = BPF_REG_5, .off = 6, .imm = be_port },
+        // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS)
+        { .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2, .src_reg = BPF_REG_1,
+          .off = offsetof(struct xdp_md, rx_queue_index) },
+        { .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1, .src_reg = BPF_PSEUDO_MAP_FD, .imm = map_fd },
+        { .code = 0 },
+        { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3, .imm = XDP_PASS },
+        { .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+        { .code = BPF_JMP | BPF_EXIT },
+        // pass:
+        { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_0, .imm = XDP_PASS },
+        { .code = BPF_JMP | BPF_EXIT },
+    };
+    static char log[4096];
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uintptr_t)"GPL";
+    attr.log_buf = (uintptr_t)log;
+    attr.log_size = sizeof(log);
+    attr.log_level = 1;
+    int fd = bpf_sys(BPF_PROG_LOAD, &attr);
+    if(fd < 0){
+        perror("Failed to load XDP program");
+        if(log[0]){
+            fprintf(stderr, "%s\n", log);
+        }
+    }
+    return fd;
+}
+
+/**
+ * Map one of the socket's rings
+ * @param fd: the AF_XDP socket
+ * @param pgoff: the ring's mmap offset (XDP_PGOFF_RX_RING, ...)
+ * @param off: the ring's field offsets from XDP_MMAP_OFFSETS
+ * @param size: ring size in descriptors
+ * @param desc_size: bytes per descriptor
+ * @param r: receives the ring
+ * return 0 if success, -1 on failure
+ */
+int xdp_ring_map(int fd, uint64_t pgoff, const struct xdp_ring_offset *off, uint32_t size,
+                 size_t desc_size, xdp_ring_t *r){
+    r->map_len = off->desc + size * desc_size;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if(r->map == MAP_FAILED){
+        return -1;
+    }
+    r->producer = (uint32_t *)((uint8_t *)r->map + off->producer);
+    r->consumer = (uint32_t *)((uint8_t *)r->map + off->consumer);
+    r->desc = (uint8_t *)r->map + off->desc;
+    r->mask = size - 1;
+    return 0;
+}
+
+/**
+ * Create the AF_XDP socket: register the UMEM, size and map the fill and
+ * RX rings, bind to the interface queue (copy mode, which generic XDP
+ * requires) and hand every chunk to the kernel through the fill ring
+ * @param x: the ingest state
+ * @param ifindex: the interface
+ * @param queue: the RX queue
+ * return 0 if success, -1 on failure
+ */
+int xdp_socket_open(xdp_ingest_t *x, int ifindex, int queue){
+    x->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if(x->fd < 0){
+        perror("Failed to create AF_XDP socket");
+        return -1;
+    }
+    x->umem = mmap(NULL, (size_t)XDP_RING_SIZE * XDP_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(x->umem == MAP_FAILED){
+        perror("Failed to allocate UMEM");
+        return -1;
+    }
+    struct xdp_umem_reg reg = { .addr = (uintptr_t)x->umem, .len = (uint64_t)XDP_RING_SIZE * XDP_CHUNK_SIZE,
+                                .chunk_size = XDP_CHUNK_SIZE, .headroom = 0 };
+    int ring_size = XDP_RING_SIZE, completion_size = 1;
+    struct xdp_mmap_offsets off;
+    socklen_t off_len = sizeof(off);
+    if(setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 ||
+       setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+       setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &completion_size, sizeof(completion_size)) < 0 ||
+       setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+       getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &off_len) < 0){
+        perror("Failed to set up AF_XDP rings");
+        return -1;
+    }
+    if(xdp_ring_map(x->fd, XDP_PGOFF_RX_RING, &off.rx, XDP_RING_SIZE, sizeof(struct xdp_desc), &x->rx) < 0 ||
+       xdp_ring_map(x->fd, XDP_UMEM_PGOFF_FILL_RING, &off.fr, XDP_RING_SIZE, sizeof(uint64_t), &x->fill) < 0){
+        perror("Failed to map AF_XDP rings");
+        return -1;
+    }
+    struct sockaddr_xdp addr = { .sxdp_family = AF_XDP, .sxdp_flags = XDP_COPY,
+                                 .sxdp_ifindex = ifindex, .sxdp_queue_id = queue };
+    if(bind(x->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0){
+        perror("Failed to bind AF_XDP socket");
+        return -1;
+    }
+    // the fill ring holds every chunk not waiting in the RX ring or being read
+    uint64_t *fill = x->fill.desc;
+    uint32_t prod = *x->fill.producer;
+    for(uint32_t i = 0; i < XDP_RING_SIZE; i++){
+        fill[(prod + i) & x->fill.mask] = (uint64_t)i * XDP_CHUNK_SIZE;
+    }
+    __atomic_store_n(x->fill.producer, prod + XDP_RING_SIZE, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Process one steered packet in place in the UMEM: find the UDP payload
+ * and aggregate each frame in it, or the whole payload if it is not made
+ * of frames
+ * @param x: the ingest state
+ * @param pkt: the packet, from its Ethernet header
+ * @param len: packet length
+ */
+void xdp_handle_packet(xdp_ingest_t *x, uint8_t *pkt, uint32_t len){
+    x->packets++;
+    if(len < 14 + 20 + 8){
+        return;
+    }
+    uint16_t udp_len;
+    memcpy(&udp_len, pkt + 14 + 20 + 4, 2);
+    udp_len = ntohs(udp_len);
+    if(udp_len < 8 || udp_len > len - 14 - 20){
+        x->bad_frames++;
+        return;
+    }
+    uint8_t *p = pkt + 14 + 20 + 8, *end = p + udp_len - 8;
+    x->bytes += end - p;
+    uint32_t magic;
+    if(end - p < FRAME_HDR_LEN || (memcpy(&magic, p, 4), ntohl(magic) != FRAME_MAGIC)){
+        aggregate_frame(p, end - p);
+        x->raw++;
+        return;
+    }
+    while(end - p >= FRAME_HDR_LEN){
+        frame_hdr_t hdr;
+        if(frame_decode_hdr(p, &hdr) < 0 || frame_body_len(&hdr) > (size_t)(end - p) - FRAME_HDR_LEN){
+            x->bad_frames++;
+            return;
+        }
+        if(hdr.flags & FRAME_FLAG_CRC){
+            uint32_t sent;
+            memcpy(&sent, p + FRAME_HDR_LEN + hdr.len, FRAME_CRC_LEN);
+            if(ntohl(sent) != crc32c(0, p, FRAME_HDR_LEN + hdr.len)){
+                x->crc_drops++;
+                p += FRAME_HDR_LEN + frame_body_len(&hdr);
+                continue;
+            }
+        }
+        aggregate_frame(p + FRAME_HDR_LEN, hdr.len);
+        x->frames++;
+        p += FRAME_HDR_LEN + frame_body_len(&hdr);
+    }
+}
+
+/**
+ * XDP ingest main loop: attach the steering program to the interface,
+ * then read packets from the RX ring, process them where the kernel put
+ * them and give their chunks straight back through the fill ring
+ */
+void run_xdp_ingest(void){
+    int ifindex = if_nametoindex(config.xdp_ifname);
+    if(ifindex == 0){
+        fprintf(stderr, "Unknown interface: %s\n", config.xdp_ifname);
+        exit(EXIT_FAILURE);
+    }
+    union bpf_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = XDP_MAP_ENTRIES;
+    int map_fd = bpf_sys(BPF_MAP_CREATE, &attr);
+    if(map_fd < 0){
+        perror("Failed to create XSKMAP");
+        exit(EXIT_FAILURE);
+    }
+    int prog_fd = xdp_load_program(map_fd, config.port);
+    if(prog_fd < 0){
+        exit(EXIT_FAILURE);
+    }
+    xdp_ingest_t x;
+    memset(&x, 0, sizeof(x));
+    if(config.xdp_queue >= XDP_MAP_ENTRIES || xdp_socket_open(&x, ifindex, config.xdp_queue) < 0){
+        exit(EXIT_FAILURE);
+    }
+    uint32_t key = config.xdp_queue, value = x.fd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = map_fd;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)&value;
+    if(bpf_sys(BPF_MAP_UPDATE_ELEM, &attr) < 0){
+        perror("Failed to register AF_XDP socket");
+        exit(EXIT_FAILURE);
+    }
+    // a link detaches the program by itself when the server exits
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = prog_fd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    if(bpf_sys(BPF_LINK_CREATE, &attr) < 0){
+        perror("Failed to attach XDP program");
         exit(EXIT_FAILURE);
     }
+    printf("XDP ingest: UDP port %d on %s queue %d\n", config.port, config.xdp_ifname, config.xdp_queue);
 
-    // Create a pool of worker threads for concurrent processing
-    pthread_t workers[NUM_WORKER_THREADS];
-    for(int i = 0; i < NUM_WORKER_THREADS; i++){
-        if(pthread_create(&workers[i], NULL, worker_thread, NULL) != 0){
-            perror("pthread_create failed");
-            close(sockfd);
+    time_t last_report = time(NULL);
+    struct pollfd pfd = { .fd = x.fd, .events = POLLIN };
+    while(1){
+        uint32_t cons = *x.rx.consumer;
+        uint32_t avail = __atomic_load_n(x.rx.producer, __ATOMIC_ACQUIRE) - cons;
+        if(avail == 0){
+            poll(&pfd, 1, 1000);
+        }
+        if(avail > XDP_BATCH){
+            avail = XDP_BATCH;
+        }
+        // each chunk read goes back to the fill ring; there are only as many
+        // chunks as fill ring slots, so it always has room
+        uint32_t fill_prod = *x.fill.producer;
+        const struct xdp_desc *desc = x.rx.desc;
+        uint64_t *fill = x.fill.desc;
+        for(uint32_t i = 0; i < avail; i++){
+            const struct xdp_desc *d = &desc[(cons + i) & x.rx.mask];
+            xdp_handle_packet(&x, x.umem + d->addr, d->len);
+            fill[(fill_prod + i) & x.fill.mask] = d->addr;
+        }
+        if(avail > 0){
+            __atomic_store_n(x.fill.producer, fill_prod + avail, __ATOMIC_RELEASE);
+            __atomic_store_n(x.rx.consumer, cons + avail, __ATOMIC_RELEASE);
+        }
+
+        time_t now = time(NULL);
+        if(now - last_report >= STATS_INTERVAL){
+            last_report = now;
+            struct xdp_statistics st;
+            socklen_t st_len = sizeof(st);
+            memset(&st, 0, sizeof(st));
+            getsockopt(x.fd, SOL_XDP, XDP_STATISTICS, &st, &st_len);
+            printf("[STATS] xdp packets=%" PRIu64 " bytes=%" PRIu64 " frames=%" PRIu64 " raw=%" PRIu64
+                   " bad=%" PRIu64 " crc_errors=%" PRIu64 " "
+                   "rx_dropped=%llu rx_ring_full=%llu fill_empty=%llu\n",
+                    x.packets, x.bytes, x.frames, x.raw, x.bad_frames, x.crc_drops,
+                    (unsigned long long)st.rx_dropped, (unsigned long long)st.rx_ring_full,
+                    (unsigned long long)st.rx_fill_ring_empty_descs);
+        }
+    }
+}
+
+/**
+ * Main function: create the listening socket,
+ * initialize the connection queue and thread pool,
+ * accept connections and enqueue them for processing
+ */
+#ifdef CONN_STATE_BENCH
+// conn_state_t's fields in declaration order of the state before it was
+// laid out by cache line: the hot ones spread between the cold ones
+typedef struct{
+    int fd;
+    line_rx_t lines;
+    int mode;
+    struct timespec opened;
+    frame_buf_t *buf;
+    frame_rx_t frames;
+    uint64_t bytes;
+    uint64_t chunks;
+    uint32_t pending;
+} conn_state_scattered_t;
+
+/**
+ * Benchmark the per-chunk path of binary frame connections over many live
+ * connection states, as a coroutine worker interleaves them: chunks land
+ * on random connections, each in the middle of a large frame, and go
+ * through the same steps as in handle_connection. conn_state_t is
+ * compared with the same fields unordered; cache misses are counted
+ * where the host exposes perf counters.
+ * return 0 if success, 1 on failure
+ */
+int conn_state_bench(void){
+    enum { CONNS = 65536, CHUNKS = 2000000, CHUNK_LEN = 64, ROUNDS = 3 };
+    conn_state_t *packed = aligned_alloc(CACHE_LINE, CONNS * sizeof(conn_state_t));
+    conn_state_scattered_t *scattered = aligned_alloc(CACHE_LINE, CONNS * sizeof(conn_state_scattered_t));
+    uint32_t *order = malloc(CHUNKS * sizeof(uint32_t));
+    if(packed == NULL || scattered == NULL || order == NULL){
+        perror("Failed to allocate benchmark state");
+        return 1;
+    }
+    uint8_t hdr[FRAME_HDR_LEN], payload[CHUNK_LEN];
+    frame_encode_hdr(hdr, &(frame_hdr_t){ .len = FRAME_MAX_LEN });
+    for(int i = 0; i < CHUNK_LEN; i++){
+        payload[i] = (uint8_t)(i * 7 % 200);   // never all 256 values: distinct keeps working
+    }
+    static uint8_t fake_buf;    // stands in for the receive buffer pointer
+    memset(packed, 0, CONNS * sizeof(conn_state_t));
+    memset(scattered, 0, CONNS * sizeof(conn_state_scattered_t));
+    for(int c = 0; c < CONNS; c++){
+        packed[c].fd = scattered[c].fd = c;
+        packed[c].mode = scattered[c].mode = CONN_FRAMES;
+        packed[c].buf = scattered[c].buf = (frame_buf_t *)&fake_buf;
+        frame_rx_consume(&packed[c].frames, c, hdr, FRAME_HDR_LEN);
+        frame_rx_consume(&scattered[c].frames, c, hdr, FRAME_HDR_LEN);
+    }
+    uint64_t rng = 88172645463325252ull;
+    for(int i = 0; i < CHUNKS; i++){
+        rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+        order[i] = rng % CONNS;
+    }
+
+    int misses_fd = perf_counter_open(PERF_COUNTER_CACHE_MISSES);
+    int l1_fd = perf_counter_open(PERF_COUNTER_L1D_MISSES);
+    if(misses_fd < 0 && l1_fd < 0){
+        printf("[BENCH] Cache miss counters unavailable here (perf_event_open), timing only\n");
+    }
+    uint64_t check[2] = {0, 0};
+    long best_ns[2] = {-1, -1};
+    int64_t best_misses[2] = {-1, -1}, best_l1[2] = {-1, -1};
+    const char *names[2] = { "packed conn_state_t", "scattered fields" };
+    // alternate the layouts and keep each one's best round, to filter noise
+    for(int run = 0; run < 2 * ROUNDS; run++){
+        int layout = run & 1;
+        struct timespec start, end;
+        perf_counter_start(misses_fd);
+        perf_counter_start(l1_fd);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int i = 0; i < CHUNKS; i++){
+            uint32_t c = order[i];
+            if(layout == 0){
+                conn_state_t *cs = &packed[c];
+                if(cs->buf == NULL || cs->mode != CONN_FRAMES){
+                    return 1;
+                }
+                cs->chunks++;
+                cs->bytes += CHUNK_LEN;
+                frame_rx_consume(&cs->frames, cs->fd, payload, CHUNK_LEN);
+                cs->pending = frame_rx_pending(&cs->frames);
+                check[0] += cs->pending;
+            }else{
+                conn_state_scattered_t *cs = &scattered[c];
+                if(cs->buf == NULL || cs->mode != CONN_FRAMES){
+                    return 1;
+                }
+                cs->chunks++;
+                cs->bytes += CHUNK_LEN;
+                frame_rx_consume(&cs->frames, cs->fd, payload, CHUNK_LEN);
+                cs->pending = frame_rx_pending(&cs->frames);
+                check[1] += cs->pending;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        int64_t misses = perf_counter_stop(misses_fd);
+        int64_t l1 = perf_counter_stop(l1_fd);
+        long ns = (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+        if(best_ns[layout] < 0 || ns < best_ns[layout]) best_ns[layout] = ns;
+        if(misses >= 0 && (best_misses[layout] < 0 || misses < best_misses[layout])) best_misses[layout] = misses;
+        if(l1 >= 0 && (best_l1[layout] < 0 || l1 < best_l1[layout])) best_l1[layout] = l1;
+    }
+    for(int layout = 0; layout < 2; layout++){
+        printf("[BENCH] %s (%zu bytes), %d connections: %.1f ns/chunk", names[layout],
+                layout == 0 ? sizeof(conn_state_t) : sizeof(conn_state_scattered_t), CONNS,
+                (double)best_ns[layout] / CHUNKS);
+        if(best_misses[layout] >= 0) printf(", %.2f cache misses/chunk", (double)best_misses[layout] / CHUNKS);
+        if(best_l1[layout] >= 0) printf(", %.2f L1D misses/chunk", (double)best_l1[layout] / CHUNKS);
+        printf("\n");
+    }
+    if(misses_fd >= 0) close(misses_fd);
+    if(l1_fd >= 0) close(l1_fd);
+    free(packed);
+    free(scattered);
+    free(order);
+    if(check[0] != check[1]){
+        printf("[BENCH] Layouts disagree\n");
+        return 1;
+    }
+    return 0;
+}
+#endif // CONN_STATE_BENCH
+
+int main(int argc, char *argv[]){
+    int c;
+#ifdef CONN_STATE_BENCH
+    return conn_state_bench();
+#endif
+    while((c = getopt(argc, argv, "p:u:B:w:t:o:s:c:S:k:C:lx:e:")) != -1){
+        switch(c){
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'u':{
+            struct sockaddr_in addr;
+            if(parse_addr(optarg, &addr) < 0){
+                fprintf(stderr, "Invalid upstream address: %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            init_upstream_pool(&upstream, &addr);
+            config.relay = 1;
+            signal(SIGPIPE, SIG_IGN); // a dead upstream must not kill the relay
+            break;
+        }
+        case 'B':
+            config.backends_file = optarg;
+            break;
+        case 't':
+            if(parse_tenant(optarg) < 0){
+                fprintf(stderr, "Invalid tenant (name:port:workers[:cpus]): %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':{
+            config.overflow_workers = atoi(optarg);
+            const char *cpus = strchr(optarg, ':');
+            if(config.overflow_workers < 0 || config.overflow_workers > MAX_GROUP_WORKERS ||
+               (cpus && parse_cpu_list(cpus + 1, &config.overflow_cpus) < 0)){
+                fprintf(stderr, "Invalid overflow pool (workers[:cpus]): %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            config.overflow_pinned = cpus != NULL;
+            break;
+        }
+        case 's':{
+            char *end;
+            long ms = strtol(optarg, &end, 10);
+            if(end == optarg || ms < 0 || (*end != '\0' && *end != ':')){
+                fprintf(stderr, "Invalid sequencer option (lateness_ms[:subscriber_port]): %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            config.sequencer = 1;
+            config.seq_lateness_ns = (uint64_t)ms * 1000000;
+            if(*end == ':'){
+                config.seq_sub_port = atoi(end + 1);
+            }
+            break;
+        }
+        case 'c':{
+            // the text after the last ':' is an interval only if it is a
+            // number, so a path holding ':' needs no interval spelled out
+            char *colon = strrchr(optarg, ':');
+            config.checkpoint_interval = CHECKPOINT_INTERVAL;
+            if(colon && colon[1] != '\0' && strspn(colon + 1, "0123456789") == strlen(colon + 1)){
+                *colon = '\0';
+                config.checkpoint_interval = atoi(colon + 1);
+            }
+            config.checkpoint_file = optarg;
+            if(config.checkpoint_interval < 1 || *optarg == '\0'){
+                fprintf(stderr, "Invalid checkpoint option (file[:interval_s])\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        }
+        case 'k':
+            config.kernel_cache = optarg;
+            break;
+        case 'C':
+            config.capture_file = optarg;
+            break;
+        case 'l':
+            config.line_mode = 1;
+            break;
+        case 'x':{
+            char *colon = strchr(optarg, ':');
+            if(colon){
+                *colon = '\0';
+                config.xdp_queue = atoi(colon + 1);
+            }
+            config.xdp_ifname = optarg;
+            break;
+        }
+        case 'e':
+            config.coroutines = atoi(optarg);
+            if(config.coroutines < 1){
+                fprintf(stderr, "Coroutine workers must serve at least one connection each\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'S':
+            config.session_ring = atoi(optarg);
+            if(config.session_ring < 1){
+                fprintf(stderr, "Session ring must hold at least one message\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            config.processes = atoi(optarg);
+            if(config.processes < 1 || config.processes > MAX_WORKER_PROCESSES){
+                fprintf(stderr, "Worker processes must be between 1 and %d\n", MAX_WORKER_PROCESSES);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-u upstream_ip:port | -B backends_file | -w processes |\n"
+                            "           -s lateness_ms[:subscriber_port]]\n"
+                            "          [-t name:port:workers[:cpus] ... [-o workers[:cpus]]]\n"
+                            "          [-c checkpoint_file[:interval_s]] [-S ring_messages] [-k kernel_cache]\n"
+                            "          [-C capture_file] [-l] [-x ifname[:queue]] [-e connections]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if((config.relay != 0) + (config.backends_file != NULL) + (config.processes > 0) + config.sequencer > 1){
+        fprintf(stderr, "Relay (-u), router (-B), prefork (-w) and sequencer (-s) modes are exclusive\n");
+        exit(EXIT_FAILURE);
+    }
+    if((config.processes > 0 || config.sequencer) && num_tenants > 0){
+        fprintf(stderr, "Tenants (-t) are not supported in prefork and sequencer modes\n");
+        exit(EXIT_FAILURE);
+    }
+    if((config.processes > 0 || config.sequencer) && config.checkpoint_file){
+        fprintf(stderr, "Checkpoints (-c) are not supported in prefork and sequencer modes\n");
+        exit(EXIT_FAILURE);
+    }
+    if(config.capture_file && (config.relay || config.backends_file || config.processes > 0)){
+        fprintf(stderr, "Capture (-C) is only supported in the default threaded and sequencer modes\n");
+        exit(EXIT_FAILURE);
+    }
+    if(config.session_ring > 0 && (config.relay || config.backends_file || config.processes > 0 || config.sequencer)){
+        fprintf(stderr, "Sessions (-S) are only supported in the default threaded mode\n");
+        exit(EXIT_FAILURE);
+    }
+    if(config.xdp_ifname && (config.relay || config.backends_file || config.processes > 0 || config.sequencer ||
+                             num_tenants > 0 || config.checkpoint_file || config.capture_file || config.session_ring > 0)){
+        fprintf(stderr, "XDP ingest (-x) is a mode of its own, without -u/-B/-w/-s/-t/-c/-C/-S\n");
+        exit(EXIT_FAILURE);
+    }
+    if(config.coroutines > 0 && (config.relay || config.backends_file || config.processes > 0 ||
+                                 config.sequencer || config.xdp_ifname || config.session_ring > 0)){
+        fprintf(stderr, "Coroutine workers (-e) are only supported in the default threaded mode, without -S\n");
+        exit(EXIT_FAILURE);
+    }
+    if(config.backends_file){
+        init_router(&router);
+        if(load_backends(&router, config.backends_file) < 0){
+            exit(EXIT_FAILURE);
+        }
+        signal(SIGPIPE, SIG_IGN); // a dead backend must not kill the router
+        // no SA_RESTART: accept() returns EINTR so the reload happens promptly
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = handle_sighup;
+        sigaction(SIGHUP, &sa, NULL);
+    }
+
+    int connfd; // connection file descriptor
+    struct sockaddr_in cli_addr; // client address
+    socklen_t cli_len = sizeof(cli_addr);  // client address length
+
+    if(config.processes > 0){
+        printf("Server is listening on port %d with %d worker processes...\n", config.port, config.processes);
+        run_prefork(); // does not return
+    }
+    if(config.sequencer){
+        if(config.seq_sub_port == 0){
+            config.seq_sub_port = config.port + 1;
+        }
+        int listenfd = create_listen_socket(config.port);
+        if(listenfd < 0){
+            exit(EXIT_FAILURE);
+        }
+        signal(SIGPIPE, SIG_IGN);
+        if(config.capture_file && start_capture() < 0){
+            exit(EXIT_FAILURE);
+        }
+        run_sequencer(listenfd); // does not return
+    }
+    if(config.xdp_ifname){
+        autotune_kernels(config.kernel_cache);
+        run_xdp_ingest(); // does not return
+    }
+
+    // without -t, a single default tenant serves the port from the global queue
+    if(num_tenants == 0){
+        memset(&tenants[0], 0, sizeof(tenant_t));
+        strcpy(tenants[0].name, "default");
+        tenants[0].port = config.port;
+        tenants[0].num_workers = NUM_WORKER_THREADS;
+        num_tenants = 1;
+    }
+
+    // pick the fastest frame kernels for this host before serving
+    autotune_kernels(config.kernel_cache);
+    char kernels[BUFFER_SIZE];
+    autotune_report(kernels, sizeof(kernels));
+    printf("[STATS] %s\n", kernels);
+
+    rx_pool = frame_buf_pool_create(BUFFER_SIZE, RX_POOL_FREE);
+    if(rx_pool == NULL){
+        perror("Failed to create receive buffer pool");
+        exit(EXIT_FAILURE);
+    }
+    num_numa_nodes = numa_discover();
+    for(int n = 0; n < num_numa_nodes && num_numa_nodes > 1; n++){
+        numa_nodes[n].rx_pool = frame_buf_pool_create_on_node(BUFFER_SIZE, RX_POOL_FREE, numa_nodes[n].id);
+        if(numa_nodes[n].rx_pool == NULL){
+            perror("Failed to create receive buffer pool");
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(config.capture_file && start_capture() < 0){
+        exit(EXIT_FAILURE);
+    }
+
+    // once per slot: a handler of an expired session may still hold the mutex
+    for(int i = 0; i < MAX_SESSIONS; i++){
+        pthread_mutex_init(&sessions[i].mutex, NULL);
+    }
+
+    // restore aggregation state before serving, then keep checkpointing it
+    if(config.checkpoint_file){
+        restore_checkpoint(config.checkpoint_file);
+        pthread_t ckpt;
+        if(pthread_create(&ckpt, NULL, checkpoint_thread, NULL) != 0){
+            perror("Failed to create checkpoint thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(ckpt);
+    }
+
+    // initialize the connection queues
+    init_queue(&queue);
+    init_queue(&overflow_queue);
+    worker_group_t groups[MAX_TENANTS * MAX_NUMA_NODES];
+    int group_workers[MAX_TENANTS * MAX_NUMA_NODES];
+    int num_groups = 0, numa_split = 0;
+    for(int t = 0; t < num_tenants; t++){
+        if(t == 0){
+            tenants[t].queue = &queue;
+        }else if((tenants[t].queue = aligned_alloc(CACHE_LINE, sizeof(conn_queue_t))) == NULL){
+            perror("Failed to allocate memory for tenant queue");
+            exit(EXIT_FAILURE);
+        }else{
+            init_queue(tenants[t].queue);
+        }
+        if((tenants[t].listenfd = create_listen_socket(tenants[t].port)) < 0){
+            exit(EXIT_FAILURE);
+        }
+        if(num_numa_nodes > 1 && !tenants[t].pinned && tenants[t].num_workers >= num_numa_nodes){
+            // one group per node, pinned to its CPUs, each with its own queue
+            tenants[t].by_node = 1;
+            numa_split = 1;
+            for(int n = 0; n < num_numa_nodes; n++){
+                conn_queue_t *q = tenants[t].queue;
+                if(n > 0 && (q = aligned_alloc(CACHE_LINE, sizeof(conn_queue_t))) == NULL){
+                    perror("Failed to allocate memory for node queue");
+                    exit(EXIT_FAILURE);
+                }else if(n > 0){
+                    init_queue(q);
+                }
+                tenants[t].node_queue[n] = q;
+                groups[num_groups] = (worker_group_t){ .queue = q, .cpus = numa_nodes[n].cpus,
+                                                       .pinned = 1, .tenant = &tenants[t], .node = n };
+                group_workers[num_groups++] = tenants[t].num_workers / num_numa_nodes +
+                                              (n < tenants[t].num_workers % num_numa_nodes);
+            }
+            continue;
+        }
+        groups[num_groups] = (worker_group_t){ .queue = tenants[t].queue, .cpus = tenants[t].cpus,
+                                               .pinned = tenants[t].pinned, .tenant = &tenants[t], .node = -1 };
+        group_workers[num_groups++] = tenants[t].num_workers;
+    }
+    worker_group_t overflow_group = { .queue = &overflow_queue, .cpus = config.overflow_cpus,
+                                      .pinned = config.overflow_pinned, .tenant = NULL, .node = -1 };
+
+    // workers inherit a mask blocking SIGHUP, so it interrupts the accept loop
+    sigset_t hup_mask, old_mask;
+    sigemptyset(&hup_mask);
+    sigaddset(&hup_mask, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hup_mask, &old_mask);
+
+    // Create the worker groups for concurrent processing
+    for(int g = 0; g < num_groups; g++){
+        if(start_worker_group(&groups[g], group_workers[g]) < 0){
             exit(EXIT_FAILURE);
         }
-        pthread_detach(workers[i]); // detach threads for independent cleanup
     }
+    if(start_worker_group(&overflow_group, config.overflow_workers) < 0){
+        exit(EXIT_FAILURE);
+    }
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
 
-    printf("Server is listening on port %d...\n", PORT);
+    struct pollfd pfds[MAX_TENANTS];
+    for(int t = 0; t < num_tenants; t++){
+        pfds[t].fd = tenants[t].listenfd;
+        pfds[t].events = POLLIN;
+        printf("Server is listening on port %d (tenant %s, %d workers%s%s)...\n",
+                tenants[t].port, tenants[t].name, tenants[t].num_workers,
+                tenants[t].by_node ? " split across NUMA nodes" : "",
+                config.coroutines > 0 ? " running connections as coroutines" : "");
+    }
+    if(numa_split){
+        pthread_t stats;
+        if(pthread_create(&stats, NULL, numa_stats_thread, NULL) != 0){
+            perror("Failed to create NUMA stats thread");
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(stats);
+    }
+    if(config.overflow_workers > 0){
+        printf("Shared overflow pool: %d workers\n", config.overflow_workers);
+    }
+    if(config.relay){
+        printf("Relaying connections to upstream %s:%d\n",
+                inet_ntoa(upstream.addr.sin_addr), ntohs(upstream.addr.sin_port));
+    }
     
     // Main loop: accept incoming connections and enqueue them for processing
     while(1){
-        // accept a new connection
-        connfd = accept(sockfd, (struct sockaddr *)&cli_addr, &cli_len);
-        if(connfd < 0){
-            perror("Failed to accept connection");
+        int ready = poll(pfds, num_tenants, -1);
+        if(reload_backends){
+            reload_backends = 0;
+            load_backends(&router, config.backends_file);
+        }
+        if(ready < 0){
+            if(errno != EINTR){
+                perror("poll failed");
+            }
             continue;
         }
-        printf("Accepted connection from %s:%d\n", 
-                inet_ntoa(cli_addr.sin_addr), ntohs(cli_addr.sin_port));
-        // enqueue the connection for processing
-        enqueue(&queue, connfd);
+        for(int t = 0; t < num_tenants; t++){
+            if(!(pfds[t].revents & POLLIN)){
+                continue;
+            }
+            // accept a new connection
+            cli_len = sizeof(cli_addr);
+            connfd = accept(tenants[t].listenfd, (struct sockaddr *)&cli_addr, &cli_len);
+            if(connfd < 0){
+                perror("Failed to accept connection");
+                continue;
+            }
+            printf("Accepted connection from %s:%d (tenant %s)\n",
+                    inet_ntoa(cli_addr.sin_addr), ntohs(cli_addr.sin_port), tenants[t].name);
+            // enqueue the connection for processing
+            dispatch_connection(t, connfd);
+        }
     }
 
     // cleanup
-    close(sockfd);
-    for(int i = 0; i < NUM_WORKER_THREADS; i++){
-        pthread_join(workers[i], NULL);
+    for(int t = 0; t < num_tenants; t++){
+        close(tenants[t].listenfd);
     }
 
     return 0;
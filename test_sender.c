@@ -1,27 +1,101 @@
 /**
  * test_sender.c
  * Test data sender for mt_server and mt_client testing
+ *
+ * Usage: test_sender [-p port] [-U] [-b [-c]] [-g dist [-n len] [-s seed]] [-i interval_ms] [feed_key]
+ *  -p: connect to the given port instead of SERVER_PORT
+ *  -U: send each message as a UDP datagram to the port (see mt_server -x)
+ *  -b: send binary timestamped frames (see frame.h) instead of text lines
+ *  -c: append a CRC32C trailer to each binary frame
+ *  -g: send binary frames of len (default TEST_DATA_SIZE) synthetic bytes
+ *      drawn from a distribution such as uniform, alphabet:8, zipf:1.2 or
+ *      runs:16 (see frame_gen_init), each holding one SEARCH_BYTE
+ *  -s: seed for -g, so a run can be repeated byte for byte
+ *  -i: delay between messages in milliseconds (default 1000)
+ *  feed_key: announce the feed with a "FEED <key>" line first (router mode)
+ *
+ * Build: gcc -O2 -pthread -DALGO_NO_MAIN test_sender.c algo.c -o test_sender -lm
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include "algo.h"
+#include "frame.h"
+
 #define SERVER_IP "127.0.0.1"
 #define SERVER_PORT 8080
 #define TEST_DATA_SIZE 100
+#define MAX_GEN_LEN (64 * 1024) // largest -n
 
-int main(){
+int main(int argc, char *argv[]){
     int sockfd;
     struct sockaddr_in server_addr;
     char test_data[TEST_DATA_SIZE];
+    static uint8_t frame[FRAME_HDR_LEN + MAX_GEN_LEN + FRAME_CRC_LEN];
     int counter = 0;
+    int port = SERVER_PORT;
+    int binary = 0;
+    int with_crc = 0;
+    const char *gen_spec = NULL;
+    int gen_len = TEST_DATA_SIZE;
+    uint64_t seed = FRAME_GEN_DEFAULT_SEED;
+    frame_gen_t gen;
+    int interval_ms = 1000;
+    int udp = 0;
+
+    int c;
+    while((c = getopt(argc, argv, "p:Ubcg:n:s:i:")) != -1){
+        switch(c){
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'U':
+            udp = 1;
+            break;
+        case 'b':
+            binary = 1;
+            break;
+        case 'c':
+            with_crc = 1;
+            break;
+        case 'g':
+            gen_spec = optarg;
+            binary = 1;
+            break;
+        case 'n':
+            gen_len = atoi(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-p port] [-U] [-b [-c]] [-g dist [-n len] [-s seed]] "
+                            "[-i interval_ms] [feed_key]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if(gen_spec){
+        if(gen_len < 1 || gen_len > MAX_GEN_LEN || frame_gen_init(&gen, gen_spec, seed) < 0){
+            fprintf(stderr, "Bad -g distribution or -n length (1 to %d)\n", MAX_GEN_LEN);
+            exit(EXIT_FAILURE);
+        }
+        gen.target = SEARCH_BYTE;
+        gen.target_once = 1;
+    }
 
     // Create socket
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    sockfd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
     if(sockfd < 0){
         perror("Failed to create socket");
         exit(EXIT_FAILURE);
@@ -30,33 +104,74 @@ int main(){
     // Set up server address
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
+    server_addr.sin_port = htons(port);
     inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
 
-    // Connect to server
+    // Connect to server (for UDP, just fix the destination)
     if(connect(sockfd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0){
         perror("Failed to connect to server");
         close(sockfd);
         exit(EXIT_FAILURE);
     }
 
-    printf("[TEST_SENDER] Connected to server at %s:%d\n", SERVER_IP, SERVER_PORT);
+    printf("[TEST_SENDER] Connected to server at %s:%d\n", SERVER_IP, port);
+
+    // name the feed so a router can pick its backend
+    if(optind < argc){
+        snprintf(test_data, TEST_DATA_SIZE, "FEED %s\n", argv[optind]);
+        if(send(sockfd, test_data, strlen(test_data), 0) < 0){
+            perror("Failed to send feed key");
+            close(sockfd);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     // send test data in a loop
     while(1){
         snprintf(test_data, TEST_DATA_SIZE, "Test message #%d from sender", counter++);
-        
+
         // send data
-        if(send(sockfd, test_data, strlen(test_data), 0) < 0){
+        const void *msg = test_data;
+        size_t len = strlen(test_data);
+        if(binary){
+            // timestamped frame carrying the message text
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            if(gen_spec){
+                // synthetic payload instead of the message text
+                int pos = frame_gen_fill(&gen, frame + FRAME_HDR_LEN, gen_len);
+                snprintf(test_data, TEST_DATA_SIZE, "%d-byte %s frame #%d, byte %d at %d",
+                         gen_len, gen_spec, counter - 1, SEARCH_BYTE, pos);
+                len = gen_len;
+            }else{
+                memcpy(frame + FRAME_HDR_LEN, test_data, len);
+            }
+            frame_hdr_t hdr = { .len = len, .flags = with_crc ? FRAME_FLAG_CRC : 0,
+                                .ts_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec };
+            frame_encode_hdr(frame, &hdr);
+            msg = frame;
+            len += FRAME_HDR_LEN;
+            if(with_crc){
+                uint32_t crc = htonl(crc32c(0, frame, len));
+                memcpy(frame + len, &crc, FRAME_CRC_LEN);
+                len += FRAME_CRC_LEN;
+            }
+        }else{
+            // one '\n'-terminated line per message (see mt_server -l)
+            memcpy(frame, test_data, len);
+            frame[len++] = '\n';
+            msg = frame;
+        }
+        if(send(sockfd, msg, len, 0) < 0){
             perror("Failed to send data");
             break;
         }
 
         printf("[TEST_SENDER] Sent: %s\n", test_data);
-        sleep(1);
+        usleep(interval_ms * 1000);
     }
 
     close(sockfd);
     return 0;
 
-}
\ No newline at end of file
+}